@@ -0,0 +1,102 @@
+/* fsimg.h - Host-side view of the ECE391 filesystem image format
+ *
+ * Mirrors the structures in student-distrib/filesys.h with <stdint.h>
+ * types so that the image tools can be built with the host compiler.
+ * Keep the two files in sync.
+ */
+
+#if !defined(FSIMG_H)
+#define FSIMG_H
+
+#include <stdint.h>
+
+#define MAX_FILE_NAME 32
+#define MAX_DATA_BLOCKS 1023
+#define MAX_DIR_ENTRIES 63
+#define MAX_BOOT_RESERVED 52
+
+#define BLOCK_SIZE 4096
+
+#define FILE_TYPE_RTC 0
+#define FILE_TYPE_DIR 1
+#define FILE_TYPE_REG 2
+
+/* Layout hints stored in the reserved bytes of the boot block */
+#define FS_EXT_MAGIC 0x31394653         /* "SF91" */
+#define FS_EXT_VERSION 1
+#define FS_EXT_VERSION_LARGE 2          /* INDIRECT and DIRBLOCKS may be set */
+#define FS_EXT_VERSION_TREE 3           /* SUBDIRS may be set too */
+#define FS_EXT_VERSION_LZ4 4            /* LZ4 may be set too */
+#define FS_FLAG_SORTED 0x01             /* dentries sorted by name (or by bucket, then name) */
+#define FS_FLAG_HASHED 0x02             /* bucket_start[] is valid */
+#define FS_FLAG_INDIRECT 0x04           /* last two inode slots are single/double indirect blocks */
+#define FS_FLAG_DIRBLOCKS 0x08          /* dentries past MAX_DIR_ENTRIES live in inode dir_inode */
+#define FS_FLAG_SUBDIRS 0x10            /* directory dentries with a nonzero inode are subdirectories */
+#define FS_FLAG_LZ4 0x20                /* regular files are LZ4 compressed one block at a time */
+#define FS_HASH_BUCKETS 39              /* bucket_start[] + dir_inode fill the 52 reserved bytes */
+#define FS_HASH_MAX_ENTRIES 255         /* bucket_start[] holds 8-bit indices */
+
+#define FS_DIRECT_BLOCKS 1021
+#define FS_SINGLE_INDIRECT 1021
+#define FS_DOUBLE_INDIRECT 1022
+#define FS_PTRS_PER_BLOCK (BLOCK_SIZE / 4)
+#define FS_DENTRIES_PER_BLOCK (BLOCK_SIZE / 64)
+/* Compressed files: data_block_num[0] is the first data block of the
+ * compressed blocks, stored back to back; data_block_num[1 + k] is the
+ * byte offset of block k from there, data_block_num[1 + nblocks] the end */
+#define FS_LZ4_RAW 0x80000000u          /* offset flag: the block is stored uncompressed */
+#define FS_LZ4_MAX_BLOCKS (MAX_DATA_BLOCKS - 2)
+#define FS_MAX_FILE_BLOCKS ((uint64_t)FS_DIRECT_BLOCKS + FS_PTRS_PER_BLOCK \
+                            + (uint64_t)FS_PTRS_PER_BLOCK * FS_PTRS_PER_BLOCK)
+
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint8_t num_buckets;
+    uint8_t pad;
+    uint8_t bucket_start[FS_HASH_BUCKETS + 1];  /* first dentry of each bucket, plus end sentinel */
+    uint32_t dir_inode;                         /* inode holding dentries MAX_DIR_ENTRIES and up */
+} __attribute__((packed)) fs_ext_t;
+
+typedef struct {
+    char file_name[MAX_FILE_NAME];
+    uint32_t file_type;
+    uint32_t inode_num;
+    uint8_t reserved[24];
+} __attribute__((packed)) dentry_t;
+
+typedef struct {
+    uint32_t num_dir_entries;
+    uint32_t num_inodes;
+    uint32_t num_data_blocks;
+    union {
+        uint8_t reserved[MAX_BOOT_RESERVED];
+        fs_ext_t ext;
+    };
+    dentry_t dir_entries_arr[MAX_DIR_ENTRIES];
+} __attribute__((packed)) boot_block_t;
+
+typedef struct {
+    uint32_t file_size;
+    uint32_t data_block_num[MAX_DATA_BLOCKS];
+} __attribute__((packed)) inode_t;
+
+/*
+ * fs_name_hash
+ *   DESCRIPTION: FNV-1a hash of a (possibly unterminated) file name;
+ *                must match fs_name_hash() in student-distrib/filesys.c
+ *   INPUTS: name - the file name, at most MAX_FILE_NAME bytes are used
+ *   RETURN VALUE: the 32-bit hash
+ */
+static inline uint32_t fs_name_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    int i;
+    for (i = 0; i < MAX_FILE_NAME && name[i]; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#endif /* FSIMG_H */
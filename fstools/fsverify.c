@@ -0,0 +1,543 @@
+/* fsverify.c - Checks an ECE391 filesystem image against a reference
+ *
+ * Usage: fsverify [-s] [-t] <image> <reference>
+ *
+ * Validates the layout of <image> (sort order, hash bucket index,
+ * block ranges, contiguity, subdirectories) and then checks that every file of
+ * <reference> (normally student-distrib/filesys_img) exists in
+ * <image> with the same type and contents.  Entries present in only
+ * one of the two images are listed; with -s they count as errors.
+ * Compressed (-z) images have every block decoded; -t also reports
+ * the compression ratio and how fast the files decompress.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fsimg.h"
+#include "lz4.h"
+
+typedef struct {
+    const char* path;
+    uint8_t* data;
+    size_t size;
+    boot_block_t* boot;
+} image_t;
+
+static int errors = 0;
+static uint64_t lz4_raw, lz4_packed;    /* file bytes before and after compression */
+
+#define FAIL(...) do { fprintf(stderr, "fsverify: " __VA_ARGS__); errors++; } while (0)
+
+static uint32_t flags_of(const image_t* img) {
+    return img->boot->ext.magic == FS_EXT_MAGIC ? img->boot->ext.flags : 0;
+}
+
+/*
+ * load_image
+ *   DESCRIPTION: reads a whole image file and checks its block counts
+ *   RETURN VALUE: 0 on success, -1 on failure
+ */
+static int load_image(image_t* img, const char* path) {
+    FILE* f = fopen(path, "rb");
+    long len;
+    img->path = path;
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    img->size = (size_t)len;
+    img->data = malloc(img->size);
+    if (len < BLOCK_SIZE || !img->data || fread(img->data, 1, img->size, f) != img->size) {
+        fprintf(stderr, "fsverify: cannot read %s\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    img->boot = (boot_block_t*)img->data;
+    if ((img->boot->num_dir_entries > MAX_DIR_ENTRIES && !(flags_of(img) & FS_FLAG_DIRBLOCKS))
+        || (size_t)(1 + img->boot->num_inodes + img->boot->num_data_blocks) * BLOCK_SIZE > img->size) {
+        fprintf(stderr, "fsverify: %s: counts exceed the image size\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static inode_t* get_inode(const image_t* img, uint32_t inode) {
+    return (inode_t*)(img->data + (size_t)(1 + inode) * BLOCK_SIZE);
+}
+
+static uint8_t* get_block(const image_t* img, uint32_t block) {
+    return img->data + (size_t)(1 + img->boot->num_inodes + block) * BLOCK_SIZE;
+}
+
+/*
+ * file_block
+ *   DESCRIPTION: maps block \p k of \p ino like fs_block_map() in the
+ *                kernel, following indirect blocks on version 2 images
+ *   RETURN VALUE: the data block number, num_data_blocks if invalid
+ */
+static uint32_t file_block(const image_t* img, const inode_t* ino, uint32_t k) {
+    uint32_t invalid = img->boot->num_data_blocks, table;
+
+    if (!(flags_of(img) & FS_FLAG_INDIRECT))
+        return k < MAX_DATA_BLOCKS ? ino->data_block_num[k] : invalid;
+    if (k < FS_DIRECT_BLOCKS)
+        return ino->data_block_num[k];
+    k -= FS_DIRECT_BLOCKS;
+    if (k < FS_PTRS_PER_BLOCK) {
+        table = ino->data_block_num[FS_SINGLE_INDIRECT];
+    } else {
+        k -= FS_PTRS_PER_BLOCK;
+        table = ino->data_block_num[FS_DOUBLE_INDIRECT];
+        if (table >= invalid || k / FS_PTRS_PER_BLOCK >= FS_PTRS_PER_BLOCK)
+            return invalid;
+        table = ((uint32_t*)get_block(img, table))[k / FS_PTRS_PER_BLOCK];
+        k %= FS_PTRS_PER_BLOCK;
+    }
+    if (table >= invalid)
+        return invalid;
+    return ((uint32_t*)get_block(img, table))[k];
+}
+
+/*
+ * get_dentry
+ *   DESCRIPTION: locates dentry \p i, which may live in the directory
+ *                inode's data on version 2 images
+ *   RETURN VALUE: the dentry, or NULL
+ */
+static dentry_t* get_dentry(const image_t* img, uint32_t i) {
+    uint32_t block;
+    if (i < MAX_DIR_ENTRIES)
+        return &img->boot->dir_entries_arr[i];
+    if (!(flags_of(img) & FS_FLAG_DIRBLOCKS) || img->boot->ext.dir_inode >= img->boot->num_inodes)
+        return NULL;
+    i -= MAX_DIR_ENTRIES;
+    block = file_block(img, get_inode(img, img->boot->ext.dir_inode), i / FS_DENTRIES_PER_BLOCK);
+    if (block >= img->boot->num_data_blocks)
+        return NULL;
+    return (dentry_t*)get_block(img, block) + i % FS_DENTRIES_PER_BLOCK;
+}
+
+static const char* name_at(const image_t* img, uint32_t i) {
+    dentry_t* d = get_dentry(img, i);
+    return d ? d->file_name : "";
+}
+
+/*
+ * subdir_entries
+ *   DESCRIPTION: number of dentries in the directory inode \p dir
+ */
+static uint32_t subdir_entries(const image_t* img, uint32_t dir) {
+    return get_inode(img, dir)->file_size / sizeof(dentry_t);
+}
+
+/*
+ * subdir_dentry
+ *   DESCRIPTION: locates dentry \p i of the directory inode \p dir
+ *   RETURN VALUE: the dentry, or NULL
+ */
+static dentry_t* subdir_dentry(const image_t* img, uint32_t dir, uint32_t i) {
+    uint32_t block;
+    if (i >= subdir_entries(img, dir))
+        return NULL;
+    block = file_block(img, get_inode(img, dir), i / FS_DENTRIES_PER_BLOCK);
+    if (block >= img->boot->num_data_blocks)
+        return NULL;
+    return (dentry_t*)get_block(img, block) + i % FS_DENTRIES_PER_BLOCK;
+}
+
+/*
+ * subdir_lookup
+ *   DESCRIPTION: binary searches the directory inode \p dir for \p name
+ *                like read_dentry_in_dir() in the kernel
+ *   RETURN VALUE: dentry index, or -1 if absent
+ */
+static int subdir_lookup(const image_t* img, uint32_t dir, const char* name) {
+    int lo = 0, hi = (int)subdir_entries(img, dir);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        dentry_t* d = subdir_dentry(img, dir, mid);
+        int cmp;
+        if (!d)
+            return -1;
+        if (!(cmp = strncmp(name, d->file_name, MAX_FILE_NAME)))
+            return mid;
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return -1;
+}
+
+/*
+ * lookup
+ *   DESCRIPTION: finds \p name the same way read_dentry_by_name() in
+ *                the kernel does, using the bucket index or binary
+ *                search when the image advertises them
+ *   RETURN VALUE: dentry index, or -1 if absent
+ */
+static int lookup(const image_t* img, const char* name) {
+    const boot_block_t* boot = img->boot;
+    int lo = 0, hi = (int)boot->num_dir_entries, i;
+
+    if (flags_of(img) & FS_FLAG_HASHED) {
+        uint32_t b = fs_name_hash(name) % boot->ext.num_buckets;
+        for (i = boot->ext.bucket_start[b]; i < boot->ext.bucket_start[b + 1]; i++)
+            if (!strncmp(name, name_at(img, i), MAX_FILE_NAME))
+                return i;
+        return -1;
+    }
+    if (flags_of(img) & FS_FLAG_SORTED) {
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            int cmp = strncmp(name, name_at(img, mid), MAX_FILE_NAME);
+            if (!cmp)
+                return mid;
+            if (cmp < 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return -1;
+    }
+    for (i = 0; i < (int)boot->num_dir_entries; i++)
+        if (!strncmp(name, name_at(img, i), MAX_FILE_NAME))
+            return i;
+    return -1;
+}
+
+/*
+ * lz4_block
+ *   DESCRIPTION: decodes block \p k of a compressed file into \p dst
+ *   RETURN VALUE: the decoded length, -1 if the index or data is bad
+ */
+static int lz4_block(const image_t* img, const inode_t* ino, uint32_t k, uint8_t* dst) {
+    uint32_t nblk = (ino->file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t want = ino->file_size - k * BLOCK_SIZE < BLOCK_SIZE ? ino->file_size - k * BLOCK_SIZE : BLOCK_SIZE;
+    uint32_t start, end;
+    const uint8_t* src;
+
+    if (k >= nblk || nblk > FS_LZ4_MAX_BLOCKS)
+        return -1;
+    start = ino->data_block_num[1 + k] & ~FS_LZ4_RAW;
+    end = ino->data_block_num[2 + k] & ~FS_LZ4_RAW;
+    if (end < start || ino->data_block_num[0] >= img->boot->num_data_blocks
+        || (uint64_t)ino->data_block_num[0] * BLOCK_SIZE + end > (uint64_t)img->boot->num_data_blocks * BLOCK_SIZE)
+        return -1;
+    src = get_block(img, ino->data_block_num[0]) + start;
+    if (ino->data_block_num[1 + k] & FS_LZ4_RAW) {
+        if (end - start != want)
+            return -1;
+        memcpy(dst, src, want);
+        return want;
+    }
+    return lz4_decompress(src, end - start, dst, want) == (int)want ? (int)want : -1;
+}
+
+/*
+ * check_file
+ *   DESCRIPTION: checks that the blocks of a regular file are in range
+ *                and counts whether they form one contiguous run
+ */
+static void check_file(const image_t* img, const dentry_t* d, const char* name,
+                       uint32_t* files, uint32_t* contiguous) {
+    const boot_block_t* boot = img->boot;
+    inode_t* ino;
+    uint32_t k, nblk, first;
+
+    if (d->inode_num >= boot->num_inodes) {
+        FAIL("%s: \"%s\" has bad inode %u\n", img->path, name, d->inode_num);
+        return;
+    }
+    ino = get_inode(img, d->inode_num);
+    nblk = (ino->file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (nblk > (flags_of(img) & FS_FLAG_INDIRECT ? FS_MAX_FILE_BLOCKS : MAX_DATA_BLOCKS)) {
+        FAIL("%s: \"%s\" is too large\n", img->path, name);
+        return;
+    }
+    (*files)++;
+    if (flags_of(img) & FS_FLAG_LZ4) {
+        uint8_t buf[BLOCK_SIZE];
+        if (nblk > FS_LZ4_MAX_BLOCKS) {
+            FAIL("%s: \"%s\" is too large\n", img->path, name);
+            return;
+        }
+        for (k = 0; k < nblk; k++) {
+            if (lz4_block(img, ino, k, buf) < 0) {
+                FAIL("%s: \"%s\" block %u does not decompress\n", img->path, name, k);
+                return;
+            }
+        }
+        lz4_raw += ino->file_size;
+        lz4_packed += ino->data_block_num[1 + nblk] & ~FS_LZ4_RAW;
+        (*contiguous)++;                /* compressed blocks are stored back to back */
+        return;
+    }
+    first = nblk ? file_block(img, ino, 0) : 0;
+    for (k = 0; k < nblk; k++) {
+        uint32_t block = file_block(img, ino, k);
+        if (block >= boot->num_data_blocks) {
+            FAIL("%s: \"%s\" block %u out of range\n", img->path, name, k);
+            break;
+        }
+        if (block != first + k)
+            break;
+    }
+    if (k == nblk)
+        (*contiguous)++;
+}
+
+/*
+ * check_subdir
+ *   DESCRIPTION: checks a subdirectory and everything below it: sorted
+ *                names, "." naming the directory, every entry reachable
+ *                by lookup, and the files' blocks
+ *   INPUTS: dir - its inode, path - its path for messages, depth - to
+ *           stop at directory cycles
+ */
+static void check_subdir(const image_t* img, uint32_t dir, const char* path, int depth,
+                         uint32_t* files, uint32_t* contiguous, uint32_t* dirs) {
+    uint32_t i, n;
+    char name[MAX_FILE_NAME + 1], sub[1024];
+
+    if (dir == 0 || dir >= img->boot->num_inodes || depth > 64) {
+        FAIL("%s: directory %s has bad inode %u\n", img->path, path, dir);
+        return;
+    }
+    (*dirs)++;
+    n = subdir_entries(img, dir);
+    if (subdir_lookup(img, dir, ".") < 0 || subdir_dentry(img, dir, subdir_lookup(img, dir, "."))->inode_num != dir)
+        FAIL("%s: %s has no \".\" naming itself\n", img->path, path);
+    for (i = 0; i < n; i++) {
+        const dentry_t* d = subdir_dentry(img, dir, i);
+        if (!d) {
+            FAIL("%s: %s entry %u is unreachable\n", img->path, path, i);
+            continue;
+        }
+        snprintf(name, sizeof(name), "%.*s", MAX_FILE_NAME, d->file_name);
+        snprintf(sub, sizeof(sub), "%s/%s", path, name);
+        if (i > 0 && memcmp(subdir_dentry(img, dir, i - 1)->file_name, d->file_name, MAX_FILE_NAME) >= 0)
+            FAIL("%s: %s entries %u and %u out of order\n", img->path, path, i - 1, i);
+        if (subdir_lookup(img, dir, name) != (int)i)
+            FAIL("%s: lookup of \"%s\" does not find it\n", img->path, sub);
+        if (d->file_type == FILE_TYPE_REG)
+            check_file(img, d, sub, files, contiguous);
+        else if (d->file_type == FILE_TYPE_DIR && strcmp(name, "."))
+            check_subdir(img, d->inode_num, sub, depth + 1, files, contiguous, dirs);
+    }
+}
+
+/*
+ * check_layout
+ *   DESCRIPTION: validates the structural invariants mkfsimg promises
+ */
+static void check_layout(const image_t* img) {
+    const boot_block_t* boot = img->boot;
+    uint32_t i, contiguous = 0, files = 0, dirs = 0;
+    char name[MAX_FILE_NAME + 1];
+
+    for (i = 0; i < boot->num_dir_entries; i++) {
+        const dentry_t* d = get_dentry(img, i);
+
+        if (!d) {
+            FAIL("%s: entry %u is unreachable\n", img->path, i);
+            continue;
+        }
+        snprintf(name, sizeof(name), "%.*s", MAX_FILE_NAME, d->file_name);
+        if (lookup(img, name) != (int)i)
+            FAIL("%s: lookup of \"%s\" does not find entry %u\n", img->path, name, i);
+        if (d->file_type == FILE_TYPE_REG)
+            check_file(img, d, name, &files, &contiguous);
+        else if (d->file_type == FILE_TYPE_DIR && d->inode_num && (flags_of(img) & FS_FLAG_SUBDIRS))
+            check_subdir(img, d->inode_num, name, 0, &files, &contiguous, &dirs);
+    }
+
+    if (boot->ext.magic != FS_EXT_MAGIC) {
+        printf("%s: no layout header, %u/%u files contiguous\n", img->path, contiguous, files);
+        return;
+    }
+
+    for (i = 1; i < boot->num_dir_entries; i++) {
+        const char* prev = name_at(img, i - 1);
+        const char* curr = name_at(img, i);
+        if (boot->ext.flags & FS_FLAG_HASHED) {
+            uint32_t pb = fs_name_hash(prev) % boot->ext.num_buckets;
+            uint32_t cb = fs_name_hash(curr) % boot->ext.num_buckets;
+            if (pb > cb || (pb == cb && memcmp(prev, curr, MAX_FILE_NAME) > 0))
+                FAIL("%s: entries %u and %u out of bucket order\n", img->path, i - 1, i);
+        } else if ((boot->ext.flags & FS_FLAG_SORTED) && memcmp(prev, curr, MAX_FILE_NAME) > 0) {
+            FAIL("%s: entries %u and %u out of order\n", img->path, i - 1, i);
+        }
+    }
+    if (contiguous != files)
+        FAIL("%s: only %u/%u files are contiguous\n", img->path, contiguous, files);
+    printf("%s: version %u, flags 0x%x, %u entries, %u subdirectories, %u/%u files contiguous\n",
+           img->path, boot->ext.version, boot->ext.flags, boot->num_dir_entries, dirs, contiguous, files);
+}
+
+/*
+ * read_file
+ *   DESCRIPTION: gathers the contents of \p inode into a new buffer
+ *   RETURN VALUE: the buffer (caller frees), size stored in \p size
+ */
+static uint8_t* read_file(const image_t* img, uint32_t inode, uint32_t* size) {
+    inode_t* ino = get_inode(img, inode);
+    uint8_t* buf = malloc(ino->file_size + 1);
+    uint32_t done, k;
+    for (done = 0, k = 0; done < ino->file_size; k++) {
+        uint32_t n = ino->file_size - done < BLOCK_SIZE ? ino->file_size - done : BLOCK_SIZE;
+        uint32_t block;
+        if (flags_of(img) & FS_FLAG_LZ4) {
+            if (lz4_block(img, ino, k, buf + done) < 0) {
+                free(buf);
+                return NULL;
+            }
+            done += n;
+            continue;
+        }
+        block = file_block(img, ino, k);
+        if (block >= img->boot->num_data_blocks) {
+            free(buf);
+            return NULL;
+        }
+        memcpy(buf + done, get_block(img, block), n);
+        done += n;
+    }
+    *size = ino->file_size;
+    return buf;
+}
+
+/*
+ * compare
+ *   DESCRIPTION: checks every entry of \p ref against \p img
+ */
+static void compare(const image_t* img, const image_t* ref, int strict) {
+    uint32_t i, matched = 0;
+    char name[MAX_FILE_NAME + 1];
+
+    for (i = 0; i < ref->boot->num_dir_entries; i++) {
+        const dentry_t* rd = get_dentry(ref, i);
+        const dentry_t* d;
+        int idx;
+
+        if (!rd)
+            continue;
+        snprintf(name, sizeof(name), "%.*s", MAX_FILE_NAME, rd->file_name);
+        if ((idx = lookup(img, name)) < 0) {
+            if (strict)
+                FAIL("\"%s\" only in %s\n", name, ref->path);
+            else
+                printf("only in %s: %s\n", ref->path, name);
+            continue;
+        }
+        d = get_dentry(img, idx);
+        if (d->file_type != rd->file_type) {
+            FAIL("\"%s\": type %u, expected %u\n", name, d->file_type, rd->file_type);
+            continue;
+        }
+        if (d->file_type == FILE_TYPE_REG) {
+            uint32_t size, ref_size;
+            uint8_t* data = read_file(img, d->inode_num, &size);
+            uint8_t* ref_data = read_file(ref, rd->inode_num, &ref_size);
+            if (!data || !ref_data || size != ref_size || memcmp(data, ref_data, size))
+                FAIL("\"%s\": contents differ\n", name);
+            else
+                matched++;
+            free(data);
+            free(ref_data);
+        } else {
+            matched++;
+        }
+    }
+    for (i = 0; i < img->boot->num_dir_entries; i++) {
+        snprintf(name, sizeof(name), "%.*s", MAX_FILE_NAME, name_at(img, i));
+        if (lookup(ref, name) >= 0)
+            continue;
+        if (strict)
+            FAIL("\"%s\" only in %s\n", name, img->path);
+        else
+            printf("only in %s: %s\n", img->path, name);
+    }
+    printf("%u/%u reference entries match\n", matched, ref->boot->num_dir_entries);
+}
+
+/*
+ * report_lz4
+ *   DESCRIPTION: -t: prints how much the files of a compressed image
+ *                shrank (as counted by check_file) and how fast the top
+ *                directory's files decode, block by block as the kernel
+ *                reads them
+ */
+static void report_lz4(const image_t* img) {
+    uint64_t decoded = 0;
+    uint8_t buf[BLOCK_SIZE];
+    struct timespec t0, t1;
+    double secs;
+    uint32_t i, k, nblk, pass;
+
+    if (!(flags_of(img) & FS_FLAG_LZ4)) {
+        printf("%s: not compressed\n", img->path);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (pass = 0; pass < 100; pass++) {
+        for (i = 0; i < img->boot->num_dir_entries; i++) {
+            const dentry_t* d = get_dentry(img, i);
+            const inode_t* ino;
+            if (!d || d->file_type != FILE_TYPE_REG || d->inode_num >= img->boot->num_inodes)
+                continue;
+            ino = get_inode(img, d->inode_num);
+            nblk = (ino->file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            for (k = 0; k < nblk; k++) {
+                int n = lz4_block(img, ino, k, buf);
+                decoded += n > 0 ? n : 0;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    printf("%s: %llu bytes of files stored in %llu (%.1f%%), %.1f MB/s decompressed\n", img->path,
+           (unsigned long long)lz4_raw, (unsigned long long)lz4_packed,
+           lz4_raw ? 100.0 * lz4_packed / lz4_raw : 100.0,
+           secs > 0 ? decoded / secs / 1e6 : 0.0);
+}
+
+int main(int argc, char** argv) {
+    image_t img, ref;
+    int strict = 0, timing = 0, arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (!strcmp(argv[arg], "-s"))
+            strict = 1;
+        else if (!strcmp(argv[arg], "-t"))
+            timing = 1;
+        else
+            break;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "usage: fsverify [-s] [-t] <image> <reference>\n");
+        return 2;
+    }
+    if (load_image(&img, argv[arg]) || load_image(&ref, argv[arg + 1]))
+        return 2;
+
+    check_layout(&img);
+    compare(&img, &ref, strict);
+    if (timing)
+        report_lz4(&img);
+
+    if (errors) {
+        printf("FAILED: %d error(s)\n", errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
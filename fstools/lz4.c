@@ -0,0 +1,149 @@
+/* lz4.c - LZ4 block compressor and decoder for the image tools */
+
+#include <string.h>
+
+#include "lz4.h"
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5                 /* the block ends with at least 5 literals */
+#define MF_LIMIT 12                     /* no match starts in the last 12 bytes */
+#define MAX_OFFSET 65535
+#define HASH_BITS 12
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/*
+ * put_length
+ *   DESCRIPTION: writes the part of a length above 15 as 255-bytes
+ *   RETURN VALUE: bytes written, or -1 if \p cap is exceeded
+ */
+static int put_length(uint32_t n, uint8_t* dst, uint32_t cap) {
+    uint32_t i = 0;
+    for (; n >= 255; n -= 255) {
+        if (i == cap)
+            return -1;
+        dst[i++] = 255;
+    }
+    if (i == cap)
+        return -1;
+    dst[i++] = (uint8_t)n;
+    return (int)i;
+}
+
+/*
+ * put_sequence
+ *   DESCRIPTION: emits literals [lit, lit + nlit) followed by a match
+ *                of \p mlen bytes at \p offset, or no match if mlen is 0
+ *   RETURN VALUE: bytes written, or -1 if \p cap is exceeded
+ */
+static int put_sequence(const uint8_t* lit, uint32_t nlit, uint32_t offset, uint32_t mlen,
+                        uint8_t* dst, uint32_t cap) {
+    uint32_t op = 1;
+    int n;
+
+    if (cap < 1)
+        return -1;
+    dst[0] = (uint8_t)((nlit < 15 ? nlit : 15) << 4);
+    if (nlit >= 15) {
+        if ((n = put_length(nlit - 15, dst + op, cap - op)) < 0)
+            return -1;
+        op += n;
+    }
+    if (cap - op < nlit)
+        return -1;
+    memcpy(dst + op, lit, nlit);
+    op += nlit;
+    if (!mlen)
+        return (int)op;
+
+    if (cap - op < 2)
+        return -1;
+    dst[op++] = (uint8_t)offset;
+    dst[op++] = (uint8_t)(offset >> 8);
+    mlen -= MIN_MATCH;
+    dst[0] |= (uint8_t)(mlen < 15 ? mlen : 15);
+    if (mlen >= 15) {
+        if ((n = put_length(mlen - 15, dst + op, cap - op)) < 0)
+            return -1;
+        op += n;
+    }
+    return (int)op;
+}
+
+int lz4_compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap) {
+    uint32_t table[1 << HASH_BITS];
+    uint32_t ip = 0, anchor = 0, op = 0, ref, mlen, h;
+    int n;
+
+    memset(table, 0xFF, sizeof(table));
+    while (len > MF_LIMIT && ip < len - MF_LIMIT) {
+        h = hash4(read32(src + ip));
+        ref = table[h];
+        table[h] = ip;
+        if (ref == 0xFFFFFFFFu || ip - ref > MAX_OFFSET || read32(src + ref) != read32(src + ip)) {
+            ip++;
+            continue;
+        }
+        for (mlen = MIN_MATCH; ip + mlen < len - LAST_LITERALS && src[ref + mlen] == src[ip + mlen]; mlen++)
+            ;
+        if ((n = put_sequence(src + anchor, ip - anchor, ip - ref, mlen, dst + op, cap - op)) < 0)
+            return -1;
+        op += n;
+        ip += mlen;
+        anchor = ip;
+    }
+    if ((n = put_sequence(src + anchor, len - anchor, 0, 0, dst + op, cap - op)) < 0)
+        return -1;
+    return (int)(op + n);
+}
+
+int lz4_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap) {
+    uint32_t ip = 0, op = 0, n, offset;
+    uint8_t token, b;
+
+    while (ip < len) {
+        token = src[ip++];
+        n = token >> 4;
+        if (n == 15) {
+            do {
+                if (ip == len)
+                    return -1;
+                n += b = src[ip++];
+            } while (b == 255);
+        }
+        if (n > len - ip || n > cap - op)
+            return -1;
+        memcpy(dst + op, src + ip, n);
+        ip += n;
+        op += n;
+        if (ip == len)
+            break;                      /* the last sequence has no match */
+
+        if (len - ip < 2)
+            return -1;
+        offset = src[ip] | (uint32_t)src[ip + 1] << 8;
+        ip += 2;
+        n = token & 15;
+        if (n == 15) {
+            do {
+                if (ip == len)
+                    return -1;
+                n += b = src[ip++];
+            } while (b == 255);
+        }
+        n += MIN_MATCH;
+        if (offset == 0 || offset > op || n > cap - op)
+            return -1;
+        for (; n; n--, op++)
+            dst[op] = dst[op - offset];
+    }
+    return (int)op;
+}
@@ -0,0 +1,29 @@
+/* lz4.h - LZ4 block format (no frame) for the image tools
+ *
+ * Compressed blocks of version 4 images use the plain LZ4 block format
+ * so that student-distrib/lz4.c can decode them without the frame
+ * header, checksums or dictionaries.
+ */
+
+#if !defined(LZ4_H)
+#define LZ4_H
+
+#include <stdint.h>
+
+/*
+ * lz4_compress
+ *   DESCRIPTION: greedy single-probe compressor; compresses \p len
+ *                bytes of \p src into at most \p cap bytes of \p dst
+ *   RETURN VALUE: the compressed size, or -1 if it does not fit
+ */
+int lz4_compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap);
+
+/*
+ * lz4_decompress
+ *   DESCRIPTION: decodes \p len bytes of \p src into at most \p cap
+ *                bytes of \p dst, checking every length and offset
+ *   RETURN VALUE: the decompressed size, or -1 if the input is corrupt
+ */
+int lz4_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap);
+
+#endif /* LZ4_H */
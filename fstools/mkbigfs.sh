@@ -0,0 +1,43 @@
+#!/bin/sh
+# mkbigfs.sh - Builds a large test image from ../fsdir
+#
+# Usage: mkbigfs.sh [output]
+#
+# Copies ../fsdir, adds a 64MB big.dat (needs indirect blocks), a nested
+# tree/ directory (needs subdirectories) and enough small files to reach
+# 1000 directory entries (needs directory blocks), then runs mkfsimg on
+# the result.  Boot it with more guest RAM than the
+# default, e.g. qemu -m 256, since the module is relocated past 8MB.
+
+set -e
+
+OUT=${1:-bigfs_img}
+FSDIR=${FSDIR:-../fsdir}
+ENTRIES=${ENTRIES:-1000}
+BIGMB=${BIGMB:-64}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cp -r "$FSDIR"/* "$TMP"/
+dd if=/dev/urandom of="$TMP/big.dat" bs=1M count="$BIGMB" 2>/dev/null
+
+# a few levels of subdirectories, tree/sub/sub/sub (a version 3 image)
+d="$TMP/tree"
+for level in 1 2 3 4; do
+    mkdir -p "$d"
+    for j in 0 1 2 3 4 5 6 7; do
+        printf 'level %d file %d\n' "$level" "$j" > "$d/l$level-$j.txt"
+    done
+    d="$d/sub"
+done
+
+# "." and "rtc" are added by mkfsimg
+n=$(ls "$TMP" | wc -l)
+i=0
+while [ $((n + 2)) -lt "$ENTRIES" ]; do
+    printf 'small file %d\n' "$i" > "$TMP/f$i.txt"
+    i=$((i + 1))
+    n=$((n + 1))
+done
+
+./mkfsimg -i "$TMP" -o "$OUT" -H -v
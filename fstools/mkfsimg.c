@@ -0,0 +1,506 @@
+/* mkfsimg.c - Builds an ECE391 filesystem image from a host directory
+ *
+ * Usage: mkfsimg -i <fsdir> -o <image> [-H] [-z] [-n <inodes>] [-v]
+ *
+ * Produces the same boot block / inode / data block format as the
+ * createfs binary, but with a deterministic layout:
+ *   - directory entries are sorted by name (by hash bucket, then name
+ *     when -H is given), so the kernel can binary search them;
+ *   - inodes are numbered in dentry order, and every file's data
+ *     blocks are allocated back to back, so a file occupies one
+ *     contiguous, page-aligned run of the image;
+ *   - with -H, a bucket index of the name hashes is stored in the
+ *     reserved bytes of the boot block.
+ *
+ * Trees that do not fit the original format (a file over 1023 blocks,
+ * or more than 63 entries) produce a version 2 image: inode slots 1021
+ * and 1022 become single and double indirect blocks, and dentries past
+ * the 63 in the boot block are stored in the data of a directory inode.
+ *
+ * Subdirectories of <fsdir> produce a version 3 image: each one gets a
+ * directory inode whose data is its sorted dentries, starting with "."
+ * naming the directory itself, and its dentry in the parent has type 1
+ * and that inode.  "." of the top directory keeps inode 0.
+ *
+ * With -z every regular file is compressed one 4KB block at a time with
+ * LZ4 (a version 4 image).  The inode then holds a block index instead
+ * of block numbers, see FS_LZ4_RAW in fsimg.h, so the kernel can decode
+ * just the blocks a read touches.  Compressed files are limited to
+ * FS_LZ4_MAX_BLOCKS blocks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fsimg.h"
+#include "lz4.h"
+
+typedef struct dir dir_t;
+
+typedef struct {
+    dentry_t dentry;
+    char path[1024];            /* host path of the file contents */
+    uint32_t size;              /* size of the file in bytes */
+    uint32_t bucket;            /* hash bucket of the name */
+    dir_t* sub;                 /* contents of a subdirectory */
+    uint8_t* z;                 /* -z: the compressed blocks, back to back */
+    uint32_t zsize;             /* -z: their total size */
+    uint32_t* zindex;           /* -z: offset of each block in z, plus the end */
+} entry_t;
+
+struct dir {
+    entry_t* entries;
+    int num_entries;
+    int max_entries;
+};
+
+static dir_t root;
+static int use_hash = 0;
+static int sort_by_bucket = 0;  /* use_hash, while sorting the top directory */
+static uint32_t flags = FS_FLAG_SORTED;
+
+static uint8_t* image;
+static uint32_t num_inodes;
+static uint32_t num_blocks;
+static uint32_t next_block;
+static int verbose = 0;
+static int use_lz4 = 0;
+static uint64_t raw_bytes, packed_bytes;
+
+/*
+ * add_entry
+ *   DESCRIPTION: appends a directory entry, truncating the name to
+ *                MAX_FILE_NAME bytes as createfs does
+ *   INPUTS: dir - the directory to add to
+ *           name - the file name
+ *           type - FILE_TYPE_*
+ *           path - host path of the contents, or NULL
+ *           size - size of the contents
+ *   RETURN VALUE: the entry, or NULL if out of memory
+ */
+static entry_t* add_entry(dir_t* dir, const char* name, uint32_t type, const char* path, uint32_t size) {
+    entry_t* e;
+    if (dir->num_entries == dir->max_entries) {
+        dir->max_entries = dir->max_entries ? dir->max_entries * 2 : MAX_DIR_ENTRIES + 1;
+        if (!(dir->entries = realloc(dir->entries, dir->max_entries * sizeof(entry_t)))) {
+            perror("realloc");
+            return NULL;
+        }
+    }
+    e = &dir->entries[dir->num_entries++];
+    memset(e, 0, sizeof(*e));
+    memcpy(e->dentry.file_name, name, strnlen(name, MAX_FILE_NAME));
+    e->dentry.file_type = type;
+    if (path)
+        snprintf(e->path, sizeof(e->path), "%s", path);
+    e->size = size;
+    e->bucket = fs_name_hash(e->dentry.file_name) % FS_HASH_BUCKETS;
+    return e;
+}
+
+/*
+ * compare_entries
+ *   DESCRIPTION: qsort comparator; orders by bucket first when hashing
+ *                is enabled, then by the zero-padded name, which gives
+ *                the same order as the kernel's strncmp()
+ */
+static int compare_entries(const void* a, const void* b) {
+    const entry_t* x = a;
+    const entry_t* y = b;
+    if (sort_by_bucket && x->bucket != y->bucket)
+        return x->bucket < y->bucket ? -1 : 1;
+    return memcmp(x->dentry.file_name, y->dentry.file_name, MAX_FILE_NAME);
+}
+
+/*
+ * scan_dir
+ *   DESCRIPTION: adds every regular file in \p path as a directory
+ *                entry of \p dir, and every subdirectory recursively
+ *   INPUTS: path - host directory to read
+ *           dir - the directory to fill
+ *   RETURN VALUE: 0 on success, -1 on failure
+ */
+static int scan_dir(const char* path, dir_t* dir) {
+    DIR* d;
+    struct dirent* de;
+    struct stat st;
+    entry_t* e;
+    char sub[1024];
+
+    if (!(d = opendir(path))) {
+        perror(path);
+        return -1;
+    }
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.')
+            continue;
+        snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name);
+        if (stat(sub, &st) || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)))
+            continue;
+        if (S_ISREG(st.st_mode)
+            && ((uint64_t)st.st_size > FS_MAX_FILE_BLOCKS * BLOCK_SIZE || st.st_size > 0xFFFFFFFFLL)) {
+            fprintf(stderr, "mkfsimg: %s is too large\n", sub);
+            closedir(d);
+            return -1;
+        }
+        if (strlen(de->d_name) > MAX_FILE_NAME)
+            fprintf(stderr, "mkfsimg: warning: name of %s truncated\n", sub);
+        if (!(e = add_entry(dir, de->d_name, S_ISDIR(st.st_mode) ? FILE_TYPE_DIR : FILE_TYPE_REG,
+                            sub, S_ISREG(st.st_mode) ? (uint32_t)st.st_size : 0))) {
+            closedir(d);
+            return -1;
+        }
+        if (e->size > (uint32_t)MAX_DATA_BLOCKS * BLOCK_SIZE)
+            flags |= FS_FLAG_INDIRECT;
+        if (S_ISDIR(st.st_mode)) {
+            flags |= FS_FLAG_SUBDIRS;
+            if (!(e->sub = calloc(1, sizeof(dir_t))) || !add_entry(e->sub, ".", FILE_TYPE_DIR, NULL, 0)
+                || scan_dir(sub, e->sub)) {
+                closedir(d);
+                return -1;
+            }
+        }
+    }
+    closedir(d);
+    return 0;
+}
+
+/*
+ * load_file
+ *   DESCRIPTION: reads the contents of \p e into \p dst
+ *   RETURN VALUE: 0 on success, -1 on failure
+ */
+static int load_file(const entry_t* e, uint8_t* dst) {
+    FILE* f = fopen(e->path, "rb");
+    int ok;
+    if (!f) {
+        perror(e->path);
+        return -1;
+    }
+    ok = fread(dst, 1, e->size, f) == e->size;
+    fclose(f);
+    if (!ok)
+        fprintf(stderr, "mkfsimg: short read on %s\n", e->path);
+    return ok ? 0 : -1;
+}
+
+/*
+ * compress_file
+ *   DESCRIPTION: -z: compresses each block of \p e on its own, keeping
+ *                it raw when LZ4 does not make it smaller
+ *   RETURN VALUE: 0 on success, -1 on failure
+ */
+static int compress_file(entry_t* e) {
+    uint32_t nblk = (e->size + BLOCK_SIZE - 1) / BLOCK_SIZE, k, len;
+    uint8_t* raw;
+    int n;
+
+    if (nblk > FS_LZ4_MAX_BLOCKS) {
+        fprintf(stderr, "mkfsimg: %s is too large to compress\n", e->path);
+        return -1;
+    }
+    if (!(raw = malloc(e->size + 1)) || !(e->z = malloc(e->size + 1))
+        || !(e->zindex = calloc(nblk + 1, sizeof(uint32_t)))) {
+        perror("malloc");
+        return -1;
+    }
+    if (load_file(e, raw))
+        return -1;
+    for (k = 0; k < nblk; k++) {
+        len = e->size - k * BLOCK_SIZE < BLOCK_SIZE ? e->size - k * BLOCK_SIZE : BLOCK_SIZE;
+        e->zindex[k] = e->zsize;
+        n = lz4_compress(raw + k * BLOCK_SIZE, len, e->z + e->zsize, len - 1);
+        if (n < 0) {
+            memcpy(e->z + e->zsize, raw + k * BLOCK_SIZE, len);
+            e->zindex[k] |= FS_LZ4_RAW;
+            n = len;
+        }
+        e->zsize += n;
+    }
+    e->zindex[nblk] = e->zsize;
+    raw_bytes += e->size;
+    packed_bytes += e->zsize;
+    free(raw);
+    return 0;
+}
+
+/*
+ * map_blocks
+ *   DESCRIPTION: number of indirect blocks a file of \p nblk blocks needs
+ */
+static uint32_t map_blocks(uint32_t nblk) {
+    uint32_t rest;
+    if (!(flags & FS_FLAG_INDIRECT) || nblk <= FS_DIRECT_BLOCKS)
+        return 0;
+    rest = nblk - FS_DIRECT_BLOCKS;
+    if (rest <= FS_PTRS_PER_BLOCK)
+        return 1;
+    rest -= FS_PTRS_PER_BLOCK;
+    return 1 + 1 + (rest + FS_PTRS_PER_BLOCK - 1) / FS_PTRS_PER_BLOCK;
+}
+
+static uint32_t* block_words(uint32_t block) {
+    return (uint32_t*)(image + (size_t)(1 + num_inodes + block) * BLOCK_SIZE);
+}
+
+/*
+ * place_file
+ *   DESCRIPTION: points \p ino at \p nblk data blocks starting at
+ *                \p first, with the indirect blocks (if any) starting
+ *                at \p meta
+ */
+static void place_file(inode_t* ino, uint32_t nblk, uint32_t first, uint32_t meta) {
+    uint32_t k, *single, *dbl;
+
+    for (k = 0; k < nblk && (k < FS_DIRECT_BLOCKS || !(flags & FS_FLAG_INDIRECT)); k++)
+        ino->data_block_num[k] = first + k;
+    if (k == nblk)
+        return;
+
+    ino->data_block_num[FS_SINGLE_INDIRECT] = meta;
+    single = block_words(meta++);
+    for (; k < nblk && k < FS_DIRECT_BLOCKS + FS_PTRS_PER_BLOCK; k++)
+        single[k - FS_DIRECT_BLOCKS] = first + k;
+    if (k == nblk)
+        return;
+
+    ino->data_block_num[FS_DOUBLE_INDIRECT] = meta;
+    dbl = block_words(meta++);
+    for (; k < nblk; k++) {
+        uint32_t idx = k - FS_DIRECT_BLOCKS - FS_PTRS_PER_BLOCK;
+        if (idx % FS_PTRS_PER_BLOCK == 0)
+            dbl[idx / FS_PTRS_PER_BLOCK] = meta++;
+        block_words(dbl[idx / FS_PTRS_PER_BLOCK])[idx % FS_PTRS_PER_BLOCK] = first + k;
+    }
+}
+
+/*
+ * dir_blocks
+ *   DESCRIPTION: data blocks holding the dentries of a subdirectory
+ */
+static uint32_t dir_blocks(const dir_t* dir) {
+    return (dir->num_entries + FS_DENTRIES_PER_BLOCK - 1) / FS_DENTRIES_PER_BLOCK;
+}
+
+/*
+ * number_dir
+ *   DESCRIPTION: sorts the directory \p dir and its descendants and
+ *                numbers their inodes depth first, in dentry order;
+ *                counts the data blocks they need
+ *   INPUTS: dir - the directory, self - its inode ("." keeps it)
+ *   RETURN VALUE: 0 on success, -1 on failure
+ */
+static int number_dir(dir_t* dir, uint32_t self) {
+    entry_t* e;
+    uint32_t nblk;
+    int i;
+
+    sort_by_bucket = use_hash && dir == &root;
+    qsort(dir->entries, dir->num_entries, sizeof(entry_t), compare_entries);
+    for (i = 0; i < dir->num_entries; i++) {
+        e = &dir->entries[i];
+        if (e->dentry.file_type == FILE_TYPE_DIR && !e->sub) {
+            e->dentry.inode_num = self;             /* "." */
+            continue;
+        }
+        if (e->dentry.file_type != FILE_TYPE_REG && !e->sub)
+            continue;
+        e->dentry.inode_num = num_inodes++;
+        if (use_lz4 && !e->sub) {
+            if (compress_file(e))
+                return -1;
+            num_blocks += (e->zsize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            continue;
+        }
+        nblk = e->sub ? dir_blocks(e->sub) : (e->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        num_blocks += nblk + map_blocks(nblk);
+        if (e->sub && number_dir(e->sub, e->dentry.inode_num))
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * place_dir
+ *   DESCRIPTION: lays out the files and subdirectories of \p dir in the
+ *                order number_dir() numbered them: a subdirectory's
+ *                dentry blocks, then everything inside it
+ *   INPUTS: dir - the directory, prefix - its path inside the image
+ *   RETURN VALUE: 0 on success, -1 on failure
+ */
+static int place_dir(const dir_t* dir, const char* prefix) {
+    inode_t* inodes = (inode_t*)(image + BLOCK_SIZE);
+    const entry_t* e;
+    char path[1024];
+    inode_t* ino;
+    uint32_t nblk;
+    int i, k;
+
+    for (i = 0; i < dir->num_entries; i++) {
+        e = &dir->entries[i];
+        if (e->dentry.file_type != FILE_TYPE_REG && !e->sub)
+            continue;
+        snprintf(path, sizeof(path), "%s%.*s", prefix, MAX_FILE_NAME, e->dentry.file_name);
+
+        ino = &inodes[e->dentry.inode_num];
+        if (e->sub) {
+            dentry_t* d;
+            nblk = dir_blocks(e->sub);
+            ino->file_size = e->sub->num_entries * sizeof(dentry_t);
+            place_file(ino, nblk, next_block, next_block + nblk);
+            d = (dentry_t*)block_words(next_block);
+            for (k = 0; k < e->sub->num_entries; k++)
+                d[k] = e->sub->entries[k].dentry;
+        } else if (use_lz4) {
+            ino->file_size = e->size;
+            nblk = (e->zsize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            ino->data_block_num[0] = next_block;
+            memcpy(&ino->data_block_num[1], e->zindex, ((e->size + BLOCK_SIZE - 1) / BLOCK_SIZE + 1) * sizeof(uint32_t));
+            memcpy(block_words(next_block), e->z, e->zsize);
+        } else {
+            ino->file_size = e->size;
+            nblk = (e->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            place_file(ino, nblk, next_block, next_block + nblk);
+            if (load_file(e, (uint8_t*)block_words(next_block)))
+                return -1;
+        }
+        if (verbose && use_lz4 && !e->sub)
+            printf("%-32s  inode %3u  blocks %4u-%-4u  %u bytes, %u compressed (%.1f%%)\n", path,
+                   e->dentry.inode_num, next_block, next_block + nblk - (nblk ? 1 : 0), e->size, e->zsize,
+                   e->size ? 100.0 * e->zsize / e->size : 100.0);
+        else if (verbose)
+            printf("%-32s%s inode %3u  blocks %4u-%-4u  %u bytes\n", path, e->sub ? "/" : " ",
+                   e->dentry.inode_num, next_block, next_block + nblk - (nblk ? 1 : 0), ino->file_size);
+        next_block += nblk + (use_lz4 && !e->sub ? 0 : map_blocks(nblk));
+        if (e->sub) {
+            strncat(path, "/", sizeof(path) - strlen(path) - 1);
+            if (place_dir(e->sub, path))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: mkfsimg -i <fsdir> -o <image> [-H] [-z] [-n <inodes>] [-v]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    const char* in_dir = NULL;
+    const char* out_img = NULL;
+    uint32_t min_inodes = 0, dir_inode = 0, root_blocks = 0;
+    int opt, i, b;
+    entry_t* entries;
+    int num_entries;
+    boot_block_t* boot;
+    inode_t* inodes;
+    size_t image_size;
+    FILE* out;
+
+    while ((opt = getopt(argc, argv, "i:o:n:Hzv")) != -1) {
+        switch (opt) {
+            case 'i': in_dir = optarg; break;
+            case 'o': out_img = optarg; break;
+            case 'n': min_inodes = (uint32_t)atoi(optarg); break;
+            case 'H': use_hash = 1; break;
+            case 'z': use_lz4 = 1; flags |= FS_FLAG_LZ4; break;
+            case 'v': verbose = 1; break;
+            default: usage();
+        }
+    }
+    if (!in_dir || !out_img)
+        usage();
+
+    /* the directory itself and the rtc device always exist */
+    if (!add_entry(&root, ".", FILE_TYPE_DIR, NULL, 0) || !add_entry(&root, "rtc", FILE_TYPE_RTC, NULL, 0)
+        || scan_dir(in_dir, &root))
+        return 1;
+    entries = root.entries;
+    num_entries = root.num_entries;
+
+    if (use_hash && num_entries > FS_HASH_MAX_ENTRIES) {
+        fprintf(stderr, "mkfsimg: warning: %d entries, hash index disabled\n", num_entries);
+        use_hash = 0;
+    }
+    if (num_entries > MAX_DIR_ENTRIES)
+        flags |= FS_FLAG_DIRBLOCKS;
+
+    /* inode 0 stays empty for "." and rtc; the rest are numbered in dentry order */
+    num_inodes = 1;
+    if (number_dir(&root, 0))
+        return 1;
+    if (flags & FS_FLAG_DIRBLOCKS) {
+        dir_inode = num_inodes++;
+        root_blocks = (num_entries - MAX_DIR_ENTRIES + FS_DENTRIES_PER_BLOCK - 1) / FS_DENTRIES_PER_BLOCK;
+        num_blocks += root_blocks + map_blocks(root_blocks);
+    }
+    if (num_inodes < min_inodes)
+        num_inodes = min_inodes;
+
+    image_size = (size_t)(1 + num_inodes + num_blocks) * BLOCK_SIZE;
+    if (!(image = calloc(1, image_size))) {
+        perror("calloc");
+        return 1;
+    }
+    boot = (boot_block_t*)image;
+    inodes = (inode_t*)(image + BLOCK_SIZE);
+
+    boot->num_dir_entries = num_entries;
+    boot->num_inodes = num_inodes;
+    boot->num_data_blocks = num_blocks;
+    boot->ext.magic = FS_EXT_MAGIC;
+    boot->ext.flags = flags;
+    if (flags & FS_FLAG_LZ4)
+        boot->ext.version = FS_EXT_VERSION_LZ4;
+    else if (flags & FS_FLAG_SUBDIRS)
+        boot->ext.version = FS_EXT_VERSION_TREE;
+    else if (flags & (FS_FLAG_INDIRECT | FS_FLAG_DIRBLOCKS))
+        boot->ext.version = FS_EXT_VERSION_LARGE;
+    else
+        boot->ext.version = FS_EXT_VERSION;
+
+    if (use_hash) {
+        boot->ext.flags |= FS_FLAG_HASHED;
+        boot->ext.num_buckets = FS_HASH_BUCKETS;
+        for (b = 0, i = 0; b <= FS_HASH_BUCKETS; b++) {
+            while (i < num_entries && entries[i].bucket < (uint32_t)b)
+                i++;
+            boot->ext.bucket_start[b] = (uint8_t)i;
+        }
+    }
+
+    /* the top directory's blocks come first, then each file's blocks back to back */
+    if (flags & FS_FLAG_DIRBLOCKS) {
+        dentry_t* extra = (dentry_t*)block_words(0);
+        boot->ext.dir_inode = dir_inode;
+        inodes[dir_inode].file_size = (num_entries - MAX_DIR_ENTRIES) * sizeof(dentry_t);
+        place_file(&inodes[dir_inode], root_blocks, 0, root_blocks);
+        for (i = MAX_DIR_ENTRIES; i < num_entries; i++)
+            extra[i - MAX_DIR_ENTRIES] = entries[i].dentry;
+        next_block = root_blocks + map_blocks(root_blocks);
+    }
+    for (i = 0; i < num_entries && i < MAX_DIR_ENTRIES; i++)
+        boot->dir_entries_arr[i] = entries[i].dentry;
+    if (place_dir(&root, ""))
+        return 1;
+
+    if (!(out = fopen(out_img, "wb")) || fwrite(image, 1, image_size, out) != image_size) {
+        perror(out_img);
+        return 1;
+    }
+    fclose(out);
+
+    if (verbose)
+        printf("version %u, %d entries, %u inodes, %u data blocks, %zu bytes\n",
+               boot->ext.version, num_entries, num_inodes, num_blocks, image_size);
+    if (verbose && use_lz4)
+        printf("compressed %llu bytes of files to %llu (%.1f%%)\n", (unsigned long long)raw_bytes,
+               (unsigned long long)packed_bytes, raw_bytes ? 100.0 * packed_bytes / raw_bytes : 100.0);
+    free(image);
+    return 0;
+}
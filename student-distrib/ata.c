@@ -0,0 +1,446 @@
+#include "ata.h"
+#include "paging.h"
+
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+#define PCI_CLASS_IDE       0x0101      /* mass storage, IDE */
+#define PCI_REG_COMMAND     0x04
+#define PCI_REG_CLASS       0x08
+#define PCI_REG_BAR4        0x20
+#define PCI_CMD_IO          0x01
+#define PCI_CMD_MASTER      0x04
+
+#define PRD_LAST            0x8000      /* end of table flag */
+#define PRD_BOUNDARY        0x10000     /* a PRD may not cross 64KB */
+
+typedef struct {
+    uint32_t addr;                      /* physical address */
+    uint16_t bytes;                     /* 0 means 64KB */
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+uint32_t ata_sectors = 0;
+
+static uint16_t bm_base = 0;            /* 0 without a bus master */
+static int32_t use_dma = 0;
+static ata_prd_t prdt[ATA_PRD_ENTRIES] __attribute__((aligned(ATA_PRD_ENTRIES * sizeof(ata_prd_t))));
+
+static ata_request_t* queue = NULL;     /* pending requests sorted by lba */
+static ata_request_t* current = NULL;   /* request on the disk */
+static uint32_t head_lba = 0;           /* where the last command ended */
+static uint32_t cmd_sectors;            /* sectors in the command on the disk */
+static uint32_t cmd_done;               /* of those, moved by PIO so far */
+static int32_t cmd_dma;                 /* 1 if it is a DMA command */
+
+/*
+* ata_delay
+*   DESCRIPTION: Waits the 400ns a drive needs after a select or command
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: the alternate status
+*   SIDE EFFECTS: none
+*/
+static uint8_t ata_delay(){
+    inb(ATA_CONTROL);
+    inb(ATA_CONTROL);
+    inb(ATA_CONTROL);
+    return inb(ATA_CONTROL);
+}
+
+static void ata_insw(void* buf){
+    uint32_t n = ATA_SECTOR_SIZE / 2;
+    asm volatile ("rep insw" : "+D"(buf), "+c"(n) : "d"(ATA_DATA) : "memory");
+}
+
+static void ata_outsw(const void* buf){
+    uint32_t n = ATA_SECTOR_SIZE / 2;
+    asm volatile ("rep outsw" : "+S"(buf), "+c"(n) : "d"(ATA_DATA) : "memory");
+}
+
+static uint32_t pci_read(uint32_t dev, uint32_t reg){
+    outl(0x80000000 | dev | reg, PCI_CONFIG_ADDRESS);
+    return inl(PCI_CONFIG_DATA);
+}
+
+static void pci_write(uint32_t dev, uint32_t reg, uint32_t val){
+    outl(0x80000000 | dev | reg, PCI_CONFIG_ADDRESS);
+    outl(val, PCI_CONFIG_DATA);
+}
+
+/*
+* ata_find_bus_master
+*   DESCRIPTION: Scans PCI bus 0 for an IDE controller and enables its
+*                bus master (QEMU's PIIX3 sits at 00:01.1)
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: the bus master I/O base, 0 if none
+*   SIDE EFFECTS: sets the I/O and bus master bits of the controller
+*/
+static uint16_t ata_find_bus_master(){
+    uint32_t slot, func, dev, bar;
+    for(slot = 0; slot < 32; slot++){
+        for(func = 0; func < 8; func++){
+            dev = (slot << 11) | (func << 8);
+            if((pci_read(dev, 0) & 0xFFFF) == 0xFFFF || (pci_read(dev, PCI_REG_CLASS) >> 16) != PCI_CLASS_IDE){
+                continue;
+            }
+            bar = pci_read(dev, PCI_REG_BAR4);
+            if(!(bar & 0x01)){
+                return 0;                                   /* not an I/O BAR */
+            }
+            pci_write(dev, PCI_REG_COMMAND, pci_read(dev, PCI_REG_COMMAND) | PCI_CMD_IO | PCI_CMD_MASTER);
+            return bar & 0xFFFC;
+        }
+    }
+    return 0;
+}
+
+/*
+* ata_init
+*   DESCRIPTION: Identifies the primary master and looks for a bus master
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: sets ata_sectors, enables IRQ 14
+*/
+void ata_init(){
+    uint16_t identify[ATA_SECTOR_SIZE / 2];
+    uint8_t status;
+
+    outb(0, ATA_CONTROL);                                   /* nIEN = 0: interrupts on */
+    outb(0xA0, ATA_DRIVE);                                  /* master */
+    ata_delay();
+    outb(0, ATA_COUNT);
+    outb(0, ATA_LBA_LO);
+    outb(0, ATA_LBA_MID);
+    outb(0, ATA_LBA_HI);
+    outb(ATA_CMD_IDENTIFY, ATA_COMMAND);
+    if((status = ata_delay()) == 0 || status == 0xFF){
+        return;                                             /* no drive */
+    }
+    while((status = inb(ATA_COMMAND)) & ATA_SR_BSY);
+    if(inb(ATA_LBA_MID) || inb(ATA_LBA_HI)){
+        return;                                             /* ATAPI or SATA, not ours */
+    }
+    while(!((status = inb(ATA_COMMAND)) & (ATA_SR_DRQ | ATA_SR_ERR)));
+    if(status & ATA_SR_ERR){
+        return;
+    }
+    ata_insw(identify);                                     /* also clears the pending irq */
+
+    ata_sectors = identify[60] | ((uint32_t)identify[61] << 16);   /* LBA28 capacity */
+    if(identify[49] & (1 << 8)){                            /* DMA supported */
+        bm_base = ata_find_bus_master();
+    }
+    use_dma = bm_base != 0;
+
+    enable_irq(ATA_IRQ);
+}
+
+/*
+* ata_set_dma
+*   DESCRIPTION: Chooses the transfer mode of the following commands
+*   INPUTS: enable - 1 for bus-master DMA, 0 for PIO
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if success, -1 if DMA is unavailable
+*   SIDE EFFECTS: none
+*/
+int32_t ata_set_dma(int32_t enable){
+    if(enable && !bm_base){
+        return -1;
+    }
+    use_dma = enable;
+    return 0;
+}
+
+/*
+* ata_build_prdt
+*   DESCRIPTION: Describes a buffer to the bus master, one entry per
+*                physically contiguous run inside a 64KB window
+*   INPUTS: buf - the buffer, bytes - its length
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if success, -1 if the table is too small
+*   SIDE EFFECTS: fills prdt
+*/
+static int32_t ata_build_prdt(uint8_t* buf, uint32_t bytes){
+    int32_t n = -1;
+    uint32_t phys, len;
+
+    while(bytes){
+        phys = virt_to_phys(buf);
+        len = PAGING_ALIGNMENT - (phys & (PAGING_ALIGNMENT - 1));  /* stay inside the page */
+        if(len > bytes){
+            len = bytes;
+        }
+        if(n >= 0 && prdt[n].addr + (prdt[n].bytes ? prdt[n].bytes : PRD_BOUNDARY) == phys
+           && (prdt[n].addr & ~(PRD_BOUNDARY - 1)) == ((phys + len - 1) & ~(PRD_BOUNDARY - 1))){
+            prdt[n].bytes += len;                           /* wraps to 0 at exactly 64KB */
+        } else {
+            if(++n == ATA_PRD_ENTRIES){
+                return -1;
+            }
+            prdt[n].addr = phys;
+            prdt[n].bytes = len;
+            prdt[n].flags = 0;
+        }
+        buf += len;
+        bytes -= len;
+    }
+    prdt[n].flags = PRD_LAST;
+    return 0;
+}
+
+/*
+* ata_issue
+*   DESCRIPTION: Sends the next chunk of the current request to the disk
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if issued, -1 if the drive refused it
+*   SIDE EFFECTS: called with interrupts off
+*/
+static int32_t ata_issue(){
+    ata_request_t* req = current;
+    uint32_t lba = req->lba + req->done;
+    uint8_t* buf = req->buf + req->done * ATA_SECTOR_SIZE;
+
+    cmd_sectors = req->count - req->done;
+    if(cmd_sectors > ATA_MAX_SECTORS){
+        cmd_sectors = ATA_MAX_SECTORS;
+    }
+    cmd_done = 0;
+    cmd_dma = use_dma && !((uint32_t)buf & 1) && ata_build_prdt(buf, cmd_sectors * ATA_SECTOR_SIZE) == 0;
+
+    while(inb(ATA_COMMAND) & ATA_SR_BSY);
+    if(cmd_dma){
+        outb(0, bm_base + BM_COMMAND);
+        outl(virt_to_phys(prdt), bm_base + BM_PRDT);
+        outb(BM_ST_ERR | BM_ST_IRQ, bm_base + BM_STATUS);  /* write 1 to clear */
+        outb(req->write ? 0 : BM_CMD_READ, bm_base + BM_COMMAND);
+    }
+
+    outb(0xE0 | ((lba >> 24) & 0x0F), ATA_DRIVE);           /* master, LBA mode */
+    outb((uint8_t)cmd_sectors, ATA_COUNT);                  /* 256 wraps to 0 */
+    outb((uint8_t)lba, ATA_LBA_LO);
+    outb((uint8_t)(lba >> 8), ATA_LBA_MID);
+    outb((uint8_t)(lba >> 16), ATA_LBA_HI);
+    if(cmd_dma){
+        outb(req->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA, ATA_COMMAND);
+        outb((req->write ? 0 : BM_CMD_READ) | BM_CMD_START, bm_base + BM_COMMAND);
+        return 0;
+    }
+
+    outb(req->write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO, ATA_COMMAND);
+    if(req->write){                                         /* the first sector goes without an irq */
+        uint8_t status;
+        ata_delay();
+        while((status = inb(ATA_COMMAND)) & ATA_SR_BSY);
+        if(!(status & ATA_SR_DRQ) || (status & (ATA_SR_ERR | ATA_SR_DF))){
+            return -1;
+        }
+        ata_outsw(buf);
+    }
+    return 0;
+}
+
+/*
+* ata_start
+*   DESCRIPTION: Takes the next request off the elevator queue (C-LOOK:
+*                the lowest lba at or past the head, else the lowest
+*                overall) and issues it
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: called with interrupts off while the disk is idle
+*/
+static void ata_start(){
+    ata_request_t **pick, **link;
+
+    while(!current && queue){
+        pick = &queue;
+        for(link = &queue; *link; link = &(*link)->next){
+            if((*link)->lba >= head_lba){
+                pick = link;
+                break;
+            }
+        }
+        current = *pick;
+        *pick = current->next;
+        current->next = NULL;
+        if(ata_issue() != 0){
+            ata_request_t* req = current;
+            current = NULL;
+            req->status = ATA_FAILED;
+            if(req->complete){
+                req->complete(req);
+            }
+        }
+    }
+}
+
+/*
+* ata_finish
+*   DESCRIPTION: Accounts for a finished command, issuing the rest of a
+*                large request or completing it and starting the next
+*   INPUTS: ok - 0 if the command failed
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+static void ata_finish(int32_t ok){
+    ata_request_t* req = current;
+
+    if(ok){
+        req->done += cmd_sectors;
+        head_lba = req->lba + req->done;
+        if(req->done < req->count && ata_issue() == 0){
+            return;
+        }
+    }
+    current = NULL;
+    req->status = (req->done == req->count) ? ATA_DONE : ATA_FAILED;
+    if(req->complete){
+        req->complete(req);
+    }
+    ata_start();
+}
+
+/*
+* ata_handler
+*   DESCRIPTION: IRQ 14 handler. Moves one sector for PIO commands, or
+*                stops the bus master once a DMA command completes
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: wakes the waiter of a finished request
+*/
+void ata_handler(){
+    uint8_t status, bm_status = 0;
+    uint8_t* buf;
+
+    if(bm_base){
+        bm_status = inb(bm_base + BM_STATUS);
+    }
+    status = inb(ATA_COMMAND);                              /* acknowledges the drive */
+    send_eoi(ATA_IRQ);
+
+    if(!current){
+        return;                                             /* spurious */
+    }
+    if(cmd_dma){
+        if(!(bm_status & BM_ST_IRQ)){
+            return;
+        }
+        outb(0, bm_base + BM_COMMAND);
+        outb(BM_ST_ERR | BM_ST_IRQ, bm_base + BM_STATUS);
+        ata_finish(!(bm_status & BM_ST_ERR) && !(status & (ATA_SR_ERR | ATA_SR_DF)));
+        return;
+    }
+
+    if(status & (ATA_SR_ERR | ATA_SR_DF)){
+        ata_finish(0);
+        return;
+    }
+    buf = current->buf + (current->done + cmd_done) * ATA_SECTOR_SIZE;
+    if(!current->write){
+        ata_insw(buf);
+    }
+    if(++cmd_done == cmd_sectors){
+        ata_finish(1);
+    } else if(current->write){
+        ata_outsw(buf + ATA_SECTOR_SIZE);
+    }
+}
+
+/*
+* ata_submit
+*   DESCRIPTION: Queues a request in lba order and starts the disk if it
+*                is idle; the caller owns req until it completes
+*   INPUTS: req - lba, count, buf, write and complete filled in
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if queued, -1 for an invalid request
+*   SIDE EFFECTS: none
+*/
+int32_t ata_submit(ata_request_t* req){
+    ata_request_t** link;
+    uint32_t flags;
+
+    if(req == NULL || req->buf == NULL || req->count == 0
+       || req->lba >= ata_sectors || req->count > ata_sectors - req->lba){
+        return -1;
+    }
+    req->status = ATA_PENDING;
+    req->done = 0;
+
+    cli_and_save(flags);
+    for(link = &queue; *link && (*link)->lba <= req->lba; link = &(*link)->next);
+    req->next = *link;
+    *link = req;
+    if(!current){
+        ata_start();
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* ata_wait
+*   DESCRIPTION: Halts until the interrupt handler finishes the request,
+*                instead of spinning on the status port
+*   INPUTS: req - a submitted request
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if it succeeded, -1 if it failed
+*   SIDE EFFECTS: enables interrupts while waiting
+*/
+int32_t ata_wait(ata_request_t* req){
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while(req->status == ATA_PENDING){
+        asm volatile ("sti; hlt; cli" ::: "memory");       /* sti's shadow keeps the irq after hlt */
+    }
+    restore_flags(flags);
+    return req->status == ATA_DONE ? 0 : -1;
+}
+
+/*
+* ata_read
+*   DESCRIPTION: Reads sectors, blocking until they arrive
+*   INPUTS: lba - first sector, count - number of sectors
+*   OUTPUTS: buf - count * ATA_SECTOR_SIZE bytes
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+int32_t ata_read(uint32_t lba, uint32_t count, void* buf){
+    ata_request_t req;
+    req.lba = lba;
+    req.count = count;
+    req.buf = buf;
+    req.write = 0;
+    req.complete = NULL;
+    if(ata_submit(&req) != 0){
+        return -1;
+    }
+    return ata_wait(&req);
+}
+
+/*
+* ata_write
+*   DESCRIPTION: Writes sectors, blocking until the disk has them
+*   INPUTS: lba - first sector, count - number of sectors,
+*           buf - count * ATA_SECTOR_SIZE bytes
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+int32_t ata_write(uint32_t lba, uint32_t count, const void* buf){
+    ata_request_t req;
+    req.lba = lba;
+    req.count = count;
+    req.buf = (uint8_t*)buf;
+    req.write = 1;
+    req.complete = NULL;
+    if(ata_submit(&req) != 0){
+        return -1;
+    }
+    return ata_wait(&req);
+}
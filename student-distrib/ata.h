@@ -0,0 +1,83 @@
+#ifndef _ATA_H
+#define _ATA_H
+
+#include "types.h"
+#include "lib.h"
+#include "i8259.h"
+
+// Primary channel ports from https://wiki.osdev.org/ATA_PIO_Mode
+#define ATA_DATA        0x1F0
+#define ATA_ERROR       0x1F1
+#define ATA_COUNT       0x1F2
+#define ATA_LBA_LO      0x1F3
+#define ATA_LBA_MID     0x1F4
+#define ATA_LBA_HI      0x1F5
+#define ATA_DRIVE       0x1F6
+#define ATA_COMMAND     0x1F7       /* reads back as the status register */
+#define ATA_CONTROL     0x3F6       /* reads back as the alternate status */
+
+#define ATA_SR_ERR      0x01
+#define ATA_SR_DRQ      0x08
+#define ATA_SR_DF       0x20
+#define ATA_SR_BSY      0x80
+
+#define ATA_CMD_READ_PIO    0x20
+#define ATA_CMD_WRITE_PIO   0x30
+#define ATA_CMD_READ_DMA    0xC8
+#define ATA_CMD_WRITE_DMA   0xCA
+#define ATA_CMD_IDENTIFY    0xEC
+
+// Bus master IDE registers, offsets from BAR4 of the PCI IDE controller
+#define BM_COMMAND      0x00        /* bit 0: start, bit 3: device -> memory */
+#define BM_STATUS       0x02        /* bit 0: active, bit 1: error, bit 2: irq */
+#define BM_PRDT         0x04
+
+#define BM_CMD_START    0x01
+#define BM_CMD_READ     0x08
+#define BM_ST_ERR       0x02
+#define BM_ST_IRQ       0x04
+
+#define ATA_IRQ         14
+#define ATA_SECTOR_SIZE 512
+#define ATA_MAX_SECTORS 256         /* one LBA28 command, a count of 0 means 256 */
+#define ATA_PRD_ENTRIES 64          /* enough for 128KB split at every page */
+
+#define ATA_PENDING     1
+#define ATA_DONE        0
+#define ATA_FAILED      -1
+
+typedef struct ata_request {
+    uint32_t lba;                   /* first sector */
+    uint32_t count;                 /* sectors, may exceed ATA_MAX_SECTORS */
+    uint8_t* buf;                   /* count * ATA_SECTOR_SIZE bytes */
+    uint8_t write;                  /* 1 to write buf to the disk */
+    volatile int32_t status;        /* ATA_PENDING until the interrupt handler finishes it */
+    uint32_t done;                  /* sectors transferred so far */
+    void (*complete)(struct ata_request* req);  /* called from the interrupt handler, may be NULL */
+    void* owner;                    /* owner data for complete() */
+    struct ata_request* next;       /* elevator queue link */
+} ata_request_t;
+
+/* total sectors on the primary master, 0 if there is no disk */
+extern uint32_t ata_sectors;
+
+/* identifies the disk and finds the bus master */
+void ata_init();
+
+/* IRQ 14 handler */
+void ata_handler();
+
+/* selects bus-master DMA (1) or PIO (0) for commands issued from now on */
+int32_t ata_set_dma(int32_t enable);
+
+/* queues a request, returns immediately */
+int32_t ata_submit(ata_request_t* req);
+
+/* sleeps until a submitted request finishes */
+int32_t ata_wait(ata_request_t* req);
+
+/* synchronous wrappers around submit + wait */
+int32_t ata_read(uint32_t lba, uint32_t count, void* buf);
+int32_t ata_write(uint32_t lba, uint32_t count, const void* buf);
+
+#endif
@@ -0,0 +1,512 @@
+#include "bcache.h"
+#include "malloc.h"
+#include "system_call.h"
+
+#define BCACHE_HASH(dev, block) (((dev) * 31 + (block)) % BCACHE_HASH_SIZE)
+
+bcache_stats_t bcache_stats;
+
+static buffer_t buffers[BCACHE_NUM_BUFFERS];
+static buffer_t* hash_table[BCACHE_HASH_SIZE];
+static buffer_t* lru_head = NULL;       /* most recently used */
+static buffer_t* lru_tail = NULL;       /* eviction candidate */
+static uint32_t ticks = 0;
+
+/*
+* bcache_init
+*   DESCRIPTION: Carves the buffers out of one heap allocation, which
+*                is physically contiguous and so usable for DMA
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: every buffer starts unused on the LRU list
+*/
+void bcache_init(){
+    uint8_t* data = malloc(BCACHE_NUM_BUFFERS * BLOCK_SIZE);
+    int i;
+
+    if(!data){
+        return;
+    }
+    for(i = 0; i < BCACHE_NUM_BUFFERS; i++){
+        buffers[i].dev = -1;
+        buffers[i].data = data + i * BLOCK_SIZE;
+        buffers[i].lru_prev = i ? &buffers[i - 1] : NULL;
+        buffers[i].lru_next = (i + 1 < BCACHE_NUM_BUFFERS) ? &buffers[i + 1] : NULL;
+    }
+    lru_head = &buffers[0];
+    lru_tail = &buffers[BCACHE_NUM_BUFFERS - 1];
+}
+
+/*
+* bcache_lookup
+*   DESCRIPTION: Finds a cached block
+*   INPUTS: dev, block - the block
+*   OUTPUTS: none
+*   RETURN VALUE: its buffer, or NULL
+*   SIDE EFFECTS: none
+*/
+static buffer_t* bcache_lookup(uint32_t dev, uint32_t block){
+    buffer_t* b;
+    for(b = hash_table[BCACHE_HASH(dev, block)]; b; b = b->hash_next){
+        if(b->dev == dev && b->block == block){
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/*
+* bcache_touch
+*   DESCRIPTION: Moves a buffer to the most recently used end
+*   INPUTS: b - the buffer
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+static void bcache_touch(buffer_t* b){
+    if(b == lru_head){
+        return;
+    }
+    b->lru_prev->lru_next = b->lru_next;
+    if(b->lru_next){
+        b->lru_next->lru_prev = b->lru_prev;
+    } else {
+        lru_tail = b->lru_prev;
+    }
+    b->lru_prev = NULL;
+    b->lru_next = lru_head;
+    lru_head->lru_prev = b;
+    lru_head = b;
+}
+
+/*
+* bcache_io_done
+*   DESCRIPTION: Completion callback of every cache request, runs in
+*                the ATA interrupt handler
+*   INPUTS: req - the finished request
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: releases the buffer from B_BUSY
+*/
+static void bcache_io_done(ata_request_t* req){
+    buffer_t* b = req->owner;
+    if(req->write){
+        if(req->status != ATA_DONE){
+            b->flags |= B_DIRTY;                    /* retry on the next flush */
+        }
+    } else if(req->status == ATA_DONE){
+        b->flags |= B_VALID;
+    }
+    b->flags &= ~B_BUSY;
+}
+
+/*
+* bcache_submit
+*   DESCRIPTION: Starts the disk request of a buffer
+*   INPUTS: b - a B_BUSY buffer, write - 1 to write it back
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if queued, -1 if fail
+*   SIDE EFFECTS: clears B_BUSY on failure
+*/
+static int32_t bcache_submit(buffer_t* b, uint8_t write){
+    b->req.lba = b->block * BCACHE_SECTORS;
+    b->req.count = BCACHE_SECTORS;
+    b->req.buf = b->data;
+    b->req.write = write;
+    b->req.complete = bcache_io_done;
+    b->req.owner = b;
+    if(ata_submit(&b->req) != 0){
+        b->req.status = ATA_FAILED;
+        b->flags &= ~B_BUSY;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+* bcache_get
+*   DESCRIPTION: Recycles the least recently used idle buffer for a
+*                block. Clean buffers go first; a dirty one is written
+*                back synchronously only when \p may_block allows it
+*   INPUTS: dev, block - the block, may_block - 0 from read-ahead
+*   OUTPUTS: none
+*   RETURN VALUE: the buffer hashed under the block, or NULL
+*   SIDE EFFECTS: called with interrupts off
+*/
+static buffer_t* bcache_get(uint32_t dev, uint32_t block, int32_t may_block){
+    buffer_t *b, *prev;
+
+    for(;;){
+        for(b = lru_tail; b; b = b->lru_prev){
+            if(!b->refs && !(b->flags & (B_BUSY | B_DIRTY))){
+                break;
+            }
+        }
+        if(b){
+            break;
+        }
+        if(!may_block){
+            return NULL;
+        }
+        for(b = lru_tail; b && (b->refs || (b->flags & B_BUSY)); b = b->lru_prev);
+        if(!b){
+            return NULL;                            /* everything is in use */
+        }
+        b->flags = (b->flags & ~B_DIRTY) | B_BUSY;
+        bcache_stats.writebacks++;
+        if(bcache_submit(b, 1) == 0){
+            ata_wait(&b->req);
+        }
+    }
+
+    if(b->flags & B_READAHEAD){
+        bcache_stats.ra_wasted++;
+    }
+    if(b->dev != -1){                               /* unhash from the old block */
+        buffer_t** link = &hash_table[BCACHE_HASH(b->dev, b->block)];
+        for(prev = *link; prev != b; link = &prev->hash_next, prev = *link);
+        *link = b->hash_next;
+    }
+    b->dev = dev;
+    b->block = block;
+    b->flags = 0;
+    b->hash_next = hash_table[BCACHE_HASH(dev, block)];
+    hash_table[BCACHE_HASH(dev, block)] = b;
+    bcache_touch(b);
+    return b;
+}
+
+/*
+* bread
+*   DESCRIPTION: Gets a block through the cache, waiting for the disk on
+*                a miss or for an in-flight read-ahead
+*   INPUTS: dev, block - the block
+*   OUTPUTS: none
+*   RETURN VALUE: the buffer with valid data, or NULL
+*   SIDE EFFECTS: takes a reference, release it with brelse
+*/
+buffer_t* bread(uint32_t dev, uint32_t block){
+    buffer_t* b;
+    uint32_t flags;
+
+    if(block >= bcache_dev_blocks(dev) || !lru_head){
+        return NULL;
+    }
+
+    cli_and_save(flags);
+    if((b = bcache_lookup(dev, block)) && (b->flags & (B_VALID | B_BUSY))){
+        bcache_stats.hits++;
+        if(b->flags & B_READAHEAD){
+            bcache_stats.ra_useful++;
+            b->flags &= ~B_READAHEAD;
+        }
+    } else {
+        bcache_stats.misses++;
+        if(!b && !(b = bcache_get(dev, block, 1))){
+            restore_flags(flags);
+            return NULL;
+        }
+        b->flags |= B_BUSY;
+        bcache_submit(b, 0);
+    }
+    b->refs++;
+    bcache_touch(b);
+    if(b->flags & B_BUSY){
+        ata_wait(&b->req);
+    }
+    restore_flags(flags);
+
+    if(!(b->flags & B_VALID)){
+        brelse(b);
+        return NULL;
+    }
+    return b;
+}
+
+/*
+* brelse
+*   DESCRIPTION: Drops a reference taken by bread
+*   INPUTS: buf - the buffer
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: the buffer may be evicted once unreferenced
+*/
+void brelse(buffer_t* buf){
+    uint32_t flags;
+    cli_and_save(flags);
+    if(buf && buf->refs){
+        buf->refs--;
+    }
+    restore_flags(flags);
+}
+
+/*
+* bdirty
+*   DESCRIPTION: Marks a referenced block modified
+*   INPUTS: buf - the buffer
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: the next flush writes it back
+*/
+void bdirty(buffer_t* buf){
+    uint32_t flags;
+    cli_and_save(flags);
+    buf->flags |= B_DIRTY | B_VALID;
+    restore_flags(flags);
+}
+
+/*
+* bcache_readahead
+*   DESCRIPTION: Starts reading a block that is not cached yet, without
+*                waiting and without evicting dirty data
+*   INPUTS: dev, block - the block
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+void bcache_readahead(uint32_t dev, uint32_t block){
+    buffer_t* b;
+    uint32_t flags;
+
+    if(block >= bcache_dev_blocks(dev) || !lru_head){
+        return;
+    }
+    cli_and_save(flags);
+    if(!bcache_lookup(dev, block) && (b = bcache_get(dev, block, 0))){
+        b->flags = B_BUSY | B_READAHEAD;
+        if(bcache_submit(b, 0) == 0){
+            bcache_stats.ra_issued++;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+* bcache_flush
+*   DESCRIPTION: Queues a write for every dirty idle buffer; the ATA
+*                elevator orders them, nothing waits
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: safe to call from an interrupt handler
+*/
+void bcache_flush(){
+    uint32_t flags;
+    int i;
+
+    cli_and_save(flags);
+    for(i = 0; i < BCACHE_NUM_BUFFERS; i++){
+        if((buffers[i].flags & (B_DIRTY | B_BUSY)) == B_DIRTY){
+            buffers[i].flags = (buffers[i].flags & ~B_DIRTY) | B_BUSY;
+            if(bcache_submit(&buffers[i], 1) == 0){
+                bcache_stats.writebacks++;
+            } else {
+                buffers[i].flags |= B_DIRTY;
+            }
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+* bcache_tick
+*   DESCRIPTION: Counts PIT ticks and flushes every BCACHE_FLUSH_TICKS
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+void bcache_tick(){
+    if(++ticks >= BCACHE_FLUSH_TICKS){
+        ticks = 0;
+        bcache_flush();
+    }
+}
+
+/*
+* bcache_dev_blocks
+*   DESCRIPTION: Gets the size of a device
+*   INPUTS: dev - the device
+*   OUTPUTS: none
+*   RETURN VALUE: its number of 4KB blocks
+*   SIDE EFFECTS: none
+*/
+uint32_t bcache_dev_blocks(uint32_t dev){
+    return dev == BCACHE_DEV_HDA ? ata_sectors / BCACHE_SECTORS : 0;
+}
+
+/*
+* bdev_open
+*   DESCRIPTION: Opens the raw disk, "/dev/hda"
+*   INPUTS: filename - ignored
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+int32_t bdev_open(const uint8_t* filename){
+    return ata_sectors ? 0 : -1;
+}
+
+/*
+* bdev_read
+*   DESCRIPTION: Reads the disk through the cache. A read that starts in
+*                the block the previous one ended in, or the next one,
+*                is sequential and doubles the read-ahead window, which
+*                is kept per fd; anything else closes it
+*   INPUTS: fd - the file descriptor
+*           nbytes - the number of bytes to read
+*   OUTPUTS: buf - the data
+*   RETURN VALUE: the number of bytes read, 0 at the end of the disk
+*   SIDE EFFECTS: read() advances the position
+*/
+int32_t bdev_read(int32_t fd, void* buf, int32_t nbytes){
+    file_descriptor_t* desc = &current_process()->fd[fd];
+    uint32_t pos = desc->file_position, size, done = 0, n, block, last;
+    buffer_t* b;
+
+    size = bcache_dev_blocks(desc->inode) * BLOCK_SIZE;
+    if(buf == NULL || nbytes < 0){
+        return -1;
+    }
+    if(pos >= size || nbytes == 0){
+        return 0;
+    }
+    if((uint32_t)nbytes > size - pos){
+        nbytes = size - pos;
+    }
+
+    block = pos / BLOCK_SIZE;
+    last = (pos + nbytes - 1) / BLOCK_SIZE;
+    if(desc->ra_window && (block == desc->ra_next || block + 1 == desc->ra_next)){
+        desc->ra_window *= 2;
+        if(desc->ra_window > BCACHE_MAX_READAHEAD){
+            desc->ra_window = BCACHE_MAX_READAHEAD;
+        }
+    } else {
+        desc->ra_window = (pos == 0 || block == desc->ra_next) ? 1 : 0;
+        desc->ra_end = last + 1;
+    }
+    desc->ra_next = last + 1;
+    if(desc->ra_end < last + 1){
+        desc->ra_end = last + 1;
+    }
+    for(; desc->ra_window && desc->ra_end <= last + desc->ra_window; desc->ra_end++){
+        bcache_readahead(desc->inode, desc->ra_end);
+    }
+
+    while(done < (uint32_t)nbytes){
+        if(!(b = bread(desc->inode, (pos + done) / BLOCK_SIZE))){
+            return done ? (int32_t)done : -1;
+        }
+        n = BLOCK_SIZE - (pos + done) % BLOCK_SIZE;
+        if(n > nbytes - done){
+            n = nbytes - done;
+        }
+        memcpy((uint8_t*)buf + done, b->data + (pos + done) % BLOCK_SIZE, n);
+        brelse(b);
+        done += n;
+    }
+    return done;
+}
+
+/*
+* bdev_write
+*   DESCRIPTION: Writes the disk through the cache; blocks are written
+*                back by the periodic flush
+*   INPUTS: fd - the file descriptor
+*           buf - the data
+*           nbytes - the number of bytes to write
+*   OUTPUTS: none
+*   RETURN VALUE: the number of bytes written, -1 if none
+*   SIDE EFFECTS: advances the position, which write() does not do
+*/
+int32_t bdev_write(int32_t fd, const void* buf, int32_t nbytes){
+    file_descriptor_t* desc = &current_process()->fd[fd];
+    uint32_t pos = desc->file_position, size, done = 0, n;
+    buffer_t* b;
+
+    size = bcache_dev_blocks(desc->inode) * BLOCK_SIZE;
+    if(buf == NULL || nbytes < 0 || pos >= size){
+        return -1;
+    }
+    if((uint32_t)nbytes > size - pos){
+        nbytes = size - pos;
+    }
+    while(done < (uint32_t)nbytes){
+        if(!(b = bread(desc->inode, (pos + done) / BLOCK_SIZE))){
+            break;
+        }
+        n = BLOCK_SIZE - (pos + done) % BLOCK_SIZE;
+        if(n > nbytes - done){
+            n = nbytes - done;
+        }
+        memcpy(b->data + (pos + done) % BLOCK_SIZE, (const uint8_t*)buf + done, n);
+        bdirty(b);
+        brelse(b);
+        done += n;
+    }
+    desc->file_position += done;
+    return done ? (int32_t)done : -1;
+}
+
+/*
+* bdev_close
+*   DESCRIPTION: Closes the raw disk
+*   INPUTS: fd - the file descriptor
+*   OUTPUTS: none
+*   RETURN VALUE: 0
+*   SIDE EFFECTS: none
+*/
+int32_t bdev_close(int32_t fd){
+    return 0;
+}
+
+/*
+* bcstat_open
+*   DESCRIPTION: Opens the statistics pseudo-file
+*   INPUTS: filename - ignored, "/dev/bcstat"
+*   OUTPUTS: none
+*   RETURN VALUE: 0
+*   SIDE EFFECTS: none
+*/
+int32_t bcstat_open(const uint8_t* filename){
+    return 0;
+}
+
+/*
+* bcstat_read
+*   DESCRIPTION: Formats the cache statistics as text and reads it from
+*                the fd's position
+*   INPUTS: fd - the file descriptor
+*           nbytes - the number of bytes to read
+*   OUTPUTS: buf - the text
+*   RETURN VALUE: the number of bytes read, 0 at the end
+*   SIDE EFFECTS: none
+*/
+int32_t bcstat_read(int32_t fd, void* buf, int32_t nbytes){
+    int8_t text[512] = {0};
+    uint32_t pos = current_process()->fd[fd].file_position, i, dirty = 0, used = 0;
+    uint32_t total = bcache_stats.hits + bcache_stats.misses;
+
+    if(buf == NULL || nbytes < 0){
+        return -1;
+    }
+    for(i = 0; i < BCACHE_NUM_BUFFERS; i++){
+        dirty += (buffers[i].flags & B_DIRTY) != 0;
+        used += buffers[i].dev != -1;
+    }
+    stat_line(text, "buffers: ", used, "");
+    stat_line(text, "/", BCACHE_NUM_BUFFERS, " used\n");
+    stat_line(text, "dirty: ", dirty, "\n");
+    stat_line(text, "hits: ", bcache_stats.hits, "\n");
+    stat_line(text, "misses: ", bcache_stats.misses, "\n");
+    stat_line(text, "hit ratio: ", total ? (total < 0x1000000 ? bcache_stats.hits * 100 / total
+                                                                : bcache_stats.hits / (total / 100)) : 0, "%\n");
+    stat_line(text, "readahead issued: ", bcache_stats.ra_issued, "\n");
+    stat_line(text, "readahead useful: ", bcache_stats.ra_useful, "\n");
+    stat_line(text, "readahead wasted: ", bcache_stats.ra_wasted, "\n");
+    stat_line(text, "writebacks: ", bcache_stats.writebacks, "\n");
+
+    return stat_read(text, pos, buf, nbytes);
+}
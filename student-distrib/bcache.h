@@ -0,0 +1,79 @@
+#ifndef _BCACHE_H
+#define _BCACHE_H
+
+#include "types.h"
+#include "lib.h"
+#include "filesys.h"
+#include "ata.h"
+
+#define BCACHE_DEV_HDA 0                    /* the primary ATA disk */
+#define BCACHE_NUM_BUFFERS 256              /* 1MB of 4KB blocks */
+#define BCACHE_HASH_SIZE 64
+#define BCACHE_SECTORS (BLOCK_SIZE / ATA_SECTOR_SIZE)
+#define BCACHE_FLUSH_TICKS (391 * 5)        /* PIT ticks between write-backs, 5s at pit_init(391) */
+#define BCACHE_MAX_READAHEAD 32             /* blocks, the window doubles up to this */
+
+#define BDEV_FILE_TYPE 4                    /* dentry file_type of "/dev/hda" */
+#define BCSTAT_FILE_TYPE 5                  /* dentry file_type of "/dev/bcstat" */
+
+#define B_VALID 0x01                        /* data matches the disk, or is newer */
+#define B_DIRTY 0x02                        /* must be written back */
+#define B_BUSY 0x04                         /* a disk request owns the data */
+#define B_READAHEAD 0x08                    /* read ahead and not used yet */
+
+typedef struct buffer {
+    uint32_t dev;
+    uint32_t block;                         /* 4KB block number on dev */
+    uint32_t flags;                         /* B_* */
+    uint32_t refs;                          /* bread without brelse */
+    uint8_t* data;
+    ata_request_t req;                      /* the request while B_BUSY */
+    struct buffer* hash_next;
+    struct buffer* lru_prev;                /* lru_prev is towards the most recent */
+    struct buffer* lru_next;
+} buffer_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t ra_issued;                     /* blocks read ahead */
+    uint32_t ra_useful;                     /* of those, later read */
+    uint32_t ra_wasted;                     /* of those, evicted unread */
+    uint32_t writebacks;                    /* blocks written to disk */
+} bcache_stats_t;
+
+extern bcache_stats_t bcache_stats;
+
+/* allocates the buffers, needs the kernel heap */
+void bcache_init();
+
+/* returns the block with its data read, or NULL; pair with brelse */
+buffer_t* bread(uint32_t dev, uint32_t block);
+
+/* drops a reference taken by bread */
+void brelse(buffer_t* buf);
+
+/* marks a block modified, the periodic flush writes it back */
+void bdirty(buffer_t* buf);
+
+/* starts an asynchronous read of a block that is not cached */
+void bcache_readahead(uint32_t dev, uint32_t block);
+
+/* starts writing every dirty block back, does not wait */
+void bcache_flush();
+
+/* called on every PIT tick, flushes every BCACHE_FLUSH_TICKS */
+void bcache_tick();
+
+/* number of blocks a device holds */
+uint32_t bcache_dev_blocks(uint32_t dev);
+
+int32_t bdev_open(const uint8_t* filename);
+int32_t bdev_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t bdev_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t bdev_close(int32_t fd);
+
+int32_t bcstat_open(const uint8_t* filename);
+int32_t bcstat_read(int32_t fd, void* buf, int32_t nbytes);
+
+#endif
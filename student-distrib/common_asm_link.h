@@ -43,5 +43,53 @@ extern void system_call();
 
 extern void pit_intr();
 
+/* 
+ * ata_intr
+ *   DESCRIPTION: Masks interrupt flags, saves all, call the ATA handler, restores all, return from the interrupt
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none 
+ *   SIDE EFFECTS: Calls the ATA handler
+ */
+extern void ata_intr();
+
+/* 
+ * page_fault_intr
+ *   DESCRIPTION: Saves all, passes the error code to the page fault handler, restores all, drops the error code, return from the exception
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none 
+ *   SIDE EFFECTS: Calls the page fault handler, which may map a page or halt the process
+ */
+extern void page_fault_intr();
+
+/* 
+ * exception_intr_table
+ *   DESCRIPTION: The linkages of exceptions 0 to 19 for the IDT, each saves a system call frame and calls exception_handler
+ *   SIDE EFFECTS: Signal delivery on the way back to user mode, as after every interrupt and system call
+ */
+extern uint32_t exception_intr_table[];
+
+/* 
+ * switch_to
+ *   DESCRIPTION: Saves the callee-saved registers and esp of the running context in \p prev, resumes the one saved in \p next
+ *   INPUTS: prev - where to keep the running context's kernel esp
+ *           next - the kernel esp of the context to run
+ *   OUTPUTS: *prev
+ *   RETURN VALUE: none, returns when some other switch_to resumes \p prev
+ *   SIDE EFFECTS: Changes the kernel stack, the caller keeps the page directory and TSS right
+ */
+extern void switch_to(uint32_t* prev, uint32_t* next);
+
+/* 
+ * child_return
+ *   DESCRIPTION: Where a new context's first switch_to returns, finishes the system call frame on its stack with 0
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: EAX = 0
+ *   SIDE EFFECTS: Returns to user mode
+ */
+extern void child_return();
+
 #endif
 #endif
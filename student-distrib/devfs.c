@@ -0,0 +1,106 @@
+#include "devfs.h"
+#include "system_call.h"
+
+typedef struct {
+    const int8_t* name;
+    uint32_t type;                          /* dentry file_type */
+    uint32_t dev;                           /* the driver's device number, used as the inode */
+    const file_operations_t* fops;
+} devfs_node_t;
+
+static const devfs_node_t devfs_nodes[] = {
+    {"rtc", 0, 0, &rtc_op},
+    {"hda", BDEV_FILE_TYPE, BCACHE_DEV_HDA, &bdev_op},
+    {"bcstat", BCSTAT_FILE_TYPE, 0, &bcstat_op},
+    {"pfstat", PFSTAT_FILE_TYPE, 0, &pfstat_op},
+    {"schedstat", SCHEDSTAT_FILE_TYPE, 0, &schedstat_op},
+};
+
+#define DEVFS_NUM_NODES (sizeof(devfs_nodes) / sizeof(devfs_nodes[0]))
+
+/*
+* devfs_present
+*   DESCRIPTION: Checks that the hardware behind a node exists
+*   INPUTS: node - the node
+*   OUTPUTS: none
+*   RETURN VALUE: 1 if it can be opened, 0 otherwise
+*   SIDE EFFECTS: none
+*/
+static int32_t devfs_present(const devfs_node_t* node){
+    return node->type != BDEV_FILE_TYPE || ata_sectors;
+}
+
+/*
+* devfs_lookup
+*   DESCRIPTION: Finds a device by name
+*   INPUTS: sb - devfs, dir - DEVFS_ROOT, name - the device name
+*   OUTPUTS: inode - the device
+*   RETURN VALUE: 0 if success, -1 if there is no such device
+*   SIDE EFFECTS: none
+*/
+static int32_t devfs_lookup(vfs_super_t* sb, uint32_t dir, const uint8_t* name, vfs_inode_t* inode){
+    uint32_t i;
+    for(i = 0; i < DEVFS_NUM_NODES; i++){
+        if(devfs_present(&devfs_nodes[i])
+           && strncmp((int8_t*)name, devfs_nodes[i].name, MAX_FILE_NAME) == 0){
+            inode->sb = sb;
+            inode->ino = devfs_nodes[i].dev;
+            inode->type = devfs_nodes[i].type;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+* devfs_readdir
+*   DESCRIPTION: Lists the devices that are present
+*   INPUTS: sb - devfs, dir - DEVFS_ROOT, index - the position
+*   OUTPUTS: dentry - the entry
+*   RETURN VALUE: 0 if success, -1 past the last device
+*   SIDE EFFECTS: none
+*/
+static int32_t devfs_readdir(vfs_super_t* sb, uint32_t dir, uint32_t index, dentry_t* dentry){
+    uint32_t i;
+    for(i = 0; i < DEVFS_NUM_NODES; i++){
+        if(devfs_present(&devfs_nodes[i]) && index-- == 0){
+            memset(dentry->file_name, 0, MAX_FILE_NAME);
+            strncpy((int8_t*)dentry->file_name, devfs_nodes[i].name, MAX_FILE_NAME);
+            dentry->file_type = devfs_nodes[i].type;
+            dentry->inode_num = devfs_nodes[i].dev;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+* devfs_fops
+*   DESCRIPTION: Gets the driver interface of a device, device numbers
+*                repeat across drivers so the type tells them apart
+*   INPUTS: inode - the device or DEVFS_ROOT
+*   OUTPUTS: none
+*   RETURN VALUE: the file operations
+*   SIDE EFFECTS: none
+*/
+static file_operations_t* devfs_fops(vfs_inode_t* inode){
+    uint32_t i;
+    for(i = 0; i < DEVFS_NUM_NODES; i++){
+        if(inode->type == devfs_nodes[i].type){
+            return (file_operations_t*)devfs_nodes[i].fops;
+        }
+    }
+    return (file_operations_t*)&dir_op;
+}
+
+static const vfs_super_ops_t devfs_ops = {
+    .lookup = devfs_lookup,
+    .readdir = devfs_readdir,
+    .fops = devfs_fops,
+};
+
+vfs_super_t devfs_super = {
+    .name = "devfs",
+    .ops = &devfs_ops,
+    .root = DEVFS_ROOT,
+};
@@ -0,0 +1,12 @@
+#ifndef _DEVFS_H
+#define _DEVFS_H
+
+#include "types.h"
+#include "vfs.h"
+
+#define DEVFS_ROOT 0xFFFFFFFF               /* inode number of "/dev", the others are device numbers */
+
+/* the devices, mounted at "/dev" */
+extern vfs_super_t devfs_super;
+
+#endif
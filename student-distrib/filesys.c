@@ -1,9 +1,21 @@
 #include "filesys.h"
 #include "system_call.h"
+#include "vfs.h"
+#include "lz4.h"
 
 file_descriptor_t global[8];
-uint32_t dir_pos=0;
-uint32_t file_size = 0;
+fs_zstats_t fs_zstats;
+
+// one decompressed block of a compressed file
+typedef struct {
+    uint32_t inode;
+    uint32_t block;
+    uint32_t used;                                  // LRU stamp, 0 if the slot is empty
+    uint8_t data[BLOCK_SIZE];
+} fs_zblock_t;
+
+static fs_zblock_t zcache[FS_ZCACHE_BLOCKS];
+static uint32_t zclock = 0;
 
 /*
 * file_system_init
@@ -22,23 +34,205 @@ void file_system_init(uint32_t boot_addr){
 }
 
 /*
-* read_dentry_by_name
-*   DESCRIPTION: Read the directory entry by name
+* fs_flags
+*   DESCRIPTION: Get the layout flags of the image
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: FS_FLAG_* bits, 0 for images without the layout header
+*   SIDE EFFECTS: none
+*/
+static uint32_t fs_flags(){
+    return boot_block->ext.magic == FS_EXT_MAGIC ? boot_block->ext.flags : 0;
+}
+
+/*
+* fs_data_block
+*   DESCRIPTION: Get the address of a data block
+*   INPUTS: block - the data block number
+*   OUTPUTS: none
+*   RETURN VALUE: pointer to the first byte of the block
+*   SIDE EFFECTS: none
+*/
+static uint8_t* fs_data_block(uint32_t block){
+    return (uint8_t*)&boot_block[boot_block->num_inodes + 1 + block];
+}
+
+/*
+* fs_block_map
+*   DESCRIPTION: Map a block index of a file to its data block number,
+*                following the indirect blocks on version 2 images
+*   INPUTS: inode - the inode of the file
+*           index - the block index within the file
+*   OUTPUTS: none
+*   RETURN VALUE: the data block number, or num_data_blocks if invalid
+*   SIDE EFFECTS: none
+*/
+static uint32_t fs_block_map(inode_t* inode, uint32_t index){
+    uint32_t invalid = boot_block->num_data_blocks;
+    uint32_t table;
+
+    if(!(fs_flags() & FS_FLAG_INDIRECT)){
+        return index < MAX_DATA_BLOCKS ? inode->data_block_num[index] : invalid;
+    }
+    if(index < FS_DIRECT_BLOCKS){
+        return inode->data_block_num[index];
+    }
+
+    index -= FS_DIRECT_BLOCKS;
+    if(index < FS_PTRS_PER_BLOCK){
+        table = inode->data_block_num[FS_SINGLE_INDIRECT];
+    } else {
+        index -= FS_PTRS_PER_BLOCK;
+        table = inode->data_block_num[FS_DOUBLE_INDIRECT];
+        if(table >= invalid){
+            return invalid;
+        }
+        table = ((uint32_t*)fs_data_block(table))[index / FS_PTRS_PER_BLOCK];
+        index %= FS_PTRS_PER_BLOCK;
+    }
+    if(table >= invalid){
+        return invalid;
+    }
+    return ((uint32_t*)fs_data_block(table))[index];
+}
+
+/*
+* fs_subdir_dentry
+*   DESCRIPTION: Locate an entry in the data blocks of a directory inode
+*   INPUTS: dir - the directory inode
+*           index - the index of the entry
+*   OUTPUTS: none
+*   RETURN VALUE: pointer to the entry, NULL past the last one
+*   SIDE EFFECTS: none
+*/
+static dentry_t* fs_subdir_dentry(uint32_t dir, uint32_t index){
+    inode_t* inode;
+    uint32_t block;
+
+    if(dir >= boot_block->num_inodes){
+        return NULL;
+    }
+    inode = &inode_block[dir];
+    if(index >= inode->file_size / sizeof(dentry_t)){
+        return NULL;
+    }
+    block = fs_block_map(inode, index / FS_DENTRIES_PER_BLOCK);
+    if(block >= boot_block->num_data_blocks){
+        return NULL;
+    }
+    return (dentry_t*)fs_data_block(block) + index % FS_DENTRIES_PER_BLOCK;
+}
+
+/*
+* fs_dentry
+*   DESCRIPTION: Locate a directory entry; entries past MAX_DIR_ENTRIES
+*                are stored in the data blocks of the directory inode
+*   INPUTS: index - the index of the entry, below num_dir_entries
+*   OUTPUTS: none
+*   RETURN VALUE: pointer to the entry, NULL if it can't be found
+*   SIDE EFFECTS: none
+*/
+static dentry_t* fs_dentry(uint32_t index){
+    if(index < MAX_DIR_ENTRIES){
+        return &dentry_block[index];
+    }
+    if(!(fs_flags() & FS_FLAG_DIRBLOCKS)){
+        return NULL;
+    }
+    return fs_subdir_dentry(boot_block->ext.dir_inode, index - MAX_DIR_ENTRIES);
+}
+
+/*
+* fs_dir_number
+*   DESCRIPTION: Get the directory a directory entry refers to
+*   INPUTS: dentry - an entry of type 1
+*   OUTPUTS: none
+*   RETURN VALUE: its inode for a subdirectory, FS_ROOT_DIR for "."
+*                 of the boot block's directory (inode 0)
+*   SIDE EFFECTS: none
+*/
+uint32_t fs_dir_number(const dentry_t* dentry){
+    if(!(fs_flags() & FS_FLAG_SUBDIRS) || dentry->inode_num == 0){
+        return FS_ROOT_DIR;
+    }
+    return dentry->inode_num;
+}
+
+/*
+* fs_name_hash
+*   DESCRIPTION: FNV-1a hash of a file name, same as fstools/fsimg.h
+*   INPUTS: fname - the name of the file, at most MAX_FILE_NAME bytes are used
+*   OUTPUTS: none
+*   RETURN VALUE: the 32-bit hash
+*   SIDE EFFECTS: none
+*/
+uint32_t fs_name_hash(const uint8_t* fname){
+    uint32_t hash = 2166136261U;
+    int i;
+    for(i = 0; i < MAX_FILE_NAME && fname[i]; i++){
+        hash ^= fname[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/*
+* fs_root_lookup
+*   DESCRIPTION: Find a name in the boot block's directory. Images built
+*                by fstools/mkfsimg are searched through the hash bucket
+*                index or by binary search, others linearly
 *   INPUTS: fname - the name of the file
 *           dentry - the directory entry
 *   OUTPUTS: dentry - the directory entry
 *   RETURN VALUE: 0 if success, -1 if fail
 *   SIDE EFFECTS: none
 */
-int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
-    int i;
+static int32_t fs_root_lookup(const uint8_t* fname, dentry_t* dentry){
+    int i, lo, hi, mid, cmp;
+    uint32_t bucket;
+    dentry_t* entry;
     if(fname == NULL || strlen((int8_t*)fname) > MAX_FILE_NAME){
         return -1;
     }
 
+    if(fs_flags() & FS_FLAG_HASHED){
+        bucket = fs_name_hash(fname) % boot_block->ext.num_buckets;
+        for(i = boot_block->ext.bucket_start[bucket]; i < boot_block->ext.bucket_start[bucket + 1]; i++){
+            entry = fs_dentry(i);
+            if(entry && strncmp((int8_t*)fname, (int8_t*)entry->file_name, MAX_FILE_NAME) == 0){
+                *dentry = *entry;
+                return 0;
+            }
+        }
+        return -1;
+    }
+
+    if(fs_flags() & FS_FLAG_SORTED){
+        lo = 0;
+        hi = boot_block->num_dir_entries;
+        while(lo < hi){
+            mid = (lo + hi) / 2;
+            if((entry = fs_dentry(mid)) == NULL){
+                return -1;
+            }
+            cmp = strncmp((int8_t*)fname, (int8_t*)entry->file_name, MAX_FILE_NAME);
+            if(cmp == 0){
+                *dentry = *entry;
+                return 0;
+            }
+            if(cmp < 0){
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return -1;
+    }
+
     for(i = 0; i < boot_block->num_dir_entries; i++){
-        if(strncmp((int8_t*)fname, (int8_t*)dentry_block[i].file_name, MAX_FILE_NAME) == 0){
-            *dentry = dentry_block[i];
+        entry = fs_dentry(i);
+        if(entry && strncmp((int8_t*)fname, (int8_t*)entry->file_name, MAX_FILE_NAME) == 0){
+            *dentry = *entry;
             // f_size = inode_block->file_size;
             return 0;
         }
@@ -46,6 +240,120 @@ int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
     return -1;
 }
 
+/*
+* read_dentry_in_dir
+*   DESCRIPTION: Find a name in one directory. Subdirectories are always
+*                sorted, so they are binary searched
+*   INPUTS: dir - FS_ROOT_DIR or the inode of a subdirectory
+*           fname - one path component
+*   OUTPUTS: dentry - the directory entry
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+int32_t read_dentry_in_dir(uint32_t dir, const uint8_t* fname, dentry_t* dentry){
+    int lo, hi, mid, cmp;
+    dentry_t* entry;
+
+    if(dir == FS_ROOT_DIR){
+        return fs_root_lookup(fname, dentry);
+    }
+    if(fname == NULL || strlen((int8_t*)fname) > MAX_FILE_NAME || dir >= boot_block->num_inodes){
+        return -1;
+    }
+    lo = 0;
+    hi = inode_block[dir].file_size / sizeof(dentry_t);
+    while(lo < hi){
+        mid = (lo + hi) / 2;
+        if((entry = fs_subdir_dentry(dir, mid)) == NULL){
+            return -1;
+        }
+        cmp = strncmp((int8_t*)fname, (int8_t*)entry->file_name, MAX_FILE_NAME);
+        if(cmp == 0){
+            *dentry = *entry;
+            return 0;
+        }
+        if(cmp < 0){
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return -1;
+}
+
+/*
+* read_dentry_by_name
+*   DESCRIPTION: Read the directory entry by path, one component at a
+*                time from the boot block's directory. Empty components
+*                are skipped, "." is an ordinary entry of each directory
+*   INPUTS: fname - the path of the file, such as "frame0.txt" or
+*                   "docs/deep/a.txt"
+*           dentry - the directory entry
+*   OUTPUTS: dentry - the directory entry
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
+    uint8_t name[MAX_FILE_NAME + 1];
+    uint32_t len, dir = FS_ROOT_DIR;
+    dentry_t entry;
+    int found = 0;
+
+    if(fname == NULL || fname[0] == '\0'){
+        return -1;
+    }
+    while(*fname){
+        if(*fname == '/'){
+            fname++;
+            continue;
+        }
+        for(len = 0; fname[len] && fname[len] != '/'; len++){
+            if(len == MAX_FILE_NAME){
+                return -1;
+            }
+        }
+        if(found){
+            if(entry.file_type != 1){
+                return -1;                              /* a file used as a directory */
+            }
+            dir = fs_dir_number(&entry);
+        }
+        memcpy(name, fname, len);
+        name[len] = '\0';
+        fname += len;
+        if(read_dentry_in_dir(dir, name, &entry) == -1){
+            return -1;
+        }
+        found = 1;
+    }
+    if(!found){
+        return read_dentry_in_dir(FS_ROOT_DIR, (uint8_t*)".", dentry);   /* "/" */
+    }
+    *dentry = entry;
+    return 0;
+}
+
+/*
+* read_dir_entry
+*   DESCRIPTION: Read the index-th entry of a directory
+*   INPUTS: dir - FS_ROOT_DIR or the inode of a subdirectory
+*           index - the position
+*   OUTPUTS: dentry - the directory entry
+*   RETURN VALUE: 0 if success, -1 past the last entry
+*   SIDE EFFECTS: none
+*/
+int32_t read_dir_entry(uint32_t dir, uint32_t index, dentry_t* dentry){
+    dentry_t* entry;
+    if(dir == FS_ROOT_DIR){
+        return read_dentry_by_index(index, dentry);
+    }
+    if((entry = fs_subdir_dentry(dir, index)) == NULL){
+        return -1;
+    }
+    *dentry = *entry;
+    return 0;
+}
+
 /*
 * read_dentry_by_index
 *   DESCRIPTION: Read the directory entry by index
@@ -56,65 +364,187 @@ int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
 *   SIDE EFFECTS: none
 */
 int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
-    if(index >= boot_block->num_dir_entries || index < 0){
+    dentry_t* entry;
+    if(index >= boot_block->num_dir_entries || (entry = fs_dentry(index)) == NULL){
         return -1;
     }
-    *dentry = dentry_block[index];
+    *dentry = *entry;
     return 0;
 }
 
+/*
+* fs_lz4_block
+*   DESCRIPTION: Decompress one block of a compressed file, using the
+*                block index at the front of its inode
+*   INPUTS: file - the inode, index - the block, size - its decoded size
+*   OUTPUTS: dst - the block's data, size bytes
+*   RETURN VALUE: 0 if success, -1 if the index or data is corrupt
+*   SIDE EFFECTS: none
+*/
+static int32_t fs_lz4_block(inode_t* file, uint32_t index, uint8_t* dst, uint32_t size){
+    uint32_t start = file->data_block_num[1 + index] & ~FS_LZ4_RAW;
+    uint32_t end = file->data_block_num[2 + index] & ~FS_LZ4_RAW;
+    uint32_t first = file->data_block_num[0];
+    uint8_t* src;
+
+    if(first >= boot_block->num_data_blocks || end < start
+       || (end + BLOCK_SIZE - 1) / BLOCK_SIZE > boot_block->num_data_blocks - first){
+        return -1;
+    }
+    src = fs_data_block(first) + start;
+    if(file->data_block_num[1 + index] & FS_LZ4_RAW){
+        if(end - start != size){
+            return -1;
+        }
+        memcpy(dst, src, size);
+    } else if(lz4_decompress(src, end - start, dst, size) != (int32_t)size){
+        return -1;
+    }
+    fs_zstats.bytes_in += end - start;
+    fs_zstats.bytes_out += size;
+    return 0;
+}
+
+/*
+* fs_zcache_get
+*   DESCRIPTION: Find a decompressed block in the cache, or decompress it
+*                into the least recently used slot. Call with interrupts
+*                off, the slot may be reused once they are back on
+*   INPUTS: inode - the inode number, file - the inode
+*           index - the block, size - its decoded size
+*   OUTPUTS: none
+*   RETURN VALUE: the block's data, NULL if it is corrupt
+*   SIDE EFFECTS: may evict another block
+*/
+static uint8_t* fs_zcache_get(uint32_t inode, inode_t* file, uint32_t index, uint32_t size){
+    fs_zblock_t* victim = &zcache[0];
+    int i;
+
+    for(i = 0; i < FS_ZCACHE_BLOCKS; i++){
+        if(zcache[i].used && zcache[i].inode == inode && zcache[i].block == index){
+            zcache[i].used = ++zclock;
+            fs_zstats.hits++;
+            return zcache[i].data;
+        }
+        if(zcache[i].used < victim->used){
+            victim = &zcache[i];
+        }
+    }
+    fs_zstats.misses++;
+    if(fs_lz4_block(file, index, victim->data, size)){
+        victim->used = 0;
+        return NULL;
+    }
+    victim->inode = inode;
+    victim->block = index;
+    victim->used = ++zclock;
+    return victim->data;
+}
+
+/*
+* fs_lz4_read
+*   DESCRIPTION: read_data for compressed images. Only the blocks the
+*                range touches are decompressed: whole blocks straight
+*                into buf, partial ones through the block cache so that
+*                small sequential reads decompress each block once
+*   INPUTS: inode - the inode number, file - the inode
+*           offset - start of the range, length - its size, within the file
+*   OUTPUTS: buf - the data
+*   RETURN VALUE: the number of bytes read, -1 if the file is corrupt
+*   SIDE EFFECTS: none
+*/
+static int32_t fs_lz4_read(uint32_t inode, inode_t* file, uint32_t offset, uint8_t* buf, uint32_t length){
+    uint32_t copied = 0, index, off, size, run, flags;
+    uint8_t* data;
+
+    if((file->file_size + BLOCK_SIZE - 1) / BLOCK_SIZE > FS_LZ4_MAX_BLOCKS){
+        return -1;
+    }
+    while(copied < length){
+        index = (offset + copied) / BLOCK_SIZE;
+        off = (offset + copied) % BLOCK_SIZE;
+        size = file->file_size - index * BLOCK_SIZE;
+        if(size > BLOCK_SIZE){
+            size = BLOCK_SIZE;
+        }
+        run = size - off;
+        if(run > length - copied){
+            run = length - copied;
+        }
+
+        if(run == size){
+            if(fs_lz4_block(file, index, buf + copied, size)){
+                return -1;
+            }
+            fs_zstats.direct++;
+        } else {
+            cli_and_save(flags);
+            if((data = fs_zcache_get(inode, file, index, size)) == NULL){
+                restore_flags(flags);
+                return -1;
+            }
+            memcpy(buf + copied, data + off, run);
+            restore_flags(flags);
+        }
+        copied += run;
+    }
+    return copied;
+}
+
 /*
 *   read_data
-*   DESCRIPTION: Read the data of the file
+*   DESCRIPTION: Read the data of the file. Runs of consecutive data
+*                blocks are copied with a single memcpy; compressed
+*                images go through fs_lz4_read
 *   INPUTS: inode - the inode number
 *           offset - the offset of the file
 *           buf - the buffer to store the data
 *           length - the length of the data
 *   OUTPUTS: buf - the buffer to store the data
-*   RETURN VALUE: the number of bytes read
+*   RETURN VALUE: the number of bytes read, -1 on a bad inode or block
 *   SIDE EFFECTS: none
 */
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
-	int i=0;
-    uint32_t data_block_num;
+    uint32_t copied = 0;
+    uint32_t block, index, run, nblocks;
     uint32_t data_block_offset;
-    uint32_t origin_num_data = boot_block->num_data_blocks;
-    inode_t* inode_block = (inode_t*)&(boot_block[inode+1]); //get current inode block
-
-	if (inode>=boot_block->num_inodes+1 || inode<0) return -1; // invalid inode number
-    if(offset >= inode_block->file_size) return 0; // offset is larger than file size
-
-	data_block_num = offset/BLOCK_SIZE;
-	data_block_offset = offset%BLOCK_SIZE;
-    
-    // get the current data block
-    uint8_t* curr_data = (uint8_t*)&boot_block[boot_block->num_inodes+1+inode_block->data_block_num[data_block_num]] + data_block_offset;
-
-	// for (i=0;i<length;i++){
-    while(i<length){
-        // check if the offset is larger than the file size, yes exit
-		if (i+offset >= inode_block->file_size){
-			return i;	
-		}
-        // copy the data from data block to the buffer
-        memcpy(buf + i, curr_data, 1);
-		data_block_offset++;
-
-        // check if the data block offset is larger than the block size
-		if (data_block_offset%BLOCK_SIZE==0){
-            // get the next data block number for index
-			data_block_num++;
-            // check if the data block number is valid
-			if (inode_block->data_block_num[data_block_num]>=origin_num_data) return -1;
-            // get the next data block
-			curr_data = (uint8_t*)&boot_block[boot_block->num_inodes+1+inode_block->data_block_num[data_block_num]];
-		}
-		else{
-		    curr_data++;
-		}
-        i++;
-	}
-	return i;
+    inode_t* file;
+
+    if(inode >= boot_block->num_inodes) return -1;    // invalid inode number
+    file = &inode_block[inode];
+    if(offset >= file->file_size) return 0;           // offset is larger than file size
+    if(length > file->file_size - offset){
+        length = file->file_size - offset;              // stop at the end of the file
+    }
+
+    if(fs_flags() & FS_FLAG_LZ4){
+        return fs_lz4_read(inode, file, offset, buf, length);
+    }
+
+    index = offset / BLOCK_SIZE;
+    data_block_offset = offset % BLOCK_SIZE;
+    while(copied < length){
+        block = fs_block_map(file, index);
+        if(block >= boot_block->num_data_blocks) return -1;
+
+        // extend the run while the following blocks are adjacent in the image
+        nblocks = 1;
+        while(copied + nblocks * BLOCK_SIZE - data_block_offset < length
+              && fs_block_map(file, index + nblocks) == block + nblocks
+              && block + nblocks < boot_block->num_data_blocks){
+            nblocks++;
+        }
+        run = nblocks * BLOCK_SIZE - data_block_offset;
+        if(run > length - copied){
+            run = length - copied;
+        }
+
+        memcpy(buf + copied, fs_data_block(block) + data_block_offset, run);
+        copied += run;
+        index += nblocks;
+        data_block_offset = 0;
+    }
+    return copied;
 }
 
 /*
@@ -126,11 +556,8 @@ int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t lengt
 *   SIDE EFFECTS: none
 */
 int32_t file_open (const uint8_t* filename){
-    dentry_t file_dentry;
-    if(read_dentry_by_name(filename, &file_dentry) == -1){
-        return -1;
-    }
-    return 0;
+    vfs_inode_t inode;
+    return vfs_lookup(filename, &inode);
 }
 
 /*
@@ -146,7 +573,7 @@ int32_t file_open (const uint8_t* filename){
 
 int32_t file_read (int32_t fd, void* buf, int32_t nbytes){
 
-    pcb_t* curr_pcb = current_pcb();
+    pcb_t* curr_pcb = current_process();
 
     uint32_t inode_num = curr_pcb->fd[fd].inode;
     uint32_t pos = curr_pcb->fd[fd].file_position;
@@ -189,48 +616,37 @@ int32_t file_close (int32_t fd){
 *   SIDE EFFECTS: none
 */
 int32_t dir_open (const uint8_t* filename){
-    dentry_t dir_dentry;
-    if(read_dentry_by_name(filename, &dir_dentry) == -1){
-        return -1;
-    }
-    return 0;
-
+    vfs_inode_t inode;
+    return vfs_lookup(filename, &inode);
 }
 
 /*
-*   dir_read2
-*   DESCRIPTION: Read the directory
-*   INPUTS: offset - the offset of the directory
-*   OUTPUTS: none
-*   RETURN VALUE: the size of the file
-*   SIDE EFFECTS: none
+*   dir_read
+*   DESCRIPTION: Read the next name of the directory the fd is open on,
+*                through the VFS so that "/" lists every filesystem
+*                mounted there
+*   INPUTS: fd - the file descriptor
+*   OUTPUTS: buf - the name, 32 bytes
+*   RETURN VALUE: the length of the name, 0 after the last one
+*   SIDE EFFECTS: advances the fd to the next entry, or back to the first
 */
 int32_t dir_read(int32_t fd, void* buf, int32_t nbytes){
-    int rev;
-    // int i;
+    file_descriptor_t* desc = &current_process()->fd[fd];
+    vfs_inode_t dir;
     dentry_t dir_entry;
+    int rev;
 
-    if (buf == NULL || dir_pos >= boot_block->num_dir_entries){
-        dir_pos = 0;
+    dir.sb = desc->sb;
+    dir.ino = desc->inode;
+    dir.type = VFS_DIR_TYPE;
+    if (buf == NULL || vfs_readdir(&dir, desc->dir_index, &dir_entry) == -1){
+        desc->dir_index = 0;
         return 0;
     }
-
-    dir_entry = boot_block->dir_entries_arr[dir_pos];
-    dir_pos ++;
+    desc->dir_index++;
 
     memcpy(buf,&dir_entry.file_name,32);
 
-    // printf("file_name: ");
-    // for (i = 0; i < strlen((int8_t*)dir_entry.file_name); i++){
-    //     printf("%c",dir_entry.file_name[i]);
-    // }
-    // file_size = read_data(dir_entry.inode_num, 0, buf, 10000);
-    int8_t* addr = (int8_t*)boot_block+BLOCK_SIZE+(dir_entry.inode_num*BLOCK_SIZE);
-    memcpy(&file_size, addr, 4); // 4 bytes for the size of the file
-
-    // printf("  file_type: %d, file_size: %d", dir_entry.file_type, file_size);
-    // printf("\n");
-
     rev = strlen((int8_t*)dir_entry.file_name);
     if (strlen((int8_t*)dir_entry.file_name) >= 32){
         rev = 32;
@@ -264,3 +680,67 @@ int32_t dir_close (int32_t fd){
     return 0;
 }
 
+
+/*
+* filesys_lookup
+*   DESCRIPTION: VFS lookup in a directory of the image
+*   INPUTS: sb - the image, dir - FS_ROOT_DIR or a subdirectory inode
+*           name - the file name
+*   OUTPUTS: inode - the file
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+static int32_t filesys_lookup(vfs_super_t* sb, uint32_t dir, const uint8_t* name, vfs_inode_t* inode){
+    dentry_t dentry;
+    if(read_dentry_in_dir(dir, name, &dentry) == -1){
+        return -1;
+    }
+    inode->sb = sb;
+    inode->ino = dentry.file_type == VFS_DIR_TYPE ? fs_dir_number(&dentry) : dentry.inode_num;
+    inode->type = dentry.file_type;
+    return 0;
+}
+
+/*
+* filesys_readdir
+*   DESCRIPTION: VFS directory listing of the image
+*   INPUTS: sb - the image, dir - FS_ROOT_DIR or a subdirectory inode
+*           index - the position
+*   OUTPUTS: dentry - the entry
+*   RETURN VALUE: 0 if success, -1 past the last entry
+*   SIDE EFFECTS: none
+*/
+static int32_t filesys_readdir(vfs_super_t* sb, uint32_t dir, uint32_t index, dentry_t* dentry){
+    return read_dir_entry(dir, index, dentry);
+}
+
+/*
+* filesys_fops
+*   DESCRIPTION: Maps an image file type to its interface
+*   INPUTS: inode - the file
+*   OUTPUTS: none
+*   RETURN VALUE: the file operations
+*   SIDE EFFECTS: none
+*/
+static file_operations_t* filesys_fops(vfs_inode_t* inode){
+    switch(inode->type){
+        case 0:
+            return (file_operations_t*)&rtc_op;
+        case VFS_DIR_TYPE:
+            return (file_operations_t*)&dir_op;
+        default:
+            return (file_operations_t*)&file_op;
+    }
+}
+
+static const vfs_super_ops_t filesys_ops = {
+    .lookup = filesys_lookup,
+    .readdir = filesys_readdir,
+    .fops = filesys_fops,
+};
+
+vfs_super_t filesys_super = {
+    .name = "bootfs",
+    .ops = &filesys_ops,
+    .root = FS_ROOT_DIR,
+};
@@ -12,6 +12,31 @@
 
 #define BLOCK_SIZE 4096
 
+/* Layout hints written into the boot block's reserved bytes by fstools/mkfsimg */
+#define FS_EXT_MAGIC 0x31394653                     // "SF91"
+#define FS_FLAG_SORTED 0x01                         // dentries sorted by name (within each bucket if hashed)
+#define FS_FLAG_HASHED 0x02                         // bucket_start[] indexes the dentries by name hash
+#define FS_FLAG_INDIRECT 0x04                       // last two inode slots are single/double indirect blocks
+#define FS_FLAG_DIRBLOCKS 0x08                      // dentries past MAX_DIR_ENTRIES live in inode dir_inode
+#define FS_FLAG_SUBDIRS 0x10                        // directory dentries with a nonzero inode are subdirectories
+#define FS_FLAG_LZ4 0x20                            // regular files are LZ4 compressed one block at a time
+#define FS_HASH_BUCKETS 39                          // bucket_start[] + dir_inode fill the 52 reserved bytes
+
+/* Block mapping of an inode when FS_FLAG_INDIRECT is set */
+#define FS_DIRECT_BLOCKS 1021                       // data_block_num[0..1020] map blocks directly
+#define FS_SINGLE_INDIRECT 1021                     // data_block_num[1021] -> block of block numbers
+#define FS_DOUBLE_INDIRECT 1022                     // data_block_num[1022] -> block of indirect blocks
+#define FS_PTRS_PER_BLOCK (BLOCK_SIZE / 4)          // block numbers per indirect block
+#define FS_DENTRIES_PER_BLOCK (BLOCK_SIZE / 64)     // dentries per directory data block
+#define FS_ROOT_DIR 0xFFFFFFFF                      // directory number of the boot block's directory, subdirectories use their inode
+
+// Compressed files (FS_FLAG_LZ4): data_block_num[0] is the first data block of
+// the file's compressed blocks, stored back to back; data_block_num[1 + k] is
+// the byte offset of block k from there, and data_block_num[1 + nblocks] the end
+#define FS_LZ4_RAW 0x80000000                       // offset flag: the block is stored uncompressed
+#define FS_LZ4_MAX_BLOCKS (MAX_DATA_BLOCKS - 2)     // 4MB files at most
+#define FS_ZCACHE_BLOCKS 16                         // decompressed blocks kept for partial reads
+
 
 // Directory entry struct
 typedef struct {
@@ -21,12 +46,26 @@ typedef struct {
     uint8_t reserved[24];                           // 24 bytes reserved
 } dentry_t;
 
+// Boot block layout header struct
+typedef struct {
+    uint32_t magic;                                 // FS_EXT_MAGIC if the header is present
+    uint8_t version;                                // 1, 2 if INDIRECT/DIRBLOCKS may be set, 3 if SUBDIRS, 4 if LZ4
+    uint8_t flags;                                  // FS_FLAG_*
+    uint8_t num_buckets;                            // number of hash buckets
+    uint8_t pad;
+    uint8_t bucket_start[FS_HASH_BUCKETS + 1];      // first dentry of each bucket, plus end sentinel
+    uint32_t dir_inode;                             // inode holding dentries MAX_DIR_ENTRIES and up
+} __attribute__((packed)) fs_ext_t;
+
 // Boot block struct
 typedef struct {
     uint32_t num_dir_entries;                       // 4 bytes for number of directory entries
     uint32_t num_inodes;                            // 4 bytes for number of inodes
     uint32_t num_data_blocks;                       // 4 bytes for number of data blocks
-    uint8_t reserved[MAX_BOOT_RESERVED];            // 52 bytes reserved
+    union {
+        uint8_t reserved[MAX_BOOT_RESERVED];        // 52 bytes reserved
+        fs_ext_t ext;                               // layout header, see fstools/mkfsimg.c
+    };
     dentry_t dir_entries_arr[MAX_DIR_ENTRIES];   // Flexible array member for directory entries
 } boot_block_t;
 
@@ -48,13 +87,33 @@ typedef struct file_operations {
     int32_t (*close)(int32_t fd);
 } file_operations_t;
 
+struct vfs_super;
+
 typedef struct file_descriptor {
     file_operations_t* file_ops;                    // Pointer to the file operations table
+    struct vfs_super* sb;                           // Filesystem of the file, NULL for "/"
     uint32_t inode;                                 // Inode number for the file
     uint32_t file_position;                         // Current position in the file
     uint32_t flags;                                 // Flags indicating the status of the file descriptor
+    uint32_t ra_next;                               // Block a sequential read would start in (bcache)
+    uint32_t ra_window;                             // Read-ahead window in blocks, 0 if not sequential
+    uint32_t ra_end;                                // First block not read ahead yet
+    uint32_t dir_index;                             // Next entry dir_read returns
 } file_descriptor_t;
 
+typedef struct {
+    uint32_t hits;                                  // partial reads served from the cache
+    uint32_t misses;                                // blocks decompressed into the cache
+    uint32_t direct;                                // whole blocks decompressed into the reader's buffer
+    uint32_t bytes_in;                              // compressed bytes decoded
+    uint32_t bytes_out;                             // bytes they decoded to
+} fs_zstats_t;
+
+extern fs_zstats_t fs_zstats;
+
+// the boot image as a VFS filesystem, mounted at "/"
+extern struct vfs_super filesys_super;
+
 boot_block_t* boot_block;
 inode_t* inode_block;
 dentry_t* dentry_block;
@@ -72,8 +131,12 @@ int32_t dir_read(int32_t fd, void* buf, int32_t nbytes);
 int32_t dir_write (int32_t fd, const void* buf, int32_t nbytes);
 int32_t dir_close (int32_t fd);
 
+uint32_t fs_name_hash(const uint8_t* fname);
 int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
 int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry);
+int32_t read_dentry_in_dir(uint32_t dir, const uint8_t* fname, dentry_t* dentry);
+int32_t read_dir_entry(uint32_t dir, uint32_t index, dentry_t* dentry);
+uint32_t fs_dir_number(const dentry_t* dentry);
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
 
 #endif
@@ -0,0 +1,120 @@
+#include "futex.h"
+#include "system_call.h"
+
+static wait_queue_t buckets[FUTEX_BUCKETS];
+static uint32_t waiting_on[MAX_TASKS];          /* physical address each pid sleeps on, 0 if none */
+
+/*
+* futex_key
+*   DESCRIPTION: Finds the physical address of a word of the running
+*                process, so that processes sharing the page through
+*                shared memory agree on it whatever their virtual address.
+*                A user region page is written first: one fork still
+*                shares copy-on-write would move to a new frame on the
+*                next store, away from the key a sleeper was queued on
+*   INPUTS: addr - the word
+*   OUTPUTS: none
+*   RETURN VALUE: the physical address, 0 if it is not a mapped user word
+*   SIDE EFFECTS: faults the page in and ends its copy-on-write sharing;
+*                 the word keeps its value, callers have interrupts off
+*/
+static uint32_t futex_key(int32_t* addr){
+    volatile int32_t* word = (volatile int32_t*)addr;
+
+    if((uint32_t)addr & (sizeof(int32_t) - 1)){
+        return 0;
+    }
+    if(((uint32_t)addr >> 22) == USER_ENTRY){
+        *word = *word;                          /* demand loads and unshares it, or kills the process */
+    }
+    return user_virt_to_phys(current_process()->pid, (uint32_t)addr);
+}
+
+/*
+* futex_bucket
+*   DESCRIPTION: Hashes a physical address to its wait queue
+*   INPUTS: key - from futex_key
+*   OUTPUTS: none
+*   RETURN VALUE: the wait queue
+*   SIDE EFFECTS: none
+*/
+static wait_queue_t* futex_bucket(uint32_t key){
+    return &buckets[((key >> 2) ^ (key >> 12)) % FUTEX_BUCKETS];
+}
+
+/*
+* futex_wait
+*   DESCRIPTION: Sleeps on a user word as long as it holds the value the
+*                caller saw. The check and going to sleep happen with
+*                interrupts off, so a futex_wake after the caller changed
+*                the word cannot be missed. The caller checks its
+*                condition again on return, the wake up may be spurious
+*   INPUTS: addr - a 4-byte aligned word of the user region or of a
+*                  shared memory segment, expected - the value it held
+*   OUTPUTS: none
+*   RETURN VALUE: 0 after sleeping, -1 if the word changed already or
+*                 addr is not a user word
+*   SIDE EFFECTS: none
+*/
+int32_t futex_wait(int32_t* addr, int32_t expected){
+    uint32_t pid = current_pcb()->pid, flags, key;
+    wait_queue_t* queue;
+
+    cli_and_save(flags);
+    if((key = futex_key(addr)) == 0 || *(volatile int32_t*)addr != expected){
+        restore_flags(flags);
+        return -1;
+    }
+    queue = futex_bucket(key);
+    waiting_on[pid] = key;
+    sleep_on(queue);
+    queue->pids &= ~(1 << pid);                 /* still queued if it woke for another reason */
+    waiting_on[pid] = 0;
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* futex_wake
+*   DESCRIPTION: Wakes processes sleeping on a user word, leaving the
+*                others that hash to the same queue asleep
+*   INPUTS: addr - the word, n - at most this many
+*   OUTPUTS: none
+*   RETURN VALUE: the number woken, -1 if addr is not a user word
+*   SIDE EFFECTS: none
+*/
+int32_t futex_wake(int32_t* addr, int32_t n){
+    uint32_t flags, key, pid;
+    wait_queue_t* queue;
+    int32_t woken = 0;
+
+    cli_and_save(flags);
+    if((key = futex_key(addr)) == 0){
+        restore_flags(flags);
+        return -1;
+    }
+    queue = futex_bucket(key);
+    for(pid = 0; pid < MAX_TASKS && woken < n; pid++){
+        if((queue->pids & (1 << pid)) && waiting_on[pid] == key){
+            queue->pids &= ~(1 << pid);
+            waiting_on[pid] = 0;
+            GET_PCB(pid)->sleeping = 0;
+            woken++;
+        }
+    }
+    restore_flags(flags);
+    return woken;
+}
+
+/*
+* futex_exit
+*   DESCRIPTION: Forgets the word a task sleeps on when it is killed in
+*                futex_wait, so futex_wake does not count it as woken
+*   INPUTS: pid - the task
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+void futex_exit(uint32_t pid){
+    waiting_on[pid] = 0;
+}
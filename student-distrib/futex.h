@@ -0,0 +1,19 @@
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include "types.h"
+#include "lib.h"
+#include "pit.h"
+
+#define FUTEX_BUCKETS 16                        /* wait queues, hashed by physical address */
+
+/* sleeps if the word at addr still holds expected, until futex_wake on it */
+int32_t futex_wait(int32_t* addr, int32_t expected);
+
+/* wakes up to n processes sleeping on the word at addr, returns how many */
+int32_t futex_wake(int32_t* addr, int32_t n);
+
+/* forgets the word a task being killed sleeps on */
+void futex_exit(uint32_t pid);
+
+#endif
@@ -7,6 +7,8 @@ uint8_t exception_occurred = 0;
 
 typedef void (*exceptions)();
 
+static const exceptions EXP[EXCEPTION_SIZE] = {EXP0, EXP1, EXP2, EXP3, EXP4, EXP5, EXP6, EXP7, EXP8, EXP9, EXPA, EXPB, EXPC, EXPD, EXPE, EXPF, EXP10, EXP11, EXP12, EXP13};  //Function pointers to the handlers
+
 /* 
  * EXPX/systemcall_blank
  *   DESCRIPTION: Handlers for exceptions and unimplemented system call
@@ -121,6 +123,27 @@ void EXP13(){
     halt(255);
 }
 
+/* 
+ * exception_handler
+ *   DESCRIPTION: Called by the exception linkages. A fault in user mode
+ *                becomes DIV_ZERO (divide error) or SEGFAULT (anything
+ *                else) when the process has a handler for it and is not
+ *                already running one; the handler runs on the way out
+ *   INPUTS: vector - the exception number
+ *           frame - the faulting context
+ *   OUTPUTS: none
+ *   RETURN VALUE: none, if it returns at all
+ *   SIDE EFFECTS: Otherwise prints the exception and halts as before
+ */
+void exception_handler(uint32_t vector, syscall_frame_t* frame){
+    uint32_t signum = vector == 0 ? SIG_DIV_ZERO : SIG_SEGFAULT;
+
+    if ((frame->cs & 3) == 3 && !current_pcb()->sig_masked
+        && signal_send(current_pcb()->pid, signum) == 0)
+        return;
+    EXP[vector]();
+}
+
 /* 
  * idt_init
  *   DESCRIPTION: Initializes interrupt descripter table
@@ -131,7 +154,6 @@ void EXP13(){
  */
 void idt_init(){
     int i;
-    exceptions EXP[20] = {EXP0, EXP1, EXP2, EXP3, EXP4, EXP5, EXP6, EXP7, EXP8, EXP9, EXPA, EXPB, EXPC, EXPD, EXPE, EXPF, EXP10, EXP11, EXP12, EXP13};  //Function pointers to the handlers
     for (i = 0; i < NUM_VEC; i++){
         idt[i].present = 0;                 //traverse and set all entries
         idt[i].size = 1;
@@ -144,7 +166,7 @@ void idt_init(){
         if (i<EXCEPTION_SIZE){              //if the given entry is for exceptions, set present, dpl to kernel, and link to corresponding handler
             idt[i].present = 1;
             idt[i].dpl = 0;
-            SET_IDT_ENTRY(idt[i], EXP[i]);
+            SET_IDT_ENTRY(idt[i], exception_intr_table[i]);    //page faults go through the demand loader first
         }
         if (i==SYSTEMCALL){                 //if the given entry is for system call, set present, dpl to applications, and link to corresponding handler
             idt[i].present = 1;
@@ -167,6 +189,11 @@ void idt_init(){
             idt[i].dpl = 0;
             SET_IDT_ENTRY(idt[i], pit_intr);
         }
+        if (i == ATA) {
+            idt[i].present = 1;
+            idt[i].dpl = 0;
+            SET_IDT_ENTRY(idt[i], ata_intr);
+        }
     }
     lidt(idt_desc_ptr);                     //load the IDT
 }
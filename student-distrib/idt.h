@@ -1,11 +1,15 @@
 #ifndef IDT_H
 #define IDT_H
 
+#include "types.h"
+
 #define EXCEPTION_SIZE 0x14
 #define SYSTEMCALL 0x80
 #define KEYBOARD 0x21
 #define RTC 0x28
 #define PIT 0x20
+#define ATA 0x2E
+#define PAGE_FAULT 0x0E
 
 /* 
  * EXPX/systemcall_blank
@@ -37,6 +41,17 @@ void EXP12();
 void EXP13();
 void systemcall_blank();
 
+/* 
+ * exception_handler
+ *   DESCRIPTION: Called by the exception linkages, raises DIV_ZERO or SEGFAULT on a user fault with a handler
+ *   INPUTS: vector - the exception number, frame - the faulting context
+ *   OUTPUTS: none
+ *   RETURN VALUE: none 
+ *   SIDE EFFECTS: Prints the exception and halts the process when no handler takes it
+ */
+struct syscall_frame;
+void exception_handler(uint32_t vector, struct syscall_frame* frame);
+
 /* 
  * idt_init
  *   DESCRIPTION: Initializes interrupt descripter table
@@ -16,6 +16,9 @@
 #include "filesys.h"
 #include "system_call.h"
 #include "malloc.h"
+#include "ata.h"
+#include "bcache.h"
+#include "vfs.h"
 
 #define RUN_TESTS 1
 
@@ -23,12 +26,63 @@
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
+#define BOOT_PHASES 16
+
+/* TSC when each boot phase finished, printed once the shell is about to start */
+static struct {
+    const int8_t* name;
+    uint64_t tsc;
+} boot_phases[BOOT_PHASES];
+static uint32_t boot_phase_count = 0;
+
+/* Records the end of a boot phase. */
+static void boot_phase(const int8_t* name) {
+    if (boot_phase_count < BOOT_PHASES) {
+        boot_phases[boot_phase_count].name = name;
+        boot_phases[boot_phase_count].tsc = rdtsc();
+        boot_phase_count++;
+    }
+}
+
+/* Prints how long each boot phase took and the total, in microseconds
+   once the TSC is calibrated, in cycles before that. */
+static void boot_report() {
+    uint32_t i;
+
+    printf("boot:");
+    for (i = 1; i < boot_phase_count; i++)
+        printf(" %s %d", boot_phases[i].name, tsc_to_us(boot_phases[i].tsc - boot_phases[i - 1].tsc));
+    printf(", total %d %s\n", tsc_to_us(boot_phases[boot_phase_count - 1].tsc - boot_phases[0].tsc),
+           tsc_mhz ? "us" : "cycles");
+}
+
+/* Number of consoles asked for by "consoles=N" on the command line,
+   NUM_TERMINAL if it is not there; never more than the pids leave room
+   for besides their shells. */
+static uint32_t boot_consoles(const int8_t* cmdline) {
+    uint32_t count = 0;
+
+    for (; *cmdline; cmdline++) {
+        if (!strncmp(cmdline, "consoles=", 9)) {
+            for (cmdline += 9; *cmdline >= '0' && *cmdline <= '9'; cmdline++)
+                count = count * 10 + (*cmdline - '0');
+            return count > MAX_TASKS - TASK_HEADROOM ? MAX_TASKS - TASK_HEADROOM : count;
+        }
+    }
+    return NUM_TERMINAL;
+}
+
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
     uint32_t start_file;
+    uint32_t end_file;
+    uint32_t mem_end = 0;
+    uint32_t consoles = NUM_TERMINAL;
+
+    boot_phase("entry");
 
     /* Clear the screen. */
     clear();
@@ -46,16 +100,21 @@ void entry(unsigned long magic, unsigned long addr) {
     printf("flags = 0x%#x\n", (unsigned)mbi->flags);
 
     /* Are mem_* valid? */
-    if (CHECK_FLAG(mbi->flags, 0))
+    if (CHECK_FLAG(mbi->flags, 0)) {
         printf("mem_lower = %uKB, mem_upper = %uKB\n", (unsigned)mbi->mem_lower, (unsigned)mbi->mem_upper);
+        /* mem_upper starts at 1MB; more than 4GB cannot be addressed anyway */
+        mem_end = mbi->mem_upper < 0x3FFC00 ? (mbi->mem_upper + 1024) << 10 : 0xFFC00000;
+    }
 
     /* Is boot_device valid? */
     if (CHECK_FLAG(mbi->flags, 1))
         printf("boot_device = 0x%#x\n", (unsigned)mbi->boot_device);
 
     /* Is the command line passed? */
-    if (CHECK_FLAG(mbi->flags, 2))
+    if (CHECK_FLAG(mbi->flags, 2)) {
         printf("cmdline = %s\n", (char *)mbi->cmdline);
+        consoles = boot_consoles((int8_t*)mbi->cmdline);
+    }
 
     if (CHECK_FLAG(mbi->flags, 3)) {
         int mod_count = 0;
@@ -70,6 +129,7 @@ void entry(unsigned long magic, unsigned long addr) {
             }
             printf("\n");
             start_file = mod->mod_start;
+            end_file = mod->mod_end;
 
             mod_count++;
             mod++;
@@ -148,19 +208,33 @@ void entry(unsigned long magic, unsigned long addr) {
     }
 
     file_system_init(start_file);
+    boot_phase("fs");
 
     idt_init();
+    boot_phase("idt");
 
     /* Init the PIC */
     i8259_init();
+    boot_phase("pic");
 
 
     /* Initialize devices, memory, filesystem, enable device interrupts on the
      * PIC, any other initialization stuff... */
     keyboard_init();
+    boot_phase("kbd");
     rtc_init();
-
-    paging_init();
+    boot_phase("rtc");
+    ata_init();
+    boot_phase("ata");
+    pit_calibrate_tsc();
+    boot_phase("tsc");
+
+    paging_init(end_file, mem_end);
+    boot_phase("paging");
+    bcache_init();
+    boot_phase("bcache");
+    vfs_init();
+    boot_phase("vfs");
 
     /* Enable interrupts */
     /* Do not enable the following until after you have set up your
@@ -172,22 +246,17 @@ void entry(unsigned long magic, unsigned long addr) {
 #ifdef RUN_TESTS
     /* Run tests */
     launch_tests();
+    boot_phase("tests");
 #endif
     /* Execute the first program ("shell") ... */
-    clear();
-    
-    //initiate terminals;
-    get_terminal(0)->pid = -1;
-    get_terminal(1)->pid = -1;
-    get_terminal(2)->pid = -1;
-    get_terminal(0)->idle = 1;
-    get_terminal(1)->idle = 1;
-    get_terminal(2)->idle = 1;
-    *get_current_terminal()=2;
-
-    //Initialize PIT and force a context switch to start all shells
+    //initiate terminals, clears every screen
+    terminal_init(consoles);
+    boot_phase("console");
+    boot_report();
+
+    //Initialize PIT and schedule once to start the shell of the shown console, the others start when first shown
     pit_init(391);
-    pit_handler();
+    schedule();
 
     /* Spin (nicely, so we don't chew up cycles) */
     asm volatile (".1: hlt; jmp .1;");
@@ -118,7 +118,8 @@ void keyboard_handler(){
                     clear();
                     break;
                 case 0x2E:      //Ctrl + C
-                    active_terminal->halt = 1;      //Tell scheduler to halt the process running on active terminal
+                    if (signal_send(active_terminal->pid, SIG_INTERRUPT) == -1)
+                        active_terminal->halt = 1;  //No handler, tell scheduler to halt the process running on active terminal
                     break;
                 default:
                     break;
@@ -126,21 +127,9 @@ void keyboard_handler(){
             }
             else if (alt)
             {
-                switch (sc){
-                case 0x3B:          //Alt + F1
-                    switch_terminal(0);
-                    pit_handler();  //Force a context switch to ensure paging isn't going to be messed up by a second switch, and also runs smoother
-                    break;
-                case 0x3C:          //Alt + F2
-                    switch_terminal(1);
-                    pit_handler();
-                    break;
-                case 0x3D:          //Alt + F3
-                    switch_terminal(2);
-                    pit_handler();
-                    break;
-                default:
-                    break;
+                if (sc >= 0x3B && sc < 0x3B + get_num_terminals()){      //Alt + F1 .. F<n>, contiguous up to F10
+                    switch_terminal(sc - 0x3B);
+                    need_resched = 1;   //Switch on the way out of this interrupt, the shown console's shell starts there if it has none
                 }
             }
             else if (sc < KEYS_SIZE && keys[(uint32_t)sc]){
@@ -11,12 +11,23 @@
 #define TAB         0xF
 #define VIDEO_SIZE 0x1000
 
-static int screen_x;
-static int screen_y;
-static char* video_mem = (char *)VIDEO;
-
-static terminal_t terminals[NUM_TERMINAL];            //Array of terminals
+#define TERMINAL_VIDEO(idx) ((uint8_t*)VIDEO + (idx) * VIDEO_SIZE)              //VGA text page of a terminal
+
+// VGA CRTC registers, reference: http://www.osdever.net/FreeVGA/vga/crtcreg.htm
+#define CRTC_INDEX 0x3D4
+#define CRTC_DATA 0x3D5
+#define CRTC_START_HIGH 0x0C
+#define CRTC_START_LOW 0x0D
+#define CRTC_CURSOR_HIGH 0x0E
+#define CRTC_CURSOR_LOW 0x0F
+
+static terminal_t terminals[NUM_TERMINAL] = {          //Array of terminals, each keeps its screen in its own VGA page
+    [0].video = TERMINAL_VIDEO(0),                      //Boot messages go to terminal 0, terminal_init sets up the rest
+};
 static uint32_t active_terminal=0, current_terminal=0;                        //Index of active terminal
+static uint32_t num_terminals=1;                                              //Consoles in use, set at boot
+
+static void term_putc(terminal_t* term, uint8_t c);
 
 /* void clear(void);
  * Inputs: void
@@ -24,20 +35,13 @@ static uint32_t active_terminal=0, current_terminal=0;                        //
  * Function: Clears video memory */
 void clear(void) {
     int32_t i;
+    terminal_t* term = &terminals[active_terminal];     // Clears the terminal being shown
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
-        *(uint8_t *)(video_mem + VIDEO_SIZE + (i << 1)) = ' ';
-        *(uint8_t *)(video_mem + VIDEO_SIZE + (i << 1) + 1) = ATTRIB;
-    }
-    if (current_terminal==active_terminal){
-        screen_x = 0;
-        screen_y = 0;
-        terminals[active_terminal].cx = 0;
-        terminals[active_terminal].cy = 0;
-    }
-    else{
-        terminals[active_terminal].cx = 0;
-        terminals[active_terminal].cy = 0;
+        *(uint8_t *)(term->video + (i << 1)) = ' ';
+        *(uint8_t *)(term->video + (i << 1) + 1) = ATTRIB;
     }
+    term->cx = 0;
+    term->cy = 0;
     update_cursor();
 }
 
@@ -183,50 +187,62 @@ int32_t puts(int8_t* s) {
 /* void putc(uint8_t c);
  * Inputs: uint_8* c = character to print
  * Return Value: void
- *  Function: Output a character to the console */
+ *  Function: Output a character to the console of the running process's terminal */
 void putc(uint8_t c) {
+    term_putc(&terminals[current_terminal], c);
+}
+
+/* static void term_putc(terminal_t* term, uint8_t c);
+ * Inputs: terminal_t* term = terminal to print on
+ *         uint_8* c = character to print
+ * Return Value: void
+ *  Function: Output a character through the terminal's own video pointer and cursor,
+ *            shown or not, so nothing has to be remapped or swapped first */
+static void term_putc(terminal_t* term, uint8_t c) {
+    uint8_t* video = term->video;
     if(c == '\n' || c == '\r') {
-        screen_y++;
-        screen_x = 0;
-        if (screen_y == NUM_ROWS)   // If past the end of the screen, scroll
-            scroll();
+        term->cy++;
+        term->cx = 0;
+        if (term->cy == NUM_ROWS)   // If past the end of the screen, scroll
+            scroll(term);
     }
     else if (c == '\b'){
         int i, count = 1;
-        if ((screen_x||screen_y)&&*(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x-1) << 1)) == ' '&&*(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x-1) << 1) + 1) == TAB)
+        if ((term->cx||term->cy)&&*(uint8_t *)(video + ((NUM_COLS * term->cy + term->cx-1) << 1)) == ' '&&*(uint8_t *)(video + ((NUM_COLS * term->cy + term->cx-1) << 1) + 1) == TAB)
             count = 4;
         for (i = 0; i < count; i++){
-            if (!screen_x&&!screen_y)   // If at the beginning of the screen, return
+            if (!term->cx&&!term->cy)   // If at the beginning of the screen, return
                 return;
-            if (screen_x > 0)           // If not at border, move back one character
-                screen_x--;
+            if (term->cx > 0)           // If not at border, move back one character
+                term->cx--;
             else{                       // If line is empty, move to the end of the previous line
-                screen_x = NUM_COLS - 1;
-                screen_y--;
+                term->cx = NUM_COLS - 1;
+                term->cy--;
             }
-            *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';    // Replace character with empty space
-            *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
+            *(uint8_t *)(video + ((NUM_COLS * term->cy + term->cx) << 1)) = ' ';    // Replace character with empty space
+            *(uint8_t *)(video + ((NUM_COLS * term->cy + term->cx) << 1) + 1) = ATTRIB;
         }
     } 
     else if (c=='\t'){
         int i;
         for (i = 0; i < 4; i++){
-            putc(' ');                                                                          // Print four space
-            *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x-1) << 1) + 1) = TAB;      // Mark foreground as TAB (since space doesn't use foreground)
+            term_putc(term, ' ');                                                               // Print four space
+            *(uint8_t *)(video + ((NUM_COLS * term->cy + term->cx-1) << 1) + 1) = TAB;          // Mark foreground as TAB (since space doesn't use foreground)
         }
     }
     else {                              // If not a command character, print the character
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
-        screen_x++;
-        if (screen_x==NUM_COLS){        // If at the end of the line, move to the next line
-            screen_y++;
-            screen_x = 0;
-            if (screen_y == NUM_ROWS)   // If past the end of the screen, scroll
-                scroll();
+        *(uint8_t *)(video + ((NUM_COLS * term->cy + term->cx) << 1)) = c;
+        *(uint8_t *)(video + ((NUM_COLS * term->cy + term->cx) << 1) + 1) = ATTRIB;
+        term->cx++;
+        if (term->cx==NUM_COLS){        // If at the end of the line, move to the next line
+            term->cy++;
+            term->cx = 0;
+            if (term->cy == NUM_ROWS)   // If past the end of the screen, scroll
+                scroll(term);
         }
     }
-    update_cursor();  // Update the cursor position
+    if (term == &terminals[active_terminal])
+        update_cursor();  // Update the cursor position
 }
 
 /* void echo(uint8_t c);
@@ -234,20 +250,7 @@ void putc(uint8_t c) {
  * Return Value: void
  *  Function: Output a character to the console of the active terminal regardless of current process */
 void echo (uint8_t c){
-    if (current_terminal==active_terminal)      // If the terminal is active, print the character
-        putc(c);
-    else{                                       // If the terminal is not active, temporarily change cursor position and video memory address and print and then switch back
-        int cache_x = screen_x, cache_y = screen_y;
-        screen_x = terminals[active_terminal].cx;
-        screen_y = terminals[active_terminal].cy;
-        video_mem+=VIDEO_SIZE;
-        putc(c);
-        video_mem-=VIDEO_SIZE;
-        terminals[active_terminal].cx = screen_x;
-        terminals[active_terminal].cy = screen_y;
-        screen_x = cache_x;
-        screen_y = cache_y;
-    }
+    term_putc(&terminals[active_terminal], c);
 }
 
 /* int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
@@ -483,7 +486,7 @@ void* memmove(void* dest, const void* src, uint32_t n) {
  *               character that does not match has a greater value
  *               in str1 than in str2; And a value less than zero
  *               indicates the opposite.
- * Function: compares string 1 and string 2 for equality */
+ * Function: compares string 1 and string 2 for equality, bytes as unsigned */
 int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n) {
     int32_t i;
     for (i = 0; i < n; i++) {
@@ -494,7 +497,7 @@ int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n) {
              * (s1[i] != s2[i]) evaluates to false, that is, if s1[i] ==
              * s2[i], then we only need to test either s1[i] or s2[i] for
              * '\0', since we know they are equal. */
-            return s1[i] - s2[i];
+            return (uint8_t)s1[i] - (uint8_t)s2[i];    /* unsigned, as memcmp sorts the image */
         }
     }
     return 0;
@@ -534,6 +537,37 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
     return dest;
 }
 
+/* void stat_line(int8_t* text, const int8_t* label, uint32_t value, const int8_t* unit)
+ * Inputs:   int8_t* text = the statistics text so far
+ *    const int8_t* label = what comes before the value
+ *         uint32_t value = the number, written in decimal
+ *     const int8_t* unit = what comes after it
+ * Return Value: none
+ * Function: appends "label value unit" to the text of a statistics pseudo-file */
+void stat_line(int8_t* text, const int8_t* label, uint32_t value, const int8_t* unit) {
+    int8_t num[16];
+    text += strlen(text);
+    strcpy(text, label);
+    strcpy(text + strlen(text), itoa(value, num, 10));
+    strcpy(text + strlen(text), unit);
+}
+
+/* int32_t stat_read(const int8_t* text, uint32_t pos, void* buf, int32_t nbytes)
+ * Inputs: const int8_t* text = the whole statistics text
+ *               uint32_t pos = the reader's file position
+ *             int32_t nbytes = the number of bytes to read
+ * Return Value: the number of bytes copied to buf, 0 at the end
+ * Function: reads a statistics pseudo-file, formatted anew on every read */
+int32_t stat_read(const int8_t* text, uint32_t pos, void* buf, int32_t nbytes) {
+    uint32_t len = strlen(text);
+    if (pos >= len)
+        return 0;
+    if ((uint32_t)nbytes > len - pos)
+        nbytes = len - pos;
+    memcpy(buf, text + pos, nbytes);
+    return nbytes;
+}
+
 /* void test_interrupts(void)
  * Inputs: void
  * Return Value: void
@@ -541,24 +575,23 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
 void test_interrupts(void) {
     int32_t i;
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
-        video_mem[i << 1]++;
+        terminals[current_terminal].video[i << 1]++;
     }
 }
 
-/* void scroll(void);
- * Inputs: void
+/* void scroll(terminal_t* term);
+ * Inputs: terminal_t* term = terminal to scroll
  * Return Value: void
  * Function: Scrolls the terminal by one line */
-void scroll() {
+void scroll(terminal_t* term) {
     int32_t i;
-    char video_buf[(NUM_ROWS-1) * NUM_COLS * 2];                                // Create a buffer to store the video memory
-    memcpy(video_buf, video_mem + NUM_COLS * 2, (NUM_ROWS-1) * NUM_COLS * 2);   // Copy the video memory to the buffer
-    memcpy(video_mem, video_buf, (NUM_ROWS-1) * NUM_COLS * 2);                  // Copy the buffer back to the video memory with offset of one line
+    uint8_t* video = term->video;
+    memmove(video, video + NUM_COLS * 2, (NUM_ROWS-1) * NUM_COLS * 2);          // Move every line up by one
     for (i = (NUM_ROWS-1) * NUM_COLS; i < NUM_ROWS * NUM_COLS; i++) {           // Clear the last line
-        *(uint8_t *)(video_mem + (i << 1)) = ' ';
-        *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;
+        *(uint8_t *)(video + (i << 1)) = ' ';
+        *(uint8_t *)(video + (i << 1) + 1) = ATTRIB;
     }
-    screen_y--;                                                                 // Adjust the screen_y
+    term->cy--;                                                                 // Adjust the cursor row
 }
 
 /* void update_cursor(int x, int y)
@@ -568,30 +601,70 @@ void scroll() {
  * Function: Updates the cursor position */
 void update_cursor(){
     //reference: https://wiki.osdev.org/Text_Mode_Cursor
-	uint16_t pos = terminals[active_terminal].cy * NUM_COLS + terminals[active_terminal].cx;    //Position of the cursor
+	uint16_t pos = active_terminal * (VIDEO_SIZE / 2)                   //Position of the cursor, counted from the start of VGA memory
+	             + terminals[active_terminal].cy * NUM_COLS + terminals[active_terminal].cx;
  
-	outb(0x0F, 0x3D4);                  //Set Cursor Low Byte
-	outb((uint8_t) (pos & 0xFF), 0x3D5);
-	outb(0x0E, 0x3D4);                  //Set Cursor High Byte
-	outb((uint8_t) ((pos >> 8) & 0xFF), 0x3D5);
+	outb(CRTC_CURSOR_LOW, CRTC_INDEX);  //Set Cursor Low Byte
+	outb((uint8_t) (pos & 0xFF), CRTC_DATA);
+	outb(CRTC_CURSOR_HIGH, CRTC_INDEX); //Set Cursor High Byte
+	outb((uint8_t) ((pos >> 8) & 0xFF), CRTC_DATA);
 }
 
 /* void switch_terminal(int terminal_idx)
  * Inputs: int terminal_idx: index of the terminal to switch to
  * Return Value: void
- * Side effect: Moves video data to corresponding terminal video memory, updates cursor position
- * Function: Switch to display corresponding terminal */
+ * Side effect: Points the CRTC at the terminal's VGA page, updates cursor position
+ * Function: Switch to display corresponding terminal, its screen is already
+ *           resident so nothing is copied */
 void switch_terminal(int terminal_idx){
-    if (terminal_idx==active_terminal)      // If the terminal is already active, do nothing
+    uint16_t start = terminal_idx * (VIDEO_SIZE / 2);   // Start address, in characters
+
+    if (terminal_idx==active_terminal || terminal_idx<0 || terminal_idx>=num_terminals)     // If the terminal is already active or not in use, do nothing
         return;
 
-    memcpy((void*)VIDEO+(active_terminal+2)*VIDEO_SIZE, (void*)VIDEO+VIDEO_SIZE, VIDEO_SIZE);   // Move the video data to the corresponding terminal video memory
-    memcpy((void*)VIDEO+VIDEO_SIZE, (void*)VIDEO+(terminal_idx+2)*VIDEO_SIZE, VIDEO_SIZE);
+    outb(CRTC_START_HIGH, CRTC_INDEX);
+    outb((uint8_t) ((start >> 8) & 0xFF), CRTC_DATA);
+    outb(CRTC_START_LOW, CRTC_INDEX);
+    outb((uint8_t) (start & 0xFF), CRTC_DATA);
 
     active_terminal = terminal_idx;         // Update the active terminal
     update_cursor();
 }
 
+/* void terminal_init(uint32_t count)
+ * Inputs: uint32_t count: consoles to use, clamped to 1..NUM_TERMINAL
+ * Return Value: void
+ * Side effect: Clears the screen of every console, marks them without a shell
+ * Function: Set up the consoles at boot, shells start the first time one is shown */
+void terminal_init(uint32_t count){
+    uint32_t i;
+
+    if (count < 1)
+        count = 1;
+    if (count > NUM_TERMINAL)
+        count = NUM_TERMINAL;
+    num_terminals = count;
+
+    for (i = 0; i < NUM_TERMINAL; i++){
+        terminals[i].video = TERMINAL_VIDEO(i);
+        terminals[i].pid = -1;
+        terminals[i].idle = 1;
+        memset_word(terminals[i].video, ' ' | (ATTRIB << 8), NUM_ROWS * NUM_COLS);
+        terminals[i].cx = 0;
+        terminals[i].cy = 0;
+    }
+    update_cursor();
+}
+
+/* uint32_t get_num_terminals()
+ * Inputs: none
+ * Return Value: number of consoles in use
+ * Side effect: none
+ * Function: let other files know how many consoles there are */
+uint32_t get_num_terminals(){
+    return num_terminals;
+}
+
 /* terminal_t* get_terminal(uint32_t terminal_idx)
  * Inputs: int terminal_idx: index of the terminal
  * Return Value: pointer to the terminal struct
@@ -618,17 +691,3 @@ uint32_t* get_active_terminal(){
 uint32_t* get_current_terminal(){
     return &current_terminal;
 }
-
-/* void sync_terminal()
- * Inputs: none
- * Return Value: none
- * Side effect: sync the cursor position with the terminal
- * Function: sync the cursor position with the terminal */
-void sync_terminal(){
-    int next_terminal = (current_terminal+1) % 3;   // Get the next terminal
-    terminals[current_terminal].cx = screen_x;      // Store current terminal cursor position and replace with next terminal cursor position
-    terminals[current_terminal].cy = screen_y;
-    screen_x = terminals[next_terminal].cx;
-    screen_y = terminals[next_terminal].cy;
-    update_cursor();
-}
@@ -25,15 +25,20 @@ int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
 
+/* Statistics pseudo-file text */
+void stat_line(int8_t* text, const int8_t* label, uint32_t value, const int8_t* unit);
+int32_t stat_read(const int8_t* text, uint32_t pos, void* buf, int32_t nbytes);
+
 void echo(uint8_t c);
-void scroll();
+void scroll(terminal_t* term);
 void update_cursor();
 void switch_terminal(int terminal_idx);
+void terminal_init(uint32_t count);
+uint32_t get_num_terminals();
 
 terminal_t* get_terminal(uint32_t terminal_idx);
 uint32_t* get_active_terminal();
 uint32_t* get_current_terminal();
-void sync_terminal();
 
 /* Userspace address-check functions */
 int32_t bad_userspace_addr(const void* addr, int32_t len);
@@ -83,6 +88,17 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the 64-bit time-stamp counter */
+static inline uint64_t rdtsc(void) {
+    uint64_t val;
+    asm volatile ("rdtsc"
+            : "=A"(val)
+            :
+            : "memory"
+    );
+    return val;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -106,7 +122,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
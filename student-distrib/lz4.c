@@ -0,0 +1,78 @@
+#include "lz4.h"
+#include "lib.h"
+
+#define LZ4_MIN_MATCH 4
+
+/*
+* lz4_length
+*   DESCRIPTION: Reads the 255-byte continuation of a length field
+*   INPUTS: src, len - the input, ip - the position of the first byte
+*           n - the 15 from the token
+*   OUTPUTS: ip - past the field
+*   RETURN VALUE: the length, or -1 if the input ends inside the field
+*   SIDE EFFECTS: none
+*/
+static int32_t lz4_length(const uint8_t* src, uint32_t len, uint32_t* ip, uint32_t n){
+    uint8_t b;
+    do {
+        if(*ip == len){
+            return -1;
+        }
+        b = src[(*ip)++];
+        n += b;
+    } while(b == 255);
+    return n;
+}
+
+/*
+* lz4_decompress
+*   DESCRIPTION: Decodes the LZ4 block format: sequences of a token,
+*                literals and a match copied from up to 64KB back. Every
+*                length and offset is checked, so a corrupt image can
+*                not write past \p cap
+*   INPUTS: src - the compressed block, len - its size
+*           cap - the room in dst
+*   OUTPUTS: dst - the decoded data
+*   RETURN VALUE: the decoded size, -1 if the input is corrupt
+*   SIDE EFFECTS: none
+*/
+int32_t lz4_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap){
+    uint32_t ip = 0, op = 0, offset;
+    int32_t n;
+    uint8_t token;
+
+    while(ip < len){
+        token = src[ip++];
+        n = token >> 4;
+        if(n == 15 && (n = lz4_length(src, len, &ip, n)) < 0){
+            return -1;
+        }
+        if((uint32_t)n > len - ip || (uint32_t)n > cap - op){
+            return -1;
+        }
+        memcpy(dst + op, src + ip, n);
+        ip += n;
+        op += n;
+        if(ip == len){
+            break;                                      /* the last sequence has no match */
+        }
+
+        if(len - ip < 2){
+            return -1;
+        }
+        offset = src[ip] | ((uint32_t)src[ip + 1] << 8);
+        ip += 2;
+        n = token & 15;
+        if(n == 15 && (n = lz4_length(src, len, &ip, n)) < 0){
+            return -1;
+        }
+        n += LZ4_MIN_MATCH;
+        if(offset == 0 || offset > op || (uint32_t)n > cap - op){
+            return -1;
+        }
+        for(; n; n--, op++){
+            dst[op] = dst[op - offset];                 /* may overlap, byte by byte */
+        }
+    }
+    return op;
+}
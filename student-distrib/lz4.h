@@ -0,0 +1,9 @@
+#ifndef _LZ4_H
+#define _LZ4_H
+
+#include "types.h"
+
+/* decodes an LZ4 block (no frame), returns the decoded size or -1 if corrupt */
+int32_t lz4_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap);
+
+#endif
@@ -15,6 +15,7 @@ struct block {
 };
 
 block_t *blocks = NULL;
+uint32_t heap_capacity = KERNEL_DYNAMIC_CAPACITY;
 
 /**
  * void *malloc(uint32_t size):
@@ -24,7 +25,7 @@ block_t *blocks = NULL;
  * RETURN: the allocated buffer, or NULL if failed
  */
 void *malloc(uint32_t size) {
-    if (size == 0 || size > KERNEL_DYNAMIC_CAPACITY) { /* the size is too large */
+    if (size == 0 || size > heap_capacity) { /* the size is too large */
         return NULL;
     }
 
@@ -71,7 +72,7 @@ void *malloc(uint32_t size) {
     blocks->prev = NULL;                        /* the first one */
     blocks->next = NULL;
     blocks = (block_t *)((unsigned char*)blocks + real_size);
-    blocks->size = (KERNEL_DYNAMIC_CAPACITY - real_size);
+    blocks->size = (heap_capacity - real_size);
     blocks->prev = NULL;
     blocks->next = NULL;
     return (void *)(KERNEL_DYNAMIC_BASE + sizeof(block_t));
@@ -5,8 +5,11 @@
 
 #define KERNEL_DYNAMIC_BASE (0xCA000000)
 #define KERNEL_DYNAMIC_PTE (KERNEL_DYNAMIC_BASE >> 22)
-#define KERNEL_DYNAMIC_PHYSICAL_BASE (10)
 #define KERNEL_DYNAMIC_CAPACITY (0xD0000000 - 0xCA000000) /* 0x6000000 */
+#define KERNEL_DYNAMIC_PAGES (KERNEL_DYNAMIC_CAPACITY >> 22)  /* 4MB frames behind the heap at most */
+
+/* bytes of the heap backed by RAM, set by paging_init */
+extern uint32_t heap_capacity;
 
 void *malloc(uint32_t size);
 
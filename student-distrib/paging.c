@@ -1,71 +1,138 @@
 #include "paging.h"
 #include "lib.h"
 #include "malloc.h"
+#include "system_call.h"
+#include "pit.h"
+#include "idt.h"
+#include "shm.h"
+
+#define POOL_FRAMES (MAX_TASKS * PAGE_TABLE_COUNT)  /* 4KB frames in the user pool */
+#define FRAME_INDEX(addr) (((addr) - (USER_FRAME(0) << FRAME_SHIFT)) >> PAGE_SHIFT)
+#define COPY_WINDOW_PTE 0x3FF                       /* kernel page at 0x3FF000 that maps one user frame to copy into */
+
+uint32_t user_frame_base;
+paging_stats_t paging_stats;
+
+/* one page directory per task, sharing the kernel's PDEs */
+static pde_t task_page_directory[MAX_TASKS][PAGE_DIRECTORY_COUNT] __attribute__((aligned(PAGING_ALIGNMENT)));
+/* one page table per task for the 4MB user region at USER_ENTRY */
+static pte_t user_page_table[MAX_TASKS][PAGE_TABLE_COUNT] __attribute__((aligned(PAGING_ALIGNMENT)));
+/* one page table per task for the shared memory window at SHM_ENTRY, in use once it attaches */
+static pte_t shm_page_table[MAX_TASKS][PAGE_TABLE_COUNT] __attribute__((aligned(PAGING_ALIGNMENT)));
+static uint16_t frame_ref[POOL_FRAMES];             /* mappings of each frame, 0 if it is free */
+static uint32_t frame_hint = 0;                     /* where frame_alloc starts looking */
 
 /**
- * void init_paging();
+ * void init_paging(uint32_t reserved_end, uint32_t mem_end);
  *      DESCRIPTION: Initializes the paging configuration;
  *                   As the document mentioned, the first 4MB
  *                   page should be broken down into 4KB subpages,
  *                   while the remaining pages should be 4MB.
+ *                   Physical memory up to reserved_end (the boot
+ *                   module may extend past 8MB) is identity mapped
+ *                   for the kernel; process and heap frames follow it.
+ *                   page_directory holds the kernel mappings only; each
+ *                   task gets a copy of it with its own user region and
+ *                   vidmap entries, so a context switch is one cr3 load.
+ *                   The kernel's mappings are global (CR4.PGE), so that
+ *                   load keeps their TLB entries.
  * 
- *      INPUTS: None
+ *                   The heap gets the 4MB frames that RAM still has
+ *                   after the pool, up to KERNEL_DYNAMIC_PAGES.
+ * 
+ *      INPUTS: reserved_end - end of the boot module
+ *              mem_end - end of RAM from the boot loader, 0 if unknown
  *      OUTPUTS: None
  *      RETURN: None
  * 
- *      SIDEEFFECTS: None
+ *      SIDEEFFECTS: never returns if RAM cannot hold the user pool and
+ *                   one heap frame
  */
-void paging_init() {
-    int i;
+void paging_init(uint32_t reserved_end, uint32_t mem_end) {
+    int i, pid;
+    uint32_t heap_frame_base, heap_frames = KERNEL_DYNAMIC_PAGES;
     int32_t ctrl_reg; /* used to g/s control registers */
 
     /* zero all of them */
     memset((void*)page_directory, 0, PAGE_DIRECTORY_COUNT * sizeof(pde_t));
     memset((void*)page_table, 0, PAGE_TABLE_COUNT * sizeof(pte_t));
-    memset((void*)page_table_user_vidmem, 0, PAGE_TABLE_COUNT * sizeof(pte_t));
+    memset((void*)page_table_user_vidmem, 0, sizeof(page_table_user_vidmem));
     
     /* PDE #0: the first 4MB should be further split into 4KB subpages */
     page_directory[0].KB.present = 1;
+    page_directory[0].KB.read_write = 1;    /* CR0.WP applies read-only to the kernel as well */
     page_directory[0].KB.page_size = 0;
     page_directory[0].val |= (uint32_t)page_table; /* plug the page table address into the page_dir[0]*/
 
     /* PDE #1: the second 4MB should be kernel page */
     page_directory[1].MB.present = 1;
+    page_directory[1].MB.read_write = 1;
     page_directory[1].MB.page_size = 1;
     page_directory[1].val |= (uint32_t)KERNEL_ADDR; /* plug the kernel address into the page_dir[1]*/
+    page_directory[1].MB.global = 1;            /* the same in every address space */
 
     /* PDE/PTE 2-1024: set necessary things, not presented*/
     page_table[1].page_base_address = 1;
-    page_table_user_vidmem[1].page_base_address = 1;
     for (i = 2; i < PAGE_DIRECTORY_COUNT; ++i) {
         page_directory[i].MB.page_size = 1; /* assign to 4MB pages for all remaining pages*/
         page_directory[i].MB.page_base_address = i; /* assign each address space to a specific page */
         page_table[i].page_base_address = i;
-        page_table_user_vidmem[i].page_base_address = i;
     }
     
-    page_table[VIDEO_MEMORY_PTE].present = 1; /* the page storing the video memory should be presented */
-    
-    page_table[VIDEO_MEMORY_PTE+1].present = 1; /* Backup video memory page */
-    page_table[VIDEO_MEMORY_PTE+2].present = 1; /* Terminal 0 video memory page */
-    page_table[VIDEO_MEMORY_PTE+3].present = 1; /* Terminal 1 video memory page */
-    page_table[VIDEO_MEMORY_PTE+4].present = 1; /* Terminal 2 video memory page */
+    /* frames 2..: the part of the boot module above 8MB, kernel only */
+    user_frame_base = (reserved_end + (1 << FRAME_SHIFT) - 1) >> FRAME_SHIFT;
+    if (user_frame_base < 2) {
+        user_frame_base = 2;
+    }
+    for (i = 2; i < user_frame_base && i < USER_ENTRY; ++i) {
+        page_directory[i].MB.present = 1;
+        page_directory[i].MB.read_write = 1;
+        page_directory[i].MB.global = 1;
+    }
+    heap_frame_base = USER_FRAME(MAX_TASKS);
+    if (mem_end) {
+        if ((mem_end >> FRAME_SHIFT) <= heap_frame_base) {
+            printf("paging: %uMB of RAM, %uMB needed for %u tasks\n", mem_end >> 20,
+                   (heap_frame_base + 1) << (FRAME_SHIFT - 20), MAX_TASKS);
+            asm volatile (".2: cli; hlt; jmp .2;");
+        }
+        if ((mem_end >> FRAME_SHIFT) - heap_frame_base < heap_frames) {
+            heap_frames = (mem_end >> FRAME_SHIFT) - heap_frame_base;
+        }
+    }
+    heap_capacity = heap_frames << FRAME_SHIFT;
 
-    page_table[VIDEO_MEMORY_PTE+1].page_base_address--; /* Set to map the video memory */
-    
-    page_table_user_vidmem[VIDEO_MEMORY_PTE].user_supervisor = 1;
-    page_table_user_vidmem[VIDEO_MEMORY_PTE].read_write = 1;
-    
-    page_directory[VIDEO_MEMORY_PTE].KB.present = 1;
-    page_directory[VIDEO_MEMORY_PTE].KB.user_supervisor = 1;
-    page_directory[VIDEO_MEMORY_PTE].KB.read_write = 1;
-    page_directory[VIDEO_MEMORY_PTE].KB.page_size = 0;          /* we need one subpage */
-    page_directory[VIDEO_MEMORY_PTE].KB.page_table_base_address = ((uint32_t)page_table_user_vidmem >> 12);
+    /* the VGA text pages, one screen per terminal; the CRTC picks the one shown */
+    for (i = VIDEO_MEMORY_PTE; i < VIDEO_MEMORY_PTE + VIDEO_PAGES; ++i) {
+        page_table[i].present = 1;
+        page_table[i].read_write = 1;
+        page_table[i].global = 1;
+    }
 
-    for (i = 0; i < 24; ++i) { /* 0xCA000000 ~ 0xCFFFFFFF, total 24 pages */
+    for (i = 0; i < NUM_TERMINAL; ++i) {   /* the vidmap page of each terminal: its own VGA page, shown or not */
+        page_table_user_vidmem[i][VIDEO_MEMORY_PTE].present = 1;
+        page_table_user_vidmem[i][VIDEO_MEMORY_PTE].user_supervisor = 1;
+        page_table_user_vidmem[i][VIDEO_MEMORY_PTE].read_write = 1;
+        page_table_user_vidmem[i][VIDEO_MEMORY_PTE].page_base_address = VIDEO_MEMORY_PTE + i;
+    }
+
+    for (i = 0; i < heap_frames; ++i) { /* 0xCA000000 ~ 0xCFFFFFFF, up to 24 pages */
         page_directory[KERNEL_DYNAMIC_PTE + i].MB.present = 1;
         page_directory[KERNEL_DYNAMIC_PTE + i].MB.read_write = 1;
-        page_directory[KERNEL_DYNAMIC_PTE + i].MB.page_base_address = (KERNEL_DYNAMIC_PHYSICAL_BASE + 1);
+        page_directory[KERNEL_DYNAMIC_PTE + i].MB.page_base_address = heap_frame_base + i;
+        page_directory[KERNEL_DYNAMIC_PTE + i].MB.global = 1;
+    }
+
+    /* the tasks' directories: the kernel PDEs copied once, a user
+     * region page table of their own and no vidmap until they ask */
+    for (pid = 0; pid < MAX_TASKS; ++pid) {
+        memcpy(task_page_directory[pid], page_directory, sizeof(page_directory));
+        task_page_directory[pid][USER_ENTRY].val = 0;
+        task_page_directory[pid][USER_ENTRY].KB.present = 1;
+        task_page_directory[pid][USER_ENTRY].KB.user_supervisor = 1;
+        task_page_directory[pid][USER_ENTRY].KB.read_write = 1;
+        task_page_directory[pid][USER_ENTRY].KB.page_size = 0;
+        task_page_directory[pid][USER_ENTRY].KB.page_table_base_address = (uint32_t)user_page_table[pid] >> PAGE_SHIFT;
     }
 
     /* **************************************************
@@ -99,10 +166,667 @@ void paging_init() {
                          :                  /* no inputs */
     );
 
-    ctrl_reg |= PAGING_FLAG; /* set the PG flag */
+    ctrl_reg |= PAGING_FLAG | PAGING_WRITE_PROTECT_FLAG; /* set the PG flag, and WP for copy-on-write */
 
     asm volatile (
         "movl %0, %%cr0" :                  /* no outputs */
                          : "r" (ctrl_reg)   /* input, gp register*/
     );
+
+    paging_global(1);
+}
+
+/**
+ * void paging_global(int32_t enable);
+ *      DESCRIPTION: Sets or clears CR4.PGE. With it set, pages marked
+ *                   global (the kernel, the video pages, the heap)
+ *                   survive cr3 loads; clearing it flushes them as well
+ *
+ *      INPUTS: enable - 1 to set, 0 to clear
+ *      OUTPUTS: None
+ *      RETURN: None
+ *
+ *      SIDEEFFECTS: flushes the TLB when cleared
+ */
+void paging_global(int32_t enable) {
+    uint32_t ctrl_reg;
+
+    asm volatile (
+        "movl %%cr4, %0" : "=r" (ctrl_reg)  /* output, gp register */
+                         :                  /* no inputs */
+    );
+
+    if (enable) {
+        ctrl_reg |= PAGING_GLOBAL_FLAG;
+    } else {
+        ctrl_reg &= ~PAGING_GLOBAL_FLAG;
+    }
+
+    asm volatile (
+        "movl %0, %%cr4" :                  /* no outputs */
+                         : "r" (ctrl_reg)   /* input, gp register*/
+                         : "memory"
+    );
+}
+
+/**
+ * uint32_t virt_to_phys(const void* addr);
+ *      DESCRIPTION: Walks the page directory to translate a virtual
+ *                   address, so device drivers can hand physical
+ *                   addresses to bus masters. Unmapped addresses
+ *                   (including everything before paging_init) are
+ *                   treated as identity mapped.
+ *
+ *      INPUTS: addr - the virtual address
+ *      OUTPUTS: None
+ *      RETURN: the physical address
+ *
+ *      SIDEEFFECTS: None
+ */
+uint32_t virt_to_phys(const void* addr) {
+    uint32_t va = (uint32_t)addr;
+    pde_t pde = page_directory[va >> 22];
+    pte_t* table;
+
+    if (!pde.MB.present) {
+        return va;
+    }
+    if (pde.MB.page_size) {
+        return (pde.MB.page_base_address << FRAME_SHIFT) | (va & ((1 << FRAME_SHIFT) - 1));
+    }
+    table = (pte_t*)(pde.KB.page_table_base_address << 12);
+    return (table[(va >> 12) & (PAGE_TABLE_COUNT - 1)].page_base_address << 12) | (va & (PAGING_ALIGNMENT - 1));
+}
+
+/**
+ * uint32_t frame_alloc();
+ *      DESCRIPTION: Takes a 4KB frame from the user pool, the 4MB
+ *                   frames after the boot module that used to hold
+ *                   one whole process image each.
+ *
+ *      INPUTS: None
+ *      OUTPUTS: None
+ *      RETURN: the physical address of the frame, 0 if the pool is empty
+ *
+ *      SIDEEFFECTS: None
+ */
+uint32_t frame_alloc() {
+    uint32_t i, frame, flags;
+
+    cli_and_save(flags);
+    for (i = 0; i < POOL_FRAMES; ++i) {
+        frame = (frame_hint + i) % POOL_FRAMES;
+        if (!frame_ref[frame]) {
+            frame_ref[frame] = 1;
+            frame_hint = frame + 1;
+            paging_stats.frames_used++;
+            restore_flags(flags);
+            return (USER_FRAME(0) << FRAME_SHIFT) + (frame << PAGE_SHIFT);
+        }
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * int32_t frame_share(uint32_t addr);
+ *      DESCRIPTION: Takes another reference on a frame in use, for a
+ *                   page that fork maps in a second address space
+ *
+ *      INPUTS: addr - the physical address frame_alloc returned
+ *      OUTPUTS: None
+ *      RETURN: 0, -1 if the frame is free, not in the pool, or its
+ *              count is at FRAME_REF_MAX; the caller copies it instead
+ *
+ *      SIDEEFFECTS: None
+ */
+int32_t frame_share(uint32_t addr) {
+    uint32_t frame = FRAME_INDEX(addr);
+    uint32_t flags;
+    int32_t result = -1;
+
+    if (frame >= POOL_FRAMES) {
+        return -1;
+    }
+    cli_and_save(flags);
+    if (frame_ref[frame] && frame_ref[frame] < FRAME_REF_MAX) {
+        frame_ref[frame]++;
+        result = 0;
+    }
+    restore_flags(flags);
+    return result;
+}
+
+/**
+ * void frame_free(uint32_t addr);
+ *      DESCRIPTION: Drops a reference on a frame, returning it to the
+ *                   user pool when no address space maps it any more
+ *
+ *      INPUTS: addr - the physical address frame_alloc returned
+ *      OUTPUTS: None
+ *      RETURN: None
+ *
+ *      SIDEEFFECTS: None
+ */
+void frame_free(uint32_t addr) {
+    uint32_t frame = FRAME_INDEX(addr);
+    uint32_t flags;
+
+    if (frame >= POOL_FRAMES) {
+        return;
+    }
+    cli_and_save(flags);
+    if (frame_ref[frame] && --frame_ref[frame] == 0) {
+        paging_stats.frames_used--;
+    }
+    restore_flags(flags);
+}
+
+/**
+ * uint32_t frame_refs(uint32_t addr);
+ *      DESCRIPTION: Counts the address spaces mapping a frame
+ *
+ *      INPUTS: addr - the physical address frame_alloc returned
+ *      OUTPUTS: None
+ *      RETURN: the references, 0 if the frame is free or not in the pool
+ *
+ *      SIDEEFFECTS: None
+ */
+uint32_t frame_refs(uint32_t addr) {
+    uint32_t frame = FRAME_INDEX(addr);
+    return frame < POOL_FRAMES ? frame_ref[frame] : 0;
+}
+
+/**
+ * static uint8_t* frame_window(uint32_t addr);
+ *      DESCRIPTION: Maps a user pool frame at the kernel's copy window,
+ *                   the pool itself is only mapped in user regions.
+ *                   Callers keep interrupts off while they use it
+ *
+ *      INPUTS: addr - the physical address of the frame
+ *      OUTPUTS: None
+ *      RETURN: the kernel address of the frame
+ *
+ *      SIDEEFFECTS: drops the window's old TLB entry
+ */
+static uint8_t* frame_window(uint32_t addr) {
+    page_table[COPY_WINDOW_PTE].val = addr;
+    page_table[COPY_WINDOW_PTE].present = 1;
+    page_table[COPY_WINDOW_PTE].read_write = 1;
+    invlpg(COPY_WINDOW_PTE << PAGE_SHIFT);
+    return (uint8_t*)(COPY_WINDOW_PTE << PAGE_SHIFT);
+}
+
+/**
+ * uint32_t user_virt_to_phys(uint32_t pid, uint32_t addr);
+ *      DESCRIPTION: Looks an address of a process up in its user region
+ *                   or its shared memory window, the two 4KB mapped
+ *                   parts of its address space
+ *
+ *      INPUTS: pid - the process, addr - the address
+ *      OUTPUTS: None
+ *      RETURN: the physical address, 0 if the page is not mapped
+ *
+ *      SIDEEFFECTS: None
+ */
+uint32_t user_virt_to_phys(uint32_t pid, uint32_t addr) {
+    pte_t* pte;
+
+    if ((addr >> 22) == USER_ENTRY) {
+        pte = &user_page_table[pid][(addr >> PAGE_SHIFT) & (PAGE_TABLE_COUNT - 1)];
+    } else if ((addr >> 22) == SHM_ENTRY && task_page_directory[pid][SHM_ENTRY].KB.present) {
+        pte = &shm_page_table[pid][(addr >> PAGE_SHIFT) & (PAGE_TABLE_COUNT - 1)];
+    } else {
+        return 0;
+    }
+    if (!pte->present) {
+        return 0;
+    }
+    return (pte->page_base_address << PAGE_SHIFT) | (addr & (PAGE_SIZE - 1));
+}
+
+/**
+ * void frame_clear(uint32_t addr);
+ *      DESCRIPTION: Zeroes a pool frame through the copy window
+ *
+ *      INPUTS: addr - the physical address of the frame
+ *      OUTPUTS: None
+ *      RETURN: None
+ *
+ *      SIDEEFFECTS: None
+ */
+void frame_clear(uint32_t addr) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    memset(frame_window(addr), 0, PAGE_SIZE);
+    restore_flags(flags);
+}
+
+/**
+ * void user_space_reset(uint32_t pid);
+ *      DESCRIPTION: Frees every frame mapped in a process's user
+ *                   region and leaves all of its pages not present,
+ *                   so the next program loads on demand; drops vidmap
+ *                   and detaches the shared memory segments
+ *
+ *      INPUTS: pid - the process
+ *      OUTPUTS: None
+ *      RETURN: None
+ *
+ *      SIDEEFFECTS: stale TLB entries remain until the caller reloads cr3
+ */
+void user_space_reset(uint32_t pid) {
+    int i;
+    for (i = 0; i < PAGE_TABLE_COUNT; ++i) {
+        if (user_page_table[pid][i].present) {
+            frame_free(user_page_table[pid][i].page_base_address << PAGE_SHIFT);
+        }
+        user_page_table[pid][i].val = 0;
+    }
+    task_page_directory[pid][VIDEO_MEMORY_PTE].val = 0;
+
+    if (task_page_directory[pid][SHM_ENTRY].KB.present) {
+        for (i = 0; i < PAGE_TABLE_COUNT; ++i) {
+            if (shm_page_table[pid][i].present) {
+                frame_free(shm_page_table[pid][i].page_base_address << PAGE_SHIFT);
+            }
+            shm_page_table[pid][i].val = 0;
+        }
+        task_page_directory[pid][SHM_ENTRY].val = 0;
+        shm_exit(pid);
+    }
+}
+
+/**
+ * int32_t user_space_fork(uint32_t parent, uint32_t child, int32_t cow);
+ *      DESCRIPTION: Gives a child the parent's user region and vidmap.
+ *                   With cow, both tables map the parent's frames and
+ *                   writable pages turn read-only and PTE_COW in both,
+ *                   so the first write to one copies it; otherwise
+ *                   every page is copied now, as a full image copy
+ *                   would. The parent's directory must be the one
+ *                   loaded, its pages are read through their user
+ *                   addresses
+ *
+ *      INPUTS: parent - the process forking, child - an unused pid,
+ *              cow - 1 to share the frames, 0 to copy them
+ *      OUTPUTS: None
+ *      RETURN: 0, -1 if the pool ran out (the child is left empty)
+ *
+ *      SIDEEFFECTS: reloads cr3, the parent's entries may have changed
+ */
+int32_t user_space_fork(uint32_t parent, uint32_t child, int32_t cow) {
+    pte_t* from = user_page_table[parent];
+    pte_t* to = user_page_table[child];
+    uint32_t i, frame, flags;
+
+    cli_and_save(flags);
+    for (i = 0; i < PAGE_TABLE_COUNT; ++i) {
+        to[i].val = 0;
+        if (!from[i].present) {
+            continue;
+        }
+        if (cow && frame_share(from[i].page_base_address << PAGE_SHIFT) == 0) {
+            if (from[i].read_write) {
+                from[i].read_write = 0;
+                from[i].available |= PTE_COW;
+            }
+            to[i] = from[i];
+        } else {                            /* a full copy, or a frame shared too often */
+            if ((frame = frame_alloc()) == 0) {
+                user_space_reset(child);
+                restore_flags(flags);
+                return -1;
+            }
+            memcpy(frame_window(frame), (void*)((USER_ENTRY << FRAME_SHIFT) | (i << PAGE_SHIFT)), PAGE_SIZE);
+            to[i] = from[i];
+            to[i].page_base_address = frame >> PAGE_SHIFT;
+        }
+    }
+    task_page_directory[child][VIDEO_MEMORY_PTE] = task_page_directory[parent][VIDEO_MEMORY_PTE];
+    if (task_page_directory[parent][SHM_ENTRY].KB.present) {    /* shared memory stays shared */
+        for (i = 0; i < PAGE_TABLE_COUNT; ++i) {
+            if (shm_page_table[parent][i].present &&
+                user_shm_map(child, SHM_ADDR | (i << PAGE_SHIFT), shm_page_table[parent][i].page_base_address << PAGE_SHIFT) == -1) {
+                user_space_reset(child);
+                restore_flags(flags);
+                return -1;
+            }
+        }
+        shm_fork(parent, child);
+    }
+    user_space_switch(parent);              /* no stale writable entries */
+    paging_stats.forks++;
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * void user_space_switch(uint32_t pid);
+ *      DESCRIPTION: Switches to a process's address space. The kernel
+ *                   mappings are the same in every directory, so this
+ *                   is the whole cost of changing address spaces
+ *
+ *      INPUTS: pid - the process
+ *      OUTPUTS: None
+ *      RETURN: None
+ *
+ *      SIDEEFFECTS: flushes the TLB
+ */
+void user_space_switch(uint32_t pid) {
+    asm volatile (
+        "movl %0, %%cr3" :                                  /* no outputs */
+                         : "r" (task_page_directory[pid])   /* input, gp register */
+                         : "memory"
+    );
+}
+
+/**
+ * void user_vidmap(uint32_t pid, uint32_t terminal);
+ *      DESCRIPTION: Maps the screen of the process's terminal at the
+ *                   vidmap address, the terminal's own VGA text
+ *                   page, so terminal switches never remap it
+ *
+ *      INPUTS: pid - the process, terminal - the terminal it runs on
+ *      OUTPUTS: None
+ *      RETURN: None
+ *
+ *      SIDEEFFECTS: drops the vidmap page from the TLB
+ */
+void user_vidmap(uint32_t pid, uint32_t terminal) {
+    task_page_directory[pid][VIDEO_MEMORY_PTE].val = 0;
+    task_page_directory[pid][VIDEO_MEMORY_PTE].KB.present = 1;
+    task_page_directory[pid][VIDEO_MEMORY_PTE].KB.user_supervisor = 1;
+    task_page_directory[pid][VIDEO_MEMORY_PTE].KB.read_write = 1;
+    task_page_directory[pid][VIDEO_MEMORY_PTE].KB.page_size = 0;        /* we need one subpage */
+    task_page_directory[pid][VIDEO_MEMORY_PTE].KB.page_table_base_address =
+        (uint32_t)page_table_user_vidmem[terminal] >> PAGE_SHIFT;
+    invlpg(USER_VIDMAP_ADDR);
+}
+
+/**
+ * int32_t user_shm_map(uint32_t pid, uint32_t addr, uint32_t frame);
+ *      DESCRIPTION: Maps a frame of a shared memory segment, writable, in
+ *                   the process's shared memory window, the way vidmap
+ *                   maps the screen: a 4KB page table of its own behind
+ *                   one PDE, plugged in with the first segment
+ *
+ *      INPUTS: pid - the process, addr - an address in the window,
+ *              frame - a pool frame
+ *      OUTPUTS: None
+ *      RETURN: 0, -1 if the frame cannot take another reference
+ *
+ *      SIDEEFFECTS: takes a reference on the frame, drops the page from the TLB
+ */
+int32_t user_shm_map(uint32_t pid, uint32_t addr, uint32_t frame) {
+    pte_t* pte = &shm_page_table[pid][(addr >> PAGE_SHIFT) & (PAGE_TABLE_COUNT - 1)];
+
+    if (!task_page_directory[pid][SHM_ENTRY].KB.present) {
+        task_page_directory[pid][SHM_ENTRY].val = 0;
+        task_page_directory[pid][SHM_ENTRY].KB.present = 1;
+        task_page_directory[pid][SHM_ENTRY].KB.user_supervisor = 1;
+        task_page_directory[pid][SHM_ENTRY].KB.read_write = 1;
+        task_page_directory[pid][SHM_ENTRY].KB.page_size = 0;
+        task_page_directory[pid][SHM_ENTRY].KB.page_table_base_address = (uint32_t)shm_page_table[pid] >> PAGE_SHIFT;
+    }
+    if (frame_share(frame) == -1) {
+        return -1;
+    }
+    if (pte->present) {
+        frame_free(pte->page_base_address << PAGE_SHIFT);
+    }
+    pte->val = frame;
+    pte->present = 1;
+    pte->read_write = 1;
+    pte->user_supervisor = 1;
+    invlpg(addr);
+    return 0;
+}
+
+/**
+ * int32_t user_page_map(uint32_t pid, uint32_t addr);
+ *      DESCRIPTION: Maps a fresh, writable frame at a user address of a
+ *                   process; its contents are whatever the frame held
+ *
+ *      INPUTS: pid - the process, addr - an address in its user region
+ *      OUTPUTS: None
+ *      RETURN: 0, -1 if the pool is empty
+ *
+ *      SIDEEFFECTS: None
+ */
+int32_t user_page_map(uint32_t pid, uint32_t addr) {
+    pte_t* pte = &user_page_table[pid][(addr >> PAGE_SHIFT) & (PAGE_TABLE_COUNT - 1)];
+    uint32_t frame = frame_alloc();
+
+    if (frame == 0) {
+        return -1;
+    }
+    pte->val = frame;
+    pte->present = 1;
+    pte->read_write = 1;
+    pte->user_supervisor = 1;
+    return 0;
+}
+
+/**
+ * uint32_t user_page_loan(uint32_t pid, uint32_t addr);
+ *      DESCRIPTION: Lends the frame behind a user page to a pipe, like a
+ *                   fork of that one page: the page turns read-only and
+ *                   PTE_COW, so the owner's next write copies it, and
+ *                   the caller holds a reference of its own. A page the
+ *                   process never touched is faulted in first
+ *
+ *      INPUTS: pid - the running process, addr - a page of its user region
+ *      OUTPUTS: None
+ *      RETURN: the physical address of the frame, 0 if it is not a user page
+ *              or the frame cannot take another reference
+ *
+ *      SIDEEFFECTS: drops the page from the TLB
+ */
+uint32_t user_page_loan(uint32_t pid, uint32_t addr) {
+    pte_t* pte = &user_page_table[pid][(addr >> PAGE_SHIFT) & (PAGE_TABLE_COUNT - 1)];
+    uint32_t frame;
+
+    if ((addr >> 22) != USER_ENTRY) {
+        return 0;
+    }
+    if (!pte->present) {
+        (void)*(volatile uint8_t*)addr;         /* demand loads it, or kills the process */
+    }
+    frame = pte->page_base_address << PAGE_SHIFT;
+    if (frame_share(frame) == -1) {             /* the pipe copies it instead */
+        return 0;
+    }
+    if (pte->read_write) {
+        pte->read_write = 0;
+        pte->available |= PTE_COW;
+        invlpg(addr);
+    }
+    paging_stats.pipe_loans++;
+    return frame;
+}
+
+/**
+ * void user_page_accept(uint32_t pid, uint32_t addr, uint32_t frame);
+ *      DESCRIPTION: Maps a frame lent by user_page_loan at a user page,
+ *                   read-only and PTE_COW, in place of whatever the page
+ *                   held; the reference the loan took becomes this
+ *                   mapping's
+ *
+ *      INPUTS: pid - the running process, addr - a page of its user
+ *              region, frame - from user_page_loan
+ *      OUTPUTS: None
+ *      RETURN: None
+ *
+ *      SIDEEFFECTS: frees the page's old frame, drops the page from the TLB
+ */
+void user_page_accept(uint32_t pid, uint32_t addr, uint32_t frame) {
+    pte_t* pte = &user_page_table[pid][(addr >> PAGE_SHIFT) & (PAGE_TABLE_COUNT - 1)];
+
+    if (pte->present) {
+        frame_free(pte->page_base_address << PAGE_SHIFT);
+    }
+    pte->val = frame;
+    pte->present = 1;
+    pte->user_supervisor = 1;
+    pte->available = PTE_COW;
+    invlpg(addr);
+    paging_stats.pipe_maps++;
+}
+
+/**
+ * void frame_read(uint32_t frame, uint32_t offset, void* buf, uint32_t nbytes);
+ *      DESCRIPTION: Copies part of a pool frame to a buffer through the
+ *                   copy window. The buffer's pages are written once
+ *                   beforehand, since the faults that demand load or
+ *                   copy them use the window as well
+ *
+ *      INPUTS: frame - a pool frame, offset - where to start in it,
+ *              nbytes - at most PAGE_SIZE - offset
+ *      OUTPUTS: buf - the bytes
+ *      RETURN: None
+ *
+ *      SIDEEFFECTS: None
+ */
+void frame_read(uint32_t frame, uint32_t offset, void* buf, uint32_t nbytes) {
+    uint32_t page;
+
+    for (page = (uint32_t)buf & ~(PAGE_SIZE - 1); page < (uint32_t)buf + nbytes; page += PAGE_SIZE) {
+        *(volatile uint8_t*)page = *(volatile uint8_t*)page;
+    }
+    memcpy(buf, frame_window(frame) + offset, nbytes);
+}
+
+/**
+ * int32_t page_fault_handler(uint32_t error);
+ *      DESCRIPTION: Demand loading. A missing page of the user region
+ *                   gets a fresh frame, filled from the program file
+ *                   for the image (bytes past the end of the file are
+ *                   zero) or zeroed for the bss and the stack. Faults
+ *                   from the kernel copying to or from user buffers are
+ *                   served the same way. A write to a page fork shares
+ *                   copies it first, or just makes it writable again if
+ *                   no other address space maps it any more. Anything
+ *                   else is left to exception_handler, a SEGFAULT.
+ *
+ *      INPUTS: error - the error code the CPU pushed
+ *      OUTPUTS: None
+ *      RETURN: 0 if the access can be retried, -1 for a real fault
+ *
+ *      SIDEEFFECTS: maps a page
+ */
+int32_t page_fault_handler(uint32_t error) {
+    pcb_t* pcb = current_process();     /* the address space and image are the process's */
+    uint32_t addr, page, frame;
+    int32_t n = 0;
+    pte_t* pte;
+
+    asm volatile (
+        "movl %%cr2, %0" : "=r" (addr)
+                         :
+    );
+    page = addr & ~(PAGE_SIZE - 1);
+
+    if ((addr >> 22) != USER_ENTRY || !pcb->present) {
+        return -1;
+    }
+    pte = &user_page_table[pcb->pid][(addr >> PAGE_SHIFT) & (PAGE_TABLE_COUNT - 1)];
+
+    if (error & PF_PRESENT) {
+        if (!(error & PF_WRITE) || !(pte->available & PTE_COW)) {
+            return -1;
+        }
+        frame = pte->page_base_address << PAGE_SHIFT;
+        if (frame_refs(frame) > 1) {            /* still shared, the writer gets a copy */
+            if ((frame = frame_alloc()) == 0) {
+                return -1;
+            }
+            memcpy(frame_window(frame), (uint8_t*)page, PAGE_SIZE);
+            frame_free(pte->page_base_address << PAGE_SHIFT);
+            pte->page_base_address = frame >> PAGE_SHIFT;
+            paging_stats.cow_copies++;
+        }
+        pte->read_write = 1;
+        pte->available &= ~PTE_COW;
+        invlpg(page);
+        paging_stats.cow_faults++;
+        return 0;
+    }
+
+    if (user_page_map(pcb->pid, page) == -1) {
+        return -1;
+    }
+
+    /* the kernel writes the page through its user address, now mapped */
+    if (page >= PROGRAM_IMAGE_ADDR && page - PROGRAM_IMAGE_ADDR < PROGRAM_IMAGE_LIMIT) {
+        n = read_data(pcb->exec_inode, page - PROGRAM_IMAGE_ADDR, (uint8_t*)page, PAGE_SIZE);
+    }
+    if (n < 0) {
+        n = 0;
+    }
+    memset((uint8_t*)page + n, 0, PAGE_SIZE - n);
+
+    paging_stats.faults++;
+    if (n) {
+        paging_stats.file_pages++;
+    } else {
+        paging_stats.zero_pages++;
+    }
+    pcb->page_faults++;
+    if ((error & PF_USER) && pcb->exec_tsc) {  /* the first instruction is about to run */
+        paging_stats.last_exec_us = tsc_to_us(rdtsc() - pcb->exec_tsc);
+        pcb->exec_tsc = 0;
+    }
+    return 0;
+}
+
+/**
+ * int32_t pfstat_open(const uint8_t* filename);
+ *      DESCRIPTION: Opens the demand paging statistics pseudo-file
+ *
+ *      INPUTS: filename - ignored, "/dev/pfstat"
+ *      OUTPUTS: None
+ *      RETURN: 0
+ *
+ *      SIDEEFFECTS: None
+ */
+int32_t pfstat_open(const uint8_t* filename) {
+    return 0;
+}
+
+/**
+ * int32_t pfstat_read(int32_t fd, void* buf, int32_t nbytes);
+ *      DESCRIPTION: Formats the demand paging statistics as text and
+ *                   reads it from the fd's position
+ *
+ *      INPUTS: fd - the file descriptor, nbytes - the number of bytes to read
+ *      OUTPUTS: buf - the text
+ *      RETURN: the number of bytes read, 0 at the end
+ *
+ *      SIDEEFFECTS: None
+ */
+int32_t pfstat_read(int32_t fd, void* buf, int32_t nbytes) {
+    int8_t text[512] = {0};
+    uint32_t pos = current_process()->fd[fd].file_position;
+
+    if (buf == NULL || nbytes < 0) {
+        return -1;
+    }
+    stat_line(text, "frames: ", paging_stats.frames_used, "");
+    stat_line(text, "/", POOL_FRAMES, " used\n");
+    stat_line(text, "launches: ", paging_stats.launches, "\n");
+    stat_line(text, "page faults: ", paging_stats.faults, "\n");
+    stat_line(text, "file pages: ", paging_stats.file_pages, "\n");
+    stat_line(text, "zero pages: ", paging_stats.zero_pages, "\n");
+    stat_line(text, "faults per launch: ", paging_stats.launches ? paging_stats.faults / paging_stats.launches : 0, "\n");
+    stat_line(text, "last exit faults: ", paging_stats.last_faults, "\n");
+    stat_line(text, "last exec to first instruction: ", paging_stats.last_exec_us, " us\n");
+    stat_line(text, "forks: ", paging_stats.forks, "\n");
+    stat_line(text, "copy-on-write faults: ", paging_stats.cow_faults, "");
+    stat_line(text, ", ", paging_stats.cow_copies, " copied\n");
+    stat_line(text, "pipe pages lent: ", paging_stats.pipe_loans, "");
+    stat_line(text, ", ", paging_stats.pipe_maps, " mapped\n");
+
+    return stat_read(text, pos, buf, nbytes);
 }
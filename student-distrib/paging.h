@@ -11,21 +11,139 @@
  */
 #define PAGING_FLAG 0x80000001
 
+/* makes the kernel's writes honour read-only pages too, bit #16 of CR0,
+ * so copying to a user buffer breaks copy-on-write like a user write */
+#define PAGING_WRITE_PROTECT_FLAG 0x00010000
+
 /* enables 4MB pages, bit #4 of CR4 */
 #define PAGING_SIZE_EXTENTION_FLAG 0x00000010
 
+/* keeps global pages in the TLB across cr3 loads, bit #7 of CR4 */
+#define PAGING_GLOBAL_FLAG 0x00000080
+
 #define PAGING_ALIGNMENT 0x1000     /* the alignment of PDE and PTE */
 
 #define KERNEL_ADDR 0x400000        /* kernel lies in here */
 #define KERNEL_PDE 1                /* the index of kernel page in PDE */
 #define VIDEO_MEMORY_ADDR 0xB8000   /* video memory lies in here */
 #define VIDEO_MEMORY_PTE 0xB8       /* the index of video memory PTE in 0th page*/
+#define VIDEO_PAGES 8               /* VGA text memory, 0xB8000 - 0xBFFFF, holds 8 screens */
+#if NUM_TERMINAL > VIDEO_PAGES
+#error "every console needs its own VGA text page"
+#endif
+#define USER_VIDMAP_ADDR ((VIDEO_MEMORY_PTE << 22) | (VIDEO_MEMORY_PTE << 12))  /* where vidmap puts the screen */
+
+#define SHM_ENTRY (USER_ENTRY + 1)  /* PDE of the shared memory window, right above the user stack */
+#define SHM_ADDR (SHM_ENTRY << 22)  /* where shared memory segments are attached */
+
+#define FRAME_SHIFT 22              /* 4MB physical frames */
+#define USER_FRAME(pid) (user_frame_base + (pid))  /* 4MB frames of the user page pool, one per task */
+#define PAGE_SIZE 0x1000            /* user images are mapped 4KB at a time */
+#define PAGE_SHIFT 12
+
+#define PF_PRESENT 0x01             /* page fault error code: protection violation, not a missing page */
+#define PF_WRITE 0x02               /* page fault error code: the access was a write */
+#define PF_USER 0x04                /* page fault error code: raised in user mode */
+
+#define FRAME_REF_MAX 0xFFFF        /* frame_share refuses a frame mapped this often */
+#define PTE_COW 0x1                 /* pte available bits: writable, but shared with a fork until written */
+
+#define PFSTAT_FILE_TYPE 6          /* dentry file_type of "/dev/pfstat" */
+
+typedef struct {
+    uint32_t launches;              /* programs started by execute */
+    uint32_t faults;                /* page faults served by demand loading */
+    uint32_t file_pages;            /* of those, pages read from the program file */
+    uint32_t zero_pages;            /* of those, bss and stack pages */
+    uint32_t frames_used;           /* 4KB frames mapped by processes now */
+    uint32_t last_faults;           /* page faults of the last program that exited */
+    uint32_t last_exec_us;          /* execute to first user instruction, last launch */
+    uint32_t forks;                 /* address spaces duplicated by fork */
+    uint32_t cow_faults;            /* writes to pages shared by fork */
+    uint32_t cow_copies;            /* of those, pages still shared that had to be copied */
+    uint32_t pipe_loans;            /* pages pipe writes lent instead of copying */
+    uint32_t pipe_maps;             /* of those, pages mapped into the reader instead of copied */
+} paging_stats_t;
+
+extern paging_stats_t paging_stats;
+
+/* first 4MB frame after the kernel and the boot module, see paging_init */
+extern uint32_t user_frame_base;
 
 pde_t page_directory[PAGE_DIRECTORY_COUNT] __attribute__((aligned(PAGING_ALIGNMENT)));
 pte_t page_table[PAGE_TABLE_COUNT] __attribute__((aligned(PAGING_ALIGNMENT)));
-pte_t page_table_user_vidmem[PAGE_TABLE_COUNT] __attribute__((aligned(PAGING_ALIGNMENT)));
+pte_t page_table_user_vidmem[NUM_TERMINAL][PAGE_TABLE_COUNT] __attribute__((aligned(PAGING_ALIGNMENT)));  /* vidmap, one per terminal */
+
+/* initialize the paging configuration of x86, halts if the user pool does not fit in RAM */
+void paging_init(uint32_t reserved_end, uint32_t mem_end);
+
+/* turns CR4.PGE on or off, turning it off flushes the global pages too */
+void paging_global(int32_t enable);
+
+/* drops the TLB entry of one page, global or not */
+static inline void invlpg(uint32_t addr) {
+    asm volatile ("invlpg (%0)"
+            :
+            : "r" (addr)
+            : "memory"
+    );
+}
+
+/* physical address behind a kernel virtual address, for DMA */
+uint32_t virt_to_phys(const void* addr);
+
+/* takes a free 4KB frame from the user pool, returns its physical address or 0 */
+uint32_t frame_alloc();
+
+/* takes another reference on a frame, for a page shared by fork; -1 once it has FRAME_REF_MAX */
+int32_t frame_share(uint32_t addr);
+
+/* drops a reference on a frame, it is free once the last one goes */
+void frame_free(uint32_t addr);
+
+/* references on a frame, 0 if it is free */
+uint32_t frame_refs(uint32_t addr);
+
+/* unmaps every page of a process's image and frees the frames */
+void user_space_reset(uint32_t pid);
+
+/* gives child a copy of parent's user region, parent's directory must be loaded;
+ * cow shares the frames read-only, otherwise every page is copied now */
+int32_t user_space_fork(uint32_t parent, uint32_t child, int32_t cow);
+
+/* maps a new frame at a user address of a process, not zeroed */
+int32_t user_page_map(uint32_t pid, uint32_t addr);
+
+/* lends the frame behind a page of the running process, which turns copy-on-write;
+ * returns the frame with a reference taken, 0 if the page cannot be mapped */
+uint32_t user_page_loan(uint32_t pid, uint32_t addr);
+
+/* maps a lent frame copy-on-write at a page of the running process, taking over the reference */
+void user_page_accept(uint32_t pid, uint32_t addr, uint32_t frame);
+
+/* copies bytes out of a pool frame to a buffer of the running process, call with interrupts off */
+void frame_read(uint32_t frame, uint32_t offset, void* buf, uint32_t nbytes);
+
+/* physical address behind a user or shared memory address of a process, 0 if it is not mapped */
+uint32_t user_virt_to_phys(uint32_t pid, uint32_t addr);
+
+/* zeroes a pool frame */
+void frame_clear(uint32_t addr);
+
+/* maps a frame writable at an address of a process's shared memory window, taking a reference; -1 if it cannot */
+int32_t user_shm_map(uint32_t pid, uint32_t addr, uint32_t frame);
+
+/* loads a process's page directory into cr3 */
+void user_space_switch(uint32_t pid);
+
+/* maps the process's terminal screen at the vidmap address */
+void user_vidmap(uint32_t pid, uint32_t terminal);
+
+/* #PF handler: loads or zeroes a missing user page, copies a page shared by fork
+ * on its first write, -1 for any other fault */
+int32_t page_fault_handler(uint32_t error);
 
-/* initialize the paging configuration of x86 */
-void paging_init();
+int32_t pfstat_open(const uint8_t* filename);
+int32_t pfstat_read(int32_t fd, void* buf, int32_t nbytes);
 
 #endif
@@ -0,0 +1,274 @@
+#include "pipe.h"
+#include "malloc.h"
+#include "system_call.h"
+
+static pipe_t pipes[MAX_PIPES];
+
+/*
+* pipe_create
+*   DESCRIPTION: Finds a free pipe and gives it a ring buffer
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: the pipe's slot, or -1 if none is free or the heap
+*                 is exhausted
+*   SIDE EFFECTS: the pipe starts with one reader and one writer
+*/
+int32_t pipe_create(){
+    int32_t i;
+    uint32_t flags;
+
+    cli_and_save(flags);                /* a preempted pipe() could take the same slot, or be inside malloc */
+    for(i = 0; i < MAX_PIPES; i++){
+        if(pipes[i].buf == NULL){
+            if((pipes[i].buf = malloc(PIPE_SIZE)) == NULL){
+                restore_flags(flags);
+                return -1;
+            }
+            pipes[i].head = 0;
+            pipes[i].count = 0;
+            pipes[i].loan_head = 0;
+            pipes[i].loan_count = 0;
+            pipes[i].loan_offset = 0;
+            pipes[i].readers = 1;
+            pipes[i].writers = 1;
+            pipes[i].readq.pids = 0;
+            pipes[i].writeq.pids = 0;
+            restore_flags(flags);
+            return i;
+        }
+    }
+    restore_flags(flags);
+    return -1;
+}
+
+/*
+* pipe_release
+*   DESCRIPTION: Frees the buffer once neither end is open
+*   INPUTS: pipe - a pipe one of whose ends just closed
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: the slot can be reused
+*/
+static void pipe_release(pipe_t* pipe){
+    if(!pipe->readers && !pipe->writers){
+        for(; pipe->loan_count; pipe->loan_count--){
+            frame_free(pipe->loan[pipe->loan_head]);
+            pipe->loan_head = (pipe->loan_head + 1) % PIPE_LOAN_PAGES;
+        }
+        free(pipe->buf);
+        pipe->buf = NULL;
+    }
+}
+
+/*
+* pipe_dup
+*   DESCRIPTION: Takes another reference on the end an fd holds, for an
+*                fd copied by fork, dup2 or a new process's stdin/stdout;
+*                the copy is closed on its own
+*   INPUTS: fd - the copied file descriptor
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if it is a pipe, -1 otherwise
+*   SIDE EFFECTS: none
+*/
+int32_t pipe_dup(file_descriptor_t* fd){
+    if(fd->file_ops->close == pipe_read_close){
+        pipes[fd->inode].readers++;
+    }else if(fd->file_ops->close == pipe_write_close){
+        pipes[fd->inode].writers++;
+    }else{
+        return -1;
+    }
+    return 0;
+}
+
+/*
+* pipe_page_aligned
+*   DESCRIPTION: Tells whether a whole page of user memory starts at addr,
+*                the only kind of buffer pages are lent from or mapped into
+*   INPUTS: addr - a buffer address, nbytes - the bytes it has from there
+*   OUTPUTS: none
+*   RETURN VALUE: 1 if it does, 0 otherwise
+*   SIDE EFFECTS: none
+*/
+static int32_t pipe_page_aligned(uint32_t addr, uint32_t nbytes){
+    return !(addr & (PAGE_SIZE - 1)) && nbytes >= PAGE_SIZE && (addr >> 22) == USER_ENTRY;
+}
+
+/*
+* pipe_read_loans
+*   DESCRIPTION: Reads from the frames on loan. A whole page of the buffer
+*                gets the frame itself mapped copy-on-write, anything
+*                else is copied out of it
+*   INPUTS: pipe - a pipe with frames on loan, nbytes - the size of buf
+*   OUTPUTS: buf - the bytes read
+*   RETURN VALUE: the number of bytes read
+*   SIDE EFFECTS: called with interrupts off, remaps the reader's pages
+*/
+static uint32_t pipe_read_loans(pipe_t* pipe, uint8_t* buf, uint32_t nbytes){
+    uint32_t pid = current_process()->pid, frame, n, done = 0;
+
+    while(pipe->loan_count && done < nbytes){
+        frame = pipe->loan[pipe->loan_head];
+        if(pipe->loan_offset == 0 && pipe_page_aligned((uint32_t)buf + done, nbytes - done)){
+            user_page_accept(pid, (uint32_t)buf + done, frame);     /* the pipe's reference moves over */
+            n = PAGE_SIZE;
+        }else{
+            n = PAGE_SIZE - pipe->loan_offset < nbytes - done ? PAGE_SIZE - pipe->loan_offset : nbytes - done;
+            frame_read(frame, pipe->loan_offset, buf + done, n);
+            if(pipe->loan_offset + n == PAGE_SIZE){
+                frame_free(frame);
+            }
+        }
+        done += n;
+        if((pipe->loan_offset += n) == PAGE_SIZE){
+            pipe->loan_offset = 0;
+            pipe->loan_head = (pipe->loan_head + 1) % PIPE_LOAN_PAGES;
+            pipe->loan_count--;
+        }
+    }
+    return done;
+}
+
+/*
+* pipe_read
+*   DESCRIPTION: Reads what is in the pipe, up to nbytes, sleeping while
+*                it is empty and a writer is still open
+*   INPUTS: fd - the read end, nbytes - the size of buf
+*   OUTPUTS: buf - the bytes read
+*   RETURN VALUE: the number of bytes read, 0 at end of file
+*   SIDE EFFECTS: wakes writers waiting for room
+*/
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes){
+    pipe_t* pipe = &pipes[current_process()->fd[fd].inode];
+    uint32_t flags, n, first;
+
+    if(buf == NULL || nbytes <= 0){
+        return 0;
+    }
+    cli_and_save(flags);
+    while(pipe->count == 0 && pipe->loan_count == 0 && pipe->writers){
+        sleep_on(&pipe->readq);
+    }
+    if(pipe->loan_count){
+        n = pipe_read_loans(pipe, buf, nbytes);
+    }else{
+        n = (uint32_t)nbytes < pipe->count ? (uint32_t)nbytes : pipe->count;
+        first = PIPE_SIZE - pipe->head < n ? PIPE_SIZE - pipe->head : n;    /* up to the end of the ring */
+        memcpy(buf, pipe->buf + pipe->head, first);
+        memcpy((uint8_t*)buf + first, pipe->buf, n - first);
+        pipe->head = (pipe->head + n) % PIPE_SIZE;
+        pipe->count -= n;
+    }
+    if(n){
+        wake_up(&pipe->writeq);
+    }
+    restore_flags(flags);
+    return n;
+}
+
+/*
+* pipe_write
+*   DESCRIPTION: Writes all of buf into the pipe, sleeping whenever it is
+*                full until a reader makes room. A page-aligned buffer
+*                lends its whole pages instead of copying them: they turn
+*                copy-on-write in the writer and the pipe queues their
+*                frames, the rest goes through the ring. The ring and the
+*                loans are never both in use, so the bytes stay in order
+*   INPUTS: fd - the write end, buf - the bytes, nbytes - how many
+*   OUTPUTS: none
+*   RETURN VALUE: nbytes, or -1 if no reader is open; bytes written
+*                 before the last reader closed are not reported
+*   SIDE EFFECTS: wakes readers waiting for data
+*/
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes){
+    pipe_t* pipe = &pipes[current_process()->fd[fd].inode];
+    uint32_t pid = current_process()->pid;
+    uint32_t flags, n, tail, first, frame, done = 0;
+    int32_t lend;
+
+    if(buf == NULL || nbytes < 0){
+        return -1;
+    }
+    lend = pipe_page_aligned((uint32_t)buf, nbytes);
+    cli_and_save(flags);
+    while(done < (uint32_t)nbytes){
+        if(lend && nbytes - done >= PAGE_SIZE){
+            while((pipe->count || pipe->loan_count == PIPE_LOAN_PAGES) && pipe->readers){
+                sleep_on(&pipe->writeq);
+            }
+            if(!pipe->readers){
+                restore_flags(flags);
+                return -1;
+            }
+            if((frame = user_page_loan(pid, (uint32_t)buf + done))){
+                pipe->loan[(pipe->loan_head + pipe->loan_count) % PIPE_LOAN_PAGES] = frame;
+                pipe->loan_count++;
+                done += PAGE_SIZE;
+                wake_up(&pipe->readq);
+                continue;
+            }
+            lend = 0;
+        }
+        while((pipe->count == PIPE_SIZE || pipe->loan_count) && pipe->readers){
+            sleep_on(&pipe->writeq);
+        }
+        if(!pipe->readers){
+            restore_flags(flags);
+            return -1;
+        }
+        n = nbytes - done < PIPE_SIZE - pipe->count ? nbytes - done : PIPE_SIZE - pipe->count;
+        tail = (pipe->head + pipe->count) % PIPE_SIZE;
+        first = PIPE_SIZE - tail < n ? PIPE_SIZE - tail : n;
+        memcpy(pipe->buf + tail, (const uint8_t*)buf + done, first);
+        memcpy(pipe->buf, (const uint8_t*)buf + done + first, n - first);
+        pipe->count += n;
+        done += n;
+        wake_up(&pipe->readq);
+    }
+    restore_flags(flags);
+    return nbytes;
+}
+
+/*
+* pipe_read_close
+*   DESCRIPTION: Closes a read end
+*   INPUTS: fd - the file descriptor
+*   OUTPUTS: none
+*   RETURN VALUE: 0
+*   SIDE EFFECTS: writers fail once the last reader is gone, so they
+*                 are woken to see it
+*/
+int32_t pipe_read_close(int32_t fd){
+    pipe_t* pipe = &pipes[current_process()->fd[fd].inode];
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if(pipe->readers && --pipe->readers == 0){
+        wake_up(&pipe->writeq);
+        pipe_release(pipe);
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* pipe_write_close
+*   DESCRIPTION: Closes a write end
+*   INPUTS: fd - the file descriptor
+*   OUTPUTS: none
+*   RETURN VALUE: 0
+*   SIDE EFFECTS: readers see end of file once the last writer is gone,
+*                 so they are woken to see it
+*/
+int32_t pipe_write_close(int32_t fd){
+    pipe_t* pipe = &pipes[current_process()->fd[fd].inode];
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if(pipe->writers && --pipe->writers == 0){
+        wake_up(&pipe->readq);
+        pipe_release(pipe);
+    }
+    restore_flags(flags);
+    return 0;
+}
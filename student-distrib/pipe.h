@@ -0,0 +1,38 @@
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "types.h"
+#include "lib.h"
+#include "filesys.h"
+#include "pit.h"
+
+#define MAX_PIPES 8                             /* pipes that can exist at once */
+#define PIPE_SIZE 4096                          /* ring buffer bytes, one page of the kernel heap */
+#define PIPE_LOAN_PAGES 16                      /* user pages a pipe holds on loan, 64KB */
+
+typedef struct {
+    uint8_t* buf;                               /* NULL while the slot is free */
+    uint32_t head;                              /* next byte to read */
+    uint32_t count;                             /* bytes in the buffer */
+    uint32_t loan[PIPE_LOAN_PAGES];             /* frames lent by page-aligned writes, in order */
+    uint32_t loan_head;                         /* first frame to read */
+    uint32_t loan_count;                        /* frames on loan, only while the ring is empty */
+    uint32_t loan_offset;                       /* bytes of the first frame already read */
+    uint32_t readers;                           /* open fds on the read end */
+    uint32_t writers;                           /* open fds on the write end */
+    wait_queue_t readq;                         /* readers waiting for data */
+    wait_queue_t writeq;                        /* writers waiting for room */
+} pipe_t;
+
+/* allocates a pipe with one reader and one writer, returns its slot or -1 */
+int32_t pipe_create();
+
+/* takes another reference on the end of a pipe an fd copy holds, -1 if it is not a pipe */
+int32_t pipe_dup(file_descriptor_t* fd);
+
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t pipe_read_close(int32_t fd);
+int32_t pipe_write_close(int32_t fd);
+
+#endif
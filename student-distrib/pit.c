@@ -10,6 +10,21 @@
 #define PIT_CHANNEL_2 0x42
 #define PIT_COMMAND 0x43
 
+#define PIT_SHELL_RETRY_TICKS 391       /* 1s at pit_init(391) */
+
+#define PIT_CH2_ONESHOT 0xB0        /* channel 2, lobyte/hibyte, mode 0 */
+#define PIT_CH2_GATE_PORT 0x61      /* bit 0: gate, bit 1: speaker, bit 5: OUT2 */
+#define CALIBRATE_MS 10
+
+uint32_t tsc_mhz = 0;
+sched_stats_t sched_stats;
+volatile uint32_t need_resched = 0;
+uint32_t irq_depth = 0;
+
+static uint32_t pit_period_us = 0;          /* between two ticks */
+static uint64_t pit_last_tsc = 0;           /* when the last tick was handled */
+static uint32_t shell_backoff = 0;          /* ticks until a console's shell that found no free pid is retried */
+
 /* void pit_init(uint16_t frequency)
  * Inputs: uint16_t frequency: PIT frequency in HZ
  * Return Value: none
@@ -18,6 +33,8 @@
 void pit_init(uint16_t frequency) {
     uint16_t param = PIT_FREQUENCY / frequency;
 
+    pit_period_us = 1000000 / frequency;
+
     outb(PIT_SQUARE_MODE, PIT_COMMAND);
     outb((uint8_t)(param & 0xFF), PIT_CHANNEL_0);           /* send the frequency byte by byte */
     outb((uint8_t)((param >> 8) & 0xFF), PIT_CHANNEL_0);    /* shift right and reserve last 8 bytes*/
@@ -25,73 +42,252 @@ void pit_init(uint16_t frequency) {
     enable_irq(0);                                          /* enable the interrupt 0x20 in PIC */
 }
 
-/* void pit_handler()
+/* void pit_calibrate_tsc()
+ * Inputs: none
+ * Return Value: none
+ * Side effect: sets tsc_mhz, reprograms PIT channel 2 (speaker)
+ * Function: Counts TSC cycles over a 10ms one-shot of PIT channel 2 */
+void pit_calibrate_tsc() {
+    uint16_t latch = PIT_FREQUENCY / (1000 / CALIBRATE_MS);
+    uint64_t start, end;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    outb((inb(PIT_CH2_GATE_PORT) & ~0x02) | 0x01, PIT_CH2_GATE_PORT);  /* gate on, speaker off */
+    outb(PIT_CH2_ONESHOT, PIT_COMMAND);
+    outb((uint8_t)(latch & 0xFF), PIT_CHANNEL_2);
+    outb((uint8_t)((latch >> 8) & 0xFF), PIT_CHANNEL_2);
+
+    start = rdtsc();
+    while (!(inb(PIT_CH2_GATE_PORT) & 0x20));                           /* OUT2 rises at terminal count */
+    end = rdtsc();
+    restore_flags(flags);
+
+    tsc_mhz = (uint32_t)(end - start) / (CALIBRATE_MS * 1000);
+}
+
+/* uint32_t tsc_to_us(uint64_t cycles)
+ * Inputs: cycles - a TSC delta
+ * Return Value: the delta in microseconds, or the raw low word if uncalibrated
+ * Side effect: none
+ * Function: 64/32 division without libgcc; valid for deltas below ~70 minutes */
+uint32_t tsc_to_us(uint64_t cycles) {
+    uint32_t quotient, remainder;
+    if (!tsc_mhz) {
+        return (uint32_t)cycles;
+    }
+    asm volatile ("divl %4"
+            : "=a"(quotient), "=d"(remainder)
+            : "a"((uint32_t)cycles), "d"((uint32_t)(cycles >> 32)), "rm"(tsc_mhz)
+            : "cc"
+    );
+    return quotient;
+}
+
+/* pcb_t* next_task(uint32_t pid)
+ * Inputs: pid - the process running now
+ * Return Value: the next runnable process after it, NULL if there is none
+ * Side effect: none
+ * Function: Round robin over the threads of all processes; one runs while it is present
+ *           and not waiting in execute or waitpid for a child */
+static pcb_t* next_task(uint32_t pid) {
+    uint32_t i;
+    pcb_t* pcb;
+    for (i = 1; i <= MAX_TASKS; ++i) {
+        pcb = GET_PCB((pid + i) % MAX_TASKS);
+        if (pcb->present && !pcb->waiting && !pcb->sleeping)
+            return pcb;
+    }
+    return NULL;
+}
+
+/* void schedule()
  * Inputs: none
  * Return Value: none
  * Side effect: Switch the currently running process
- * Function: Handle the PIT interrupt and schedule processes in a round robin fashion */
-void pit_handler() {
-    send_eoi(0);            /* send eoi before handling it */
-    int current_terminal = *get_current_terminal();
-    int next_terminal = (*get_current_terminal()+1)%3;
-    pcb_t *current = GET_PCB(get_terminal(current_terminal)->pid);
+ * Function: Saves the running process with switch_to and resumes the next runnable
+ *           one where it called switch_to; a halting process is saved too, but never
+ *           picked again. The shown console's shell starts here the first time the
+ *           console is shown, and a process Ctrl+C halts dies here once it runs again */
+void schedule() {
+    pcb_t *current = current_pcb();
     pcb_t *next;
+    uint32_t active = *get_active_terminal();
+
+    need_resched = 0;
 
-    if (get_terminal(*get_current_terminal())->pid != -1){                /* If the kernel has been set up, if not, let execute set them */
-        asm volatile (
-            "movl %%ebp, %0\n"
-            : "=r"(current->ebp)
-        );
-        current->esp0 = tss.esp0;
+    if (get_terminal(active)->pid == -1 && !shell_backoff){     /* the shown console has no shell yet */
+        *get_current_terminal() = active;
+        execute((uint8_t*)"shell");         /* comes back when this process is scheduled again */
+        if (get_terminal(active)->pid != -1)
+            return;
+        *get_current_terminal() = current->terminal;               /* it could not start, the caller keeps its console */
+        shell_backoff = PIT_SHELL_RETRY_TICKS;
     }
 
-    if (next_terminal == *get_active_terminal()) {                              /* show the content */
-        page_table[VIDEO_MEMORY_PTE].page_base_address = VIDEO_MEMORY_PTE;
-        page_table_user_vidmem[VIDEO_MEMORY_PTE].page_base_address = VIDEO_MEMORY_PTE;
-    } else {                                                                    /* don't need to show, but need to update */
-        page_table[VIDEO_MEMORY_PTE].page_base_address = VIDEO_MEMORY_PTE + next_terminal + 2;
-        page_table_user_vidmem[VIDEO_MEMORY_PTE].page_base_address = VIDEO_MEMORY_PTE + next_terminal + 2;
+    if (!(next = next_task(current->pid)))  /* only while the shown console's shell cannot start */
+        return;
+
+    *get_current_terminal() = next->terminal;                                   /* update the current terminal, putc follows it */
+
+    if (next != current) {
+        user_space_switch(next->leader ? next->leader->pid : next->pid);       /* one cr3 load, threads load their process's */
+        tss.esp0 = next->esp0;
+        sched_stats.switches++;
+        switch_to(&current->ksp, &next->ksp);
     }
 
-    sync_terminal();    
-    *get_current_terminal() = next_terminal;                                    /* update the current terminal */
-    
-    if (get_terminal(next_terminal)->pid == -1)                                 /* if the task going to switch to isn't running */
-        execute((uint8_t*)"shell");
-    
-    next = GET_PCB(get_terminal(next_terminal)->pid);
-
-    page_directory[USER_ENTRY].MB.page_base_address = 2 + next->pid;
-    page_table_user_vidmem[VIDEO_MEMORY_PTE].present = next->vidmap;
-
-    tss.esp0=next->esp0;
-
-    if (get_terminal(next_terminal)->halt){    //If scheduled to be halted
-        asm volatile (
-        "movl %%cr3, %%ecx\n"       /* flush the TLB*/
-        "movl %%ecx, %%cr3\n"
-
-        "movl %0, %%ebp\n"       /* set new EBP, go to that kernel stack and halt*/
-        // "sti\n"
-        "leave\n"               
-        :
-        : "r"(next->ebp)
-        : "%ecx"
-        );
+    if (get_terminal(current->terminal)->halt && get_terminal(current->terminal)->pid == current->pid)    //If scheduled to be halted
         halt(128);
+}
+
+/* void sleep_on(wait_queue_t* queue)
+ * Inputs: queue - what the process waits for
+ * Return Value: none
+ * Side effect: runs other processes until the queue is woken
+ * Function: Marks the running process sleeping and schedules away; interrupts must
+ *           be off from checking the condition to here, or the wake up can be lost.
+ *           Callers check their condition again when this returns */
+void sleep_on(wait_queue_t* queue) {
+    pcb_t* pcb = current_pcb();
+    queue->pids |= 1 << pcb->pid;
+    pcb->waitq = queue;
+    pcb->sleeping = 1;
+    schedule();
+    pcb->waitq = NULL;
+    if (pcb->sleeping) {                    /* nothing else could run, let interrupts in */
+        pcb->sleeping = 0;
+        asm volatile ("sti; hlt; cli" ::: "memory");
     }
-    
-
-    asm volatile (
-        "movl %%cr3, %%ecx\n"       /* flush the TLB*/
-        "movl %%ecx, %%cr3\n"
-        "movl %0, %%ebp\n"       /* set new EBP, used by return */
-        // "sti\n"
-
-        "leave\n" 
-        "ret\n" 
-        :
-        : "r"(next->ebp)
-        : "%ecx"
-    );
+}
+
+/* void wake_up(wait_queue_t* queue)
+ * Inputs: queue - the event that happened
+ * Return Value: none
+ * Side effect: empties the queue
+ * Function: Lets every process sleeping on the queue be scheduled again */
+void wake_up(wait_queue_t* queue) {
+    uint32_t pid;
+    for (pid = 0; pid < MAX_TASKS; pid++)
+        if (queue->pids & (1 << pid))
+            GET_PCB(pid)->sleeping = 0;
+    queue->pids = 0;
+}
+
+/* void sleep_cancel(uint32_t pid)
+ * Inputs: pid - a task that is being killed
+ * Return Value: none
+ * Side effect: takes the pid off the queue it sleeps on
+ * Function: Forgets a task that will never return from sleep_on, so that a wake up
+ *           of its queue does not land on whatever task gets the pid next */
+void sleep_cancel(uint32_t pid) {
+    pcb_t* pcb = GET_PCB(pid);
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (pcb->waitq)
+        pcb->waitq->pids &= ~(1 << pid);
+    pcb->waitq = NULL;
+    pcb->sleeping = 0;
+    restore_flags(flags);
+}
+
+/* void preempt_disable()
+ * Inputs: none
+ * Return Value: none
+ * Side effect: the running process is not switched away on interrupt returns
+ * Function: Starts a section that interrupts may still run in, but no other process;
+ *           nests, and sleeping still switches */
+void preempt_disable() {
+    current_pcb()->preempt_count++;
+}
+
+/* void preempt_enable()
+ * Inputs: none
+ * Return Value: none
+ * Side effect: may switch to another process
+ * Function: Ends a preempt_disable section, and takes the switch a tick asked for
+ *           meanwhile once the outermost one ends */
+void preempt_enable() {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (--current_pcb()->preempt_count == 0 && need_resched && !irq_depth) {
+        sched_stats.preemptions++;
+        schedule();
+    }
+    restore_flags(flags);
+}
+
+/* void preempt_check()
+ * Inputs: none
+ * Return Value: none
+ * Side effect: may switch to another process
+ * Function: Called by intr_done with interrupts off on the way out of every interrupt,
+ *           exception and system call: switches if a tick asked for it, unless this is
+ *           a nested interrupt or the interrupted kernel code disabled preemption */
+void preempt_check() {
+    if (!need_resched || irq_depth)
+        return;
+    if (current_pcb()->preempt_count) {
+        sched_stats.deferred++;
+        return;
+    }
+    sched_stats.preemptions++;
+    schedule();
+}
+
+/* void pit_handler()
+ * Inputs: none
+ * Return Value: none
+ * Side effect: asks for a switch and records how late the tick was
+ * Function: Handle the PIT interrupt; processes are switched round robin on the way
+ *           out of it, by preempt_check. A tick is late by as long as interrupts were
+ *           disabled when it came, so the worst lateness bounds the longest cli
+ *           section from below */
+void pit_handler() {
+    uint64_t now = rdtsc();
+    uint32_t late;
+
+    send_eoi(0);            /* send eoi before handling it */
+    if (pit_last_tsc && tsc_mhz) {
+        late = tsc_to_us(now - pit_last_tsc);
+        late = late > pit_period_us ? late - pit_period_us : 0;
+        if (late > sched_stats.worst_irq_off_us)
+            sched_stats.worst_irq_off_us = late;
+    }
+    pit_last_tsc = now;
+    if (shell_backoff)
+        shell_backoff--;
+    bcache_tick();          /* periodic write-back of dirty blocks */
+    signal_tick();          /* ALARM intervals */
+    need_resched = 1;
+}
+
+/* int32_t schedstat_open(const uint8_t* filename)
+ * Inputs: filename - ignored, "/dev/schedstat"
+ * Return Value: 0
+ * Side effect: none
+ * Function: Opens the scheduler statistics pseudo-file */
+int32_t schedstat_open(const uint8_t* filename) {
+    return 0;
+}
+
+/* int32_t schedstat_read(int32_t fd, void* buf, int32_t nbytes)
+ * Inputs: fd - the file descriptor, nbytes - the number of bytes to read
+ * Return Value: the number of bytes read, 0 at the end
+ * Side effect: fills buf
+ * Function: Formats the scheduler statistics as text and reads it from the fd's position */
+int32_t schedstat_read(int32_t fd, void* buf, int32_t nbytes) {
+    int8_t text[256] = {0};
+    uint32_t pos = current_process()->fd[fd].file_position;
+
+    if (buf == NULL || nbytes < 0)
+        return -1;
+    stat_line(text, "context switches: ", sched_stats.switches, "\n");
+    stat_line(text, "preemptions: ", sched_stats.preemptions, "\n");
+    stat_line(text, "deferred by preempt_disable: ", sched_stats.deferred, "\n");
+    stat_line(text, "worst interrupts-off interval: ", sched_stats.worst_irq_off_us, " us\n");
+
+    return stat_read(text, pos, buf, nbytes);
 }
@@ -3,8 +3,63 @@
 
 #include "lib.h"
 
+#define SCHEDSTAT_FILE_TYPE 7       /* dentry file_type of "/dev/schedstat" */
+
+typedef struct {
+    uint32_t switches;              /* context switches by schedule */
+    uint32_t preemptions;           /* of those, forced by a tick rather than a sleep or exit */
+    uint32_t deferred;              /* interrupt returns that could not switch, preempt_disable held */
+    uint32_t worst_irq_off_us;      /* the latest a PIT tick was handled */
+} sched_stats_t;
+
+extern sched_stats_t sched_stats;
+
+/* set by the PIT, the next interrupt return outside preempt_disable switches */
+extern volatile uint32_t need_resched;
+
+/* interrupt handlers running, the linkages count them */
+extern uint32_t irq_depth;
+
+/* processes blocked on some event, one bit per pid */
+typedef struct wait_queue {
+    uint32_t pids;
+} wait_queue_t;
+
 extern void pit_init(uint16_t frequency);
 
 extern void pit_handler();
 
+/* switches to the next runnable process, returns when the caller is scheduled again */
+extern void schedule();
+
+/* blocks the running process on \p queue until wake_up, call with interrupts off */
+extern void sleep_on(wait_queue_t* queue);
+
+/* takes a task being killed off the queue it sleeps on */
+extern void sleep_cancel(uint32_t pid);
+
+/* makes every process blocked on \p queue runnable again */
+extern void wake_up(wait_queue_t* queue);
+
+/* no switch to another process until preempt_enable, interrupts stay on */
+extern void preempt_disable();
+
+/* ends preempt_disable, switches if a tick asked for it meanwhile */
+extern void preempt_enable();
+
+/* the reschedule check on the way out of interrupts, exceptions and system calls */
+extern void preempt_check();
+
+extern int32_t schedstat_open(const uint8_t* filename);
+extern int32_t schedstat_read(int32_t fd, void* buf, int32_t nbytes);
+
+/* measures the TSC frequency against PIT channel 2 */
+extern void pit_calibrate_tsc();
+
+/* converts a TSC cycle count into microseconds */
+extern uint32_t tsc_to_us(uint64_t cycles);
+
+/* TSC frequency in MHz, 0 before calibration */
+extern uint32_t tsc_mhz;
+
 #endif
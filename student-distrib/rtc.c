@@ -1,12 +1,6 @@
 #include "rtc.h"
 #include "system_call.h"
 
-rtc_info_t rtc_info[3] = {
-    {.enabled = 0, .current = 0, .rate = MAX_FREQUENCY / MIN_FREQUENCY},
-    {.enabled = 0, .current = 0, .rate = MAX_FREQUENCY / MIN_FREQUENCY},
-    {.enabled = 0, .current = 0, .rate = MAX_FREQUENCY / MIN_FREQUENCY},
-};
-
 /*
 * rtc_init
 *   DESCRIPTION: Initialize the RTC
@@ -40,7 +34,7 @@ void rtc_handler(){
     
     int i;
     pcb_t *pcb;
-    for (i = 3, pcb = GET_PCB(i); i < 6; ++i, pcb = GET_PCB(i)) {
+    for (i = 0, pcb = GET_PCB(i); i < MAX_TASKS; ++i, pcb = GET_PCB(i)) {
         /* begin if the process exists AND the process has an RTC AND the rtc has not been triggered */
         if (pcb->present && pcb->rtc && !pcb->rtc_det) {
             if (pcb->rtc_curr <= 1) {
@@ -85,7 +79,7 @@ int32_t rtc_set_rate(int32_t rate){
  * SIDE EFFECTS: If another rtc is already open, this would reset the frequency
  */
 int32_t rtc_open(const uint8_t* filename){
-    pcb_t *pcb = current_pcb();
+    pcb_t *pcb = current_process();     /* the fd is the process's, so is the rtc state */
     pcb->rtc = 1;       /* set the flag  */
     pcb->rtc_curr = pcb->rtc_rate = MAX_FREQUENCY / MIN_FREQUENCY;
     return 0;
@@ -100,7 +94,7 @@ int32_t rtc_open(const uint8_t* filename){
  * SIDE EFFECTS: none
  */
 int32_t rtc_close(int32_t fd){
-    pcb_t *pcb = current_pcb();
+    pcb_t *pcb = current_process();
     pcb->rtc = 0;       /* set the flag back */
     return 0;
 }
@@ -126,7 +120,7 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes){
         return -1;
     }
     
-    pcb_t *pcb = current_pcb();
+    pcb_t *pcb = current_process();
     if (!pcb->rtc) {
         return -1;      /* process doesn't have an rtc */
     }
@@ -146,7 +140,7 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes){
  * SIDE EFFECTS: none
  */
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes){
-    pcb_t *pcb = current_pcb();
+    pcb_t *pcb = current_process();
     if (!pcb->rtc) {
         return -1;  /* doesn't own */
     }
@@ -0,0 +1,157 @@
+#include "shm.h"
+#include "system_call.h"
+
+static shm_segment_t segments[SHM_MAX_SEGMENTS];
+
+/*
+* shm_lookup
+*   DESCRIPTION: Finds a segment by its key
+*   INPUTS: key - the name the programs agreed on
+*   OUTPUTS: none
+*   RETURN VALUE: the segment, or NULL
+*   SIDE EFFECTS: none
+*/
+static shm_segment_t* shm_lookup(int32_t key){
+    int32_t i;
+    for(i = 0; i < SHM_MAX_SEGMENTS; i++){
+        if(segments[i].key == key){
+            return &segments[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+* shm_release
+*   DESCRIPTION: Frees a segment's frames and its slot
+*   INPUTS: seg - a segment nobody is attached to
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+static void shm_release(shm_segment_t* seg){
+    uint32_t i;
+    for(i = 0; i < seg->pages; i++){
+        frame_free(seg->frames[i]);
+    }
+    seg->key = 0;
+    seg->pages = 0;
+}
+
+/*
+* shm_segment_create
+*   DESCRIPTION: Makes a segment of zeroed frames from the user pool. It
+*                exists until the last process attached to it exits, or
+*                for good if nobody ever attaches
+*   INPUTS: key - a nonzero name, size - bytes, up to SHM_SEGMENT_SIZE
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if it was made or already exists at least this big,
+*                 -1 otherwise or if the pool or the slots ran out
+*   SIDE EFFECTS: none
+*/
+int32_t shm_segment_create(int32_t key, uint32_t size){
+    uint32_t pages = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    shm_segment_t* seg;
+    uint32_t flags, frame;
+    int32_t result = 0;
+
+    if(key == 0 || size == 0 || size > SHM_SEGMENT_SIZE){
+        return -1;
+    }
+    cli_and_save(flags);
+    if((seg = shm_lookup(key)) != NULL){
+        result = seg->pages >= pages ? 0 : -1;
+    }else if((seg = shm_lookup(0)) == NULL){
+        result = -1;
+    }else{
+        seg->key = key;
+        seg->pids = 0;
+        for(seg->pages = 0; seg->pages < pages; seg->pages++){
+            if((frame = frame_alloc()) == 0){
+                shm_release(seg);
+                result = -1;
+                break;
+            }
+            frame_clear(frame);
+            seg->frames[seg->pages] = frame;
+        }
+    }
+    restore_flags(flags);
+    return result;
+}
+
+/*
+* shm_segment_attach
+*   DESCRIPTION: Maps a segment into a process at its fixed place in the
+*                shared memory window, the same address in every process,
+*                so pointers into it can be shared too
+*   INPUTS: pid - the process, key - the segment
+*   OUTPUTS: none
+*   RETURN VALUE: the address of the segment, -1 if there is none or a
+*                 page of it cannot be shared once more
+*   SIDE EFFECTS: none
+*/
+int32_t shm_segment_attach(uint32_t pid, int32_t key){
+    shm_segment_t* seg;
+    uint32_t flags, addr, i;
+
+    if(key == 0){
+        return -1;
+    }
+    cli_and_save(flags);
+    if((seg = shm_lookup(key)) == NULL){
+        restore_flags(flags);
+        return -1;
+    }
+    addr = SHM_ADDR + (seg - segments) * SHM_SEGMENT_SIZE;
+    if(!(seg->pids & (1 << pid))){
+        for(i = 0; i < seg->pages; i++){
+            if(user_shm_map(pid, addr + (i << PAGE_SHIFT), seg->frames[i]) == -1){
+                restore_flags(flags);
+                return -1;              /* the pages mapped so far go with the process */
+            }
+        }
+        seg->pids |= 1 << pid;
+    }
+    restore_flags(flags);
+    return addr;
+}
+
+/*
+* shm_fork
+*   DESCRIPTION: Records a forked child as attached wherever its parent
+*                is; the child's window is already a copy of the parent's
+*   INPUTS: parent - the forking process, child - its child
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+void shm_fork(uint32_t parent, uint32_t child){
+    int32_t i;
+    for(i = 0; i < SHM_MAX_SEGMENTS; i++){
+        if(segments[i].key && (segments[i].pids & (1 << parent))){
+            segments[i].pids |= 1 << child;
+        }
+    }
+}
+
+/*
+* shm_exit
+*   DESCRIPTION: Detaches a process from every segment, freeing the ones
+*                it was the last process attached to
+*   INPUTS: pid - the process, its window already unmapped
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+void shm_exit(uint32_t pid){
+    int32_t i;
+    for(i = 0; i < SHM_MAX_SEGMENTS; i++){
+        if(segments[i].key && (segments[i].pids & (1 << pid))){
+            segments[i].pids &= ~(1 << pid);
+            if(!segments[i].pids){
+                shm_release(&segments[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "types.h"
+#include "lib.h"
+
+#define SHM_MAX_SEGMENTS 8                      /* segments that can exist at once */
+#define SHM_SEGMENT_PAGES 128                   /* 512KB, the window holds every segment */
+#define SHM_SEGMENT_SIZE (SHM_SEGMENT_PAGES * 4096)
+
+typedef struct {
+    int32_t key;                                /* 0 while the slot is free */
+    uint32_t pages;                             /* size, rounded up to pages */
+    uint32_t pids;                              /* attached processes, one bit per pid */
+    uint32_t frames[SHM_SEGMENT_PAGES];         /* the segment holds a reference on each */
+} shm_segment_t;
+
+/* makes a zeroed segment of size bytes named key, 0 if it exists already and is big enough */
+int32_t shm_segment_create(int32_t key, uint32_t size);
+
+/* maps segment key in process pid, returns the address it is at or -1 */
+int32_t shm_segment_attach(uint32_t pid, int32_t key);
+
+/* a forked child is attached to whatever its parent is */
+void shm_fork(uint32_t parent, uint32_t child);
+
+/* detaches pid from every segment, the window is already unmapped */
+void shm_exit(uint32_t pid);
+
+#endif
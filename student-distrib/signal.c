@@ -0,0 +1,155 @@
+#include "signal.h"
+#include "system_call.h"
+
+#define SIGNAL_USER_EFLAGS 0xCD5                /* CF PF AF ZF SF DF OF, what a handler may change */
+
+extern uint8_t exception_occurred;
+
+/* movl $10, %eax; int $0x80 -- system call 10 is sigreturn */
+static const uint8_t trampoline[SIGNAL_TRAMPOLINE_SIZE] = {0xB8, 0x0A, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x90};
+
+/*
+* signal_user_range
+*   DESCRIPTION: Checks that [start, end) lies in the user program's 4MB
+*                page or in the shared memory window, where a stack can be
+*   INPUTS: start, end - the range
+*   OUTPUTS: none
+*   RETURN VALUE: 1 if it does, 0 otherwise
+*   SIDE EFFECTS: none
+*/
+static int32_t signal_user_range(uint32_t start, uint32_t end){
+    if(start >= end || (start >> 22) != ((end - 1) >> 22)){
+        return 0;
+    }
+    return (start >> 22) == USER_ENTRY || (start >> 22) == SHM_ENTRY;
+}
+
+/*
+* signal_send
+*   DESCRIPTION: Raises a signal on a pid when its process has installed
+*                a handler for it; it runs the next time that pid
+*                returns to user mode
+*   INPUTS: pid - the thread to interrupt
+*           signum - SIG_*
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if it is pending, -1 if there is no such pid or no
+*                 handler, the caller then applies the default action
+*   SIDE EFFECTS: none
+*/
+int32_t signal_send(int32_t pid, uint32_t signum){
+    pcb_t* pcb;
+
+    if(pid < 0 || pid >= MAX_TASKS || signum >= NUM_SIGNALS){
+        return -1;
+    }
+    pcb = GET_PCB(pid);
+    if(!pcb->present || pcb->leader->sig_handler[signum] == NULL){
+        return -1;
+    }
+    pcb->sig_pending |= 1 << signum;
+    return 0;
+}
+
+/*
+* signal_deliver
+*   DESCRIPTION: Called by the linkage on every return to user mode.
+*                Takes the lowest pending signal and, if the process has
+*                a handler, moves the interrupted context onto the user
+*                stack and returns into the handler instead:
+*                   esp -> return address, the trampoline below
+*                          signum
+*                          the saved syscall_frame_t
+*                          the trampoline code, calls sigreturn
+*                Without a handler DIV_ZERO, SEGFAULT and INTERRUPT halt
+*                the thread and ALARM and USER1 are dropped
+*   INPUTS: frame - the context about to be restored by iret
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: may halt; masks signals until sigreturn
+*/
+void signal_deliver(struct syscall_frame* frame){
+    pcb_t* pcb = current_pcb();
+    uint32_t signum, esp;
+    uint32_t* stack;
+    void* handler;
+
+    while(!pcb->sig_masked && pcb->sig_pending){
+        for(signum = 0; !(pcb->sig_pending & (1 << signum)); signum++);
+        pcb->sig_pending &= ~(1 << signum);
+        handler = current_process()->sig_handler[signum];
+
+        esp = frame->esp - SIGNAL_TRAMPOLINE_SIZE - sizeof(syscall_frame_t) - 2 * sizeof(uint32_t);
+        if(handler == NULL || !signal_user_range(esp, frame->esp)){
+            if(signum == SIG_ALARM || signum == SIG_USER1){
+                continue;
+            }
+            exception_occurred = (signum != SIG_INTERRUPT);
+            halt(signum == SIG_INTERRUPT ? 128 : 255);
+        }
+
+        stack = (uint32_t*)esp;
+        memcpy((uint8_t*)frame->esp - SIGNAL_TRAMPOLINE_SIZE, trampoline, SIGNAL_TRAMPOLINE_SIZE);
+        memcpy(&stack[2], frame, sizeof(syscall_frame_t));
+        stack[1] = signum;
+        stack[0] = frame->esp - SIGNAL_TRAMPOLINE_SIZE;
+        frame->esp = esp;
+        frame->eip = (uint32_t)handler;
+        pcb->sig_masked = 1;
+    }
+}
+
+/*
+* signal_return
+*   DESCRIPTION: Undoes signal_deliver once the handler returned into the
+*                trampoline: restores the registers saved on the user
+*                stack, which the handler may have changed, except that
+*                the segments and privileged flags stay the user's
+*   INPUTS: frame - the sigreturn system call's frame
+*   OUTPUTS: none
+*   RETURN VALUE: the restored eax, system_call stores it back, or -1 if
+*                 the saved context is not on the user stack
+*   SIDE EFFECTS: unmasks signals
+*/
+int32_t signal_return(struct syscall_frame* frame){
+    pcb_t* pcb = current_pcb();
+    syscall_frame_t saved;
+    uint32_t context = frame->esp + sizeof(uint32_t);     /* the handler's ret popped the return address */
+
+    if(!pcb->sig_masked || !signal_user_range(context, context + sizeof(syscall_frame_t))){
+        return -1;
+    }
+    memcpy(&saved, (void*)context, sizeof(syscall_frame_t));
+    saved.ds = saved.es = saved.fs = USER_DS;
+    saved.pad_ds = saved.pad_es = saved.pad_fs = 0;
+    saved.cs = USER_CS;
+    saved.ss = USER_DS;
+    saved.eflags = USER_EFLAGS | (saved.eflags & SIGNAL_USER_EFLAGS);
+    memcpy(frame, &saved, sizeof(syscall_frame_t));
+    pcb->sig_masked = 0;
+    return saved.eax;
+}
+
+/*
+* signal_tick
+*   DESCRIPTION: Counts down every process's ALARM interval and raises
+*                ALARM on its main thread when it runs out
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: called from the PIT interrupt
+*/
+void signal_tick(){
+    int32_t pid;
+    pcb_t* pcb;
+
+    for(pid = 0; pid < MAX_TASKS; pid++){
+        pcb = GET_PCB(pid);
+        if(!pcb->present || pcb->leader != pcb || !pcb->alarm_ticks){
+            continue;
+        }
+        if(--pcb->alarm_left == 0){
+            pcb->alarm_left = pcb->alarm_ticks;
+            signal_send(pid, SIG_ALARM);
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef _SIGNAL_H
+#define _SIGNAL_H
+
+#include "types.h"
+#include "lib.h"
+
+/* the signal numbers, as in the user library's enum signums */
+#define SIG_DIV_ZERO 0
+#define SIG_SEGFAULT 1
+#define SIG_INTERRUPT 2
+#define SIG_ALARM 3
+#define SIG_USER1 4
+#define NUM_SIGNALS 5
+
+#define SIGNAL_TICK_HZ 391                      /* PIT ticks per second, pit_init(391) */
+#define ALARM_DEFAULT_MS 10000                  /* every process gets ALARM this often until it calls alarm */
+#define ALARM_MAX_MS 10000000                   /* ms * SIGNAL_TICK_HZ still fits 32 bits */
+#define SIGNAL_TRAMPOLINE_SIZE 8                /* movl $SYS_SIGRETURN, %eax; int $0x80; nop */
+
+struct syscall_frame;
+
+/* marks a signal pending on a pid if its process has a handler for it,
+ * -1 if it has none and the caller applies the default action */
+int32_t signal_send(int32_t pid, uint32_t signum);
+
+/* on the way back to user mode: runs the handler of a pending signal or
+ * applies its default action; called with interrupts off */
+void signal_deliver(struct syscall_frame* frame);
+
+/* restores the context a handler interrupted, the body of sigreturn */
+int32_t signal_return(struct syscall_frame* frame);
+
+/* called on every PIT tick, counts the processes' ALARM intervals down */
+void signal_tick();
+
+#endif
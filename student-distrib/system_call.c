@@ -1,10 +1,16 @@
 #include "system_call.h"
 #include "lib.h"
+#include "vfs.h"
+#include "pit.h"
+#include "common_asm_link.h"
 
 /* nonzero if exception occurs. */
 extern uint8_t exception_occurred;
 
-extern pte_t page_table_user_vidmem[PAGE_TABLE_COUNT];
+static void task_orphan(pcb_t* pcb);
+static void task_vanish();
+static void task_start(pcb_t* pcb);
+static void task_entry(pcb_t* pcb, uint32_t eip, uint32_t esp);
 
 /**
  * int32_t halt(uint8_t status):
@@ -15,93 +21,183 @@ extern pte_t page_table_user_vidmem[PAGE_TABLE_COUNT];
  * RETURNS: never used
  */
 int32_t halt(uint8_t status){
-    cli();
     int i;
     pcb_t* pcb = current_pcb();
-    
+
+    if (pcb->leader != pcb) {   /* a thread ends alone, whoever joins it gets the status */
+        cli();
+        pcb->present = 0;
+        pcb->exit_status = exception_occurred ? 256 : status;
+        pcb->zombie = 1;
+        exception_occurred = 0;
+        task_orphan(pcb);
+        wake_up(&pcb->leader->exitq);       /* any other thread may be in thread_join */
+        task_vanish();
+    }
+
+    /* interrupts stay on while the resources go, but nothing else runs
+     * until the handoff below; it stays present so that closing an fd
+     * may still sleep */
+    preempt_disable();
+
     /* **************************************************
      * *            Reclaims Owned Resources            *
      * **************************************************/
-    pcb->present = 0;
     pcb->vidmap = 0;
     pcb->rtc = 0;
     get_terminal(*get_active_terminal())->halt = 0;
 
     for (i = 0; i < MAX_FILES; ++i) {
+        if (pcb->fd[i].flags)
+            pcb->fd[i].file_ops->close(i);  /* lets tmpfs and pipes drop their references */
         pcb->fd[i].flags = 0;
     }
 
-    if (pcb->pid < 3) { /* if exit the shell, recreate it ^-^ */
+    /* the other threads go with the address space, done or not */
+    for (i = 0; i < MAX_TASKS; ++i) {
+        if (GET_PCB(i) != pcb && GET_PCB(i)->leader == pcb && (GET_PCB(i)->present || GET_PCB(i)->zombie)) {
+            GET_PCB(i)->present = 0;
+            GET_PCB(i)->zombie = 0;
+            sleep_cancel(i);        /* it may have been preempted in a system call, asleep */
+            futex_exit(i);
+            task_orphan(GET_PCB(i));
+        }
+    }
+
+    /* frees the image, the parent's pages stay mapped in its own table */
+    paging_stats.last_faults = pcb->page_faults;
+    user_space_reset(pcb->pid);
+
+    task_orphan(pcb);
+
+    cli();
+    pcb->present = 0;
+
+    if (pcb->async) {   /* nobody waits in execute, the parent collects the status with waitpid */
+        if (pcb->parent) {
+            pcb->exit_status = exception_occurred ? 256 : status;
+            pcb->zombie = 1;
+            wake_up(&pcb->parent->exitq);
+        }
+        exception_occurred = 0;
+        task_vanish();
+    }
+
+    if (pcb->parent == NULL) { /* if exit the shell, recreate it ^-^ */
         pcb->present = 0;
+        get_terminal(pcb->terminal)->pid = -1;  /* the new shell is the console's first process again */
         execute((uint8_t*)"shell");
         return 0;
     }
-    
-    get_terminal(*get_current_terminal())->pid = current_pcb()->parent->pid;
+
+    pcb->parent->waiting = 0;
+
+    if (get_terminal(*get_current_terminal())->pid == pcb->pid)
+        get_terminal(*get_current_terminal())->pid = pcb->parent->pid;    /* the console goes back only if this had it */
 
     /* **************************************************
      * *          Restore Parent Paging & TSS           *
      * **************************************************/
-    page_directory[USER_ENTRY].MB.page_base_address = 2 + pcb->parent->pid; /* shell */
+    user_space_switch(pcb->parent->leader->pid);    /* shell */
     tss.esp0 = pcb->parent->esp0;
     tss.ss0 = KERNEL_DS;
 
-    asm volatile (
-        "movl %%cr3, %%eax\n"   /* flushes the tlb*/
-        "movl %%eax, %%cr3\n"
-        :
-        :
-        : "%eax"
-    );
+    /* the parent resumes in execute, which returns the status */
+    pcb->exit_status = exception_occurred ? 256 : status;
+    exception_occurred = 0;
+    switch_to(&pcb->ksp, &pcb->parent->ksp);
 
-    if (exception_occurred) {
-        asm volatile(           /* exception occurred, %eax = 0x100 */
-            "movl $0x100, %%eax\n"
-            "movl %0, %%ebp\n"      /* restores the ebp */
-            :
-            : "r"(pcb->eebp)
-            : "%eax", "%ebp"
-        );
-        exception_occurred = 0;
-    } else {
-        asm volatile(
-            "movl $0, %%eax\n"
-            "movb %b0, %%al\n"
-            "movl %1, %%ebp\n"      /* restores the ebp */
-            :
-            : "r"(status), "r"(pcb->eebp)
-            : "%eax", "%ebp"
-        );
-    }
+    return -1;                  /* never reaches here */
+}
 
-    asm volatile(               /* we are logically in remaining part of */
-        "sti\n"
-        "leave\n"               /* execute handler, because we reset ebp */
-        "ret\n"                 /* we return to execute actually.        */
-    );
+/**
+ * void fd_dup(file_descriptor_t* fd):
+ * DESCRIPTION: takes the references an fd copied from another one
+ *              holds, so that each copy is closed on its own
+ * INPUTS: fd -- the copy, open
+ * OUTPUTS: none
+ * RETURN: none
+ */
+static void fd_dup(file_descriptor_t* fd){
+    if (fd->sb == &tmpfs_super)
+        tmpfs_dup(fd->inode);
+    else
+        pipe_dup(fd);               /* nothing to take for the other kinds */
+}
 
-    return -1;                  /* never reaches here */
+/**
+ * void task_orphan(pcb_t* pcb):
+ * DESCRIPTION: forgets the children a halting thread made with fork,
+ *              spawn or thread_create, nobody collects them any more
+ * INPUTS: pcb -- the thread
+ * OUTPUTS: none
+ * RETURN: none
+ */
+static void task_orphan(pcb_t* pcb){
+    int i;
+    for (i = 0; i < MAX_TASKS; ++i) {
+        if (GET_PCB(i)->async && GET_PCB(i)->parent == pcb) {
+            GET_PCB(i)->parent = NULL;
+            if (GET_PCB(i)->leader != GET_PCB(i))
+                continue;           /* a thread stays until its process halts or someone joins it */
+            GET_PCB(i)->zombie = 0;
+        }
+    }
 }
 
 /**
- * int32_t execute(const uint8_t* command):
- * DESCRIPTION: executes a program specified by \p command
- *              followed by arguments (not required) after
- *              the program name in \p command
- * INPUTS: command -- a null-terminated string stored the
- *                    program name and the arguments
+ * void task_vanish():
+ * DESCRIPTION: leaves a halted task nobody switches back to, its pcb
+ *              no longer present; while nothing else is runnable,
+ *              schedule returns and this idles with interrupts on
+ *              until something is, so halt never falls through
+ * INPUTS: none
  * OUTPUTS: none
- * RETURN: 0 if created successfully, 1 otherwise
+ * RETURN: never
  */
-int32_t execute(const uint8_t* command){
-    cli();
-    int i, pid;
+static void task_vanish(){
+    while (1) {
+        schedule();
+        asm volatile ("sti; hlt; cli" ::: "memory");
+    }
+}
+
+/**
+ * int32_t task_alloc():
+ * DESCRIPTION: finds a pid for a new process; a child that halted
+ *              keeps its pid until its parent collects the status
+ * INPUTS: none
+ * OUTPUTS: none
+ * RETURN: the pid, or -1 if every one is taken
+ */
+static int32_t task_alloc(){
+    int32_t pid;
+    for (pid = 0; pid < MAX_TASKS; pid++)
+        if (!GET_PCB(pid)->present && !GET_PCB(pid)->zombie)
+            return pid;
+    return -1;
+}
+
+/**
+ * int32_t task_create(int32_t pid, const uint8_t* command, pcb_t* parent, uint32_t* eip):
+ * DESCRIPTION: parses \p command and sets up process \p pid to run
+ *              it on the current terminal: an empty user region the
+ *              image loads into on demand, stdin/stdout and the
+ *              arguments; the pcb is not present yet
+ * INPUTS: pid -- from task_alloc
+ *         command -- the program name followed by the arguments
+ *         parent -- the creating process, NULL for a console's shell
+ * OUTPUTS: eip -- the program's entry point
+ * RETURN: 0 if created successfully, -1 if it is not a program
+ */
+static int32_t task_create(int32_t pid, const uint8_t* command, pcb_t* parent, uint32_t* eip){
+    uint64_t start_tsc = rdtsc();   /* for the exec to first instruction latency */
+    int i;
     uint8_t filename[READBUF_SIZE] = {0};   /* file name */
     uint8_t args[READBUF_SIZE] = {0};       /* arguments */
-    dentry_t exec_dentry;           /* location of file name */
+    vfs_inode_t exec_inode;         /* the program file */
     uint32_t magic_check;           /* exec format check */
     uint8_t entry[4];               /* instruction ptr */
-    uint32_t eip;
     pcb_t* pcb;
 
     /* **************************************************
@@ -148,101 +244,272 @@ int32_t execute(const uint8_t* command){
      *   - size of the file
      *   - magic header of executable
      */
-    if (read_dentry_by_name(filename, &exec_dentry) == -1
-        || read_data(exec_dentry.inode_num, 0, (uint8_t*)&magic_check, MAGIC_SIZE) == -1
+    if (vfs_lookup(filename, &exec_inode) == -1
+        || exec_inode.sb != &filesys_super || exec_inode.type != 2   /* programs come from the boot image */
+        || read_data(exec_inode.ino, 0, (uint8_t*)&magic_check, MAGIC_SIZE) == -1
         || magic_check != MAGIC_NUM)
         return -1;
 
-    /* gets the index of the new process */
-    for (pid = 0; pid < MAX_TASKS; pid++)
-        if (!(GET_PCB(pid)->present))
-            break;
-
-    if (pid == MAX_TASKS) {/* cannot handle it */
-        printf("TOO MUCH PROCESSES!\n");
-        return 0;
-    }
-
-
     /* **************************************************
      * *                  Setup Paging                  *
      * **************************************************/
-    page_directory[USER_ENTRY].MB.present = 1;              /* 128MB -> user program */
-    page_directory[USER_ENTRY].MB.user_supervisor = 1;      /* user can access */
-    page_directory[USER_ENTRY].MB.read_write = 1;           /* allows user to write (-_-|||) */
-    page_directory[USER_ENTRY].MB.page_base_address = 2 + pid; /* physical address: 0x400000 & 0x800000 */
-
-    asm volatile (                  /* rewrite cr3 (pde[]) to empty tlb */
-        "movl %%cr3, %%eax\n"
-        "movl %%eax, %%cr3\n"
-        :
-        :
-        : "%eax"
-    );
-
-    /* **************************************************
-     * *             Load File into Memory              *
-     * **************************************************/
-    /* loads the program image */
-    read_data(exec_dentry.inode_num, 0, (uint8_t*)PROGRAM_IMAGE_ADDR, PROGRAM_IMAGE_LIMIT);
+    /* the process's own directory, 128MB -> its page table with every
+     * page not present; the image is loaded by page faults as the
+     * program touches it */
+    user_space_reset(pid);
 
     /* **************************************************
      * *              Create PCB & File OP              *
      * **************************************************/
     /* creates the pcb */
     pcb = GET_PCB(pid);
-    pcb->parent = (pid > 2) ? current_pcb() : NULL;
-    pcb->present = 1;
+    pcb->parent = parent;
     pcb->pid = pid;
+    pcb->leader = pcb;
+    pcb->terminal = *get_current_terminal();
+    pcb->exec_inode = exec_inode.ino;
+    pcb->page_faults = 0;
+    pcb->exec_tsc = start_tsc;
+    pcb->waiting = 0;
+    pcb->sleeping = 0;
+    pcb->async = 0;
+    pcb->zombie = 0;
+    pcb->vidmap = 0;
+    pcb->rtc = 0;
+    pcb->sig_pending = 0;
+    pcb->preempt_count = 0;
+    pcb->exitq.pids = 0;
+    pcb->waitq = NULL;
+    pcb->sig_masked = 0;
+    memset(pcb->sig_handler, 0, sizeof(pcb->sig_handler));
+    pcb->alarm_ticks = pcb->alarm_left = ALARM_DEFAULT_MS / 1000 * SIGNAL_TICK_HZ;
+    pcb->esp0 = KSTACK_START - KSTACK_SIZE * pid;
+    paging_stats.launches++;
     
-    /* setup stdin and stdout*/
-    pcb->fd[0].file_ops = (file_operations_t*)&stdin_op;
-    pcb->fd[0].flags = 1;
-    pcb->fd[1].file_ops = (file_operations_t*)&stdout_op;
-    pcb->fd[1].flags = 1;
+    /* setup stdin and stdout, inherited so that a shell can redirect them */
+    if (parent) {
+        for (i = 0; i < 2; i++) {
+            pcb->fd[i] = parent->leader->fd[i];
+            if (pcb->fd[i].flags)
+                fd_dup(&pcb->fd[i]);
+        }
+    } else {
+        pcb->fd[0].file_ops = (file_operations_t*)&stdin_op;
+        pcb->fd[0].sb = NULL;
+        pcb->fd[0].flags = 1;
+        pcb->fd[1].file_ops = (file_operations_t*)&stdout_op;
+        pcb->fd[1].sb = NULL;
+        pcb->fd[1].flags = 1;
+    }
 
     /* setup remaining fileop */
-    for (i = 2; i < MAX_FILES; i++)
+    for (i = 2; i < MAX_FILES; i++) {
         pcb->fd[i].file_ops = (file_operations_t*)&null_op;
+        pcb->fd[i].flags = 0;
+    }
 
     memcpy(pcb->args, args, READBUF_SIZE); /* assign pcb->args */
     
-    read_data(exec_dentry.inode_num, 24, (uint8_t*)entry, 4);
-    eip = (((uint32_t)entry[3] << 24) | ((uint32_t)entry[2] << 16) | ((uint32_t)entry[1] << 8) | ((uint32_t)entry[0]));
+    read_data(exec_inode.ino, 24, (uint8_t*)entry, 4);
+    *eip = (((uint32_t)entry[3] << 24) | ((uint32_t)entry[2] << 16) | ((uint32_t)entry[1] << 8) | ((uint32_t)entry[0]));
+    return 0;
+}
 
-    tss.esp0 = KSTACK_START - KSTACK_SIZE * pid;
-    tss.ss0 = KERNEL_DS;
+/**
+ * int32_t execute(const uint8_t* command):
+ * DESCRIPTION: executes a program specified by \p command
+ *              followed by arguments (not required) after
+ *              the program name in \p command
+ * INPUTS: command -- a null-terminated string stored the
+ *                    program name and the arguments
+ * OUTPUTS: none
+ * RETURN: the status the program passed to halt, 256 if it died by an
+ *         exception, -1 if it could not start or the caller is not a
+ *         process's main thread, whose halt would kill it under the
+ *         child that returns to it; a console's first
+ *         process has no caller to return to, its execute returns 0
+ *         only when the process that called it is scheduled again
+ */
+int32_t execute(const uint8_t* command){
+    int32_t pid;
+    uint32_t eip, discard;
+    uint32_t* prev;
+    pcb_t* pcb;
+    pcb_t* self = current_pcb();
+    pcb_t* parent = (get_terminal(*get_current_terminal())->pid == -1) ? NULL : current_pcb();  /* a console's first process is its shell */
+
+    if (parent && current_process() != parent)
+        return -1;                  /* threads spawn or fork instead */
+
+    /* where switch_to keeps the caller: the parent, a process preempted
+     * to start a console's shell, or nowhere for a halted one or boot */
+    prev = parent ? &parent->ksp : self->present ? &self->ksp : &discard;
 
-    get_terminal(*get_current_terminal())->pid = pid;
+    /* loading the program runs with interrupts on, only the handoff to
+     * it below disables them; a halted process or boot keeps them off,
+     * its pcb may become the child's before the child can run */
+    if (prev == &discard)
+        cli();
+    preempt_disable();
+
+    /* gets the index of the new process */
+    if ((pid = task_alloc()) == -1) {/* cannot handle it */
+        printf("TOO MUCH PROCESSES!\n");
+        preempt_enable();
+        return 0;
+    }
+    if (task_create(pid, command, parent, &eip) == -1) {
+        preempt_enable();
+        return -1;
+    }
+
+    pcb = GET_PCB(pid);
 
-    pcb->esp0 = tss.esp0;
     /* **************************************************
      * *           Prepare for Context Switch           *
      * **************************************************/
-    /* save the current ebp */
-    asm volatile(
-        "movl %%ebp, %0\n"
-        : "=g"(pcb->ebp)
-    );
+    /* without a parent the child may reuse the pid, and so the stack, of
+     * the halted process running this: the frame overwrites the top of
+     * it, which is never returned to */
+    task_entry(pcb, eip, USER_STACK);
 
-    pcb->eebp = pcb->ebp;
-
-    /* Create its own context switch stack */
-    asm volatile (
-        "movw %w0, %%ds\n"
-        "pushl %0\n"      /* USER_DS */
-        "pushl %1\n"      /* USER_STACK */
-        "sti\n"
-        "pushfl\n"        /* eflags */
-        "pushl %2\n"      /* USER_CS */
-        "pushl %3\n"      /* eip */
-        "iret\n"
-        :
-        :"r"((uint32_t)USER_DS), "r"((uint32_t)USER_STACK), "r"((uint32_t)USER_CS), "r"(eip)
-        :"memory"
-    );
+    cli();
+    if (self != pcb)
+        self->preempt_count--;      /* a reused pcb starts over at 0, the caller resumes preemptible */
+    pcb->present = 1;
+    if (parent)
+        parent->waiting = 1;        /* until this child halts */
 
-    return 0;
+    user_space_switch(pid);
+    tss.esp0 = pcb->esp0;
+    tss.ss0 = KERNEL_DS;
+
+    if (!parent || get_terminal(*get_current_terminal())->pid == parent->pid)
+        get_terminal(*get_current_terminal())->pid = pid;   /* a background job's child leaves the console alone */
+
+    switch_to(prev, &pcb->ksp);
+
+    return parent ? pcb->exit_status : 0;
+}
+
+/**
+ * void task_start(pcb_t* pcb):
+ * DESCRIPTION: puts what switch_to restores below the system call frame
+ *              at the top of a kernel stack: zero callee-saved
+ *              registers and child_return as the return address
+ * INPUTS: pcb -- the context, its frame in place
+ * OUTPUTS: none
+ * RETURN: none
+ */
+static void task_start(pcb_t* pcb){
+    uint32_t* stack = (uint32_t*)(pcb->esp0 - sizeof(syscall_frame_t));
+
+    *--stack = (uint32_t)child_return;
+    *--stack = 0;                   /* ebp */
+    *--stack = 0;                   /* ebx */
+    *--stack = 0;                   /* esi */
+    *--stack = 0;                   /* edi */
+    pcb->ksp = (uint32_t)stack;
+}
+
+/**
+ * void task_entry(pcb_t* pcb, uint32_t eip, uint32_t esp):
+ * DESCRIPTION: builds the kernel stack of a context that has never
+ *              run: a system call frame that returns to user mode at
+ *              \p eip, then what switch_to restores
+ * INPUTS: pcb -- the context, its esp0 set
+ *         eip, esp -- where it starts in user mode
+ * OUTPUTS: none
+ * RETURN: none
+ */
+static void task_entry(pcb_t* pcb, uint32_t eip, uint32_t esp){
+    syscall_frame_t* frame = (syscall_frame_t*)(pcb->esp0 - sizeof(syscall_frame_t));
+
+    memset(frame, 0, sizeof(syscall_frame_t));
+    frame->ds = frame->es = frame->fs = USER_DS;
+    frame->eip = eip;
+    frame->cs = USER_CS;
+    frame->eflags = USER_EFLAGS;
+    frame->esp = esp;
+    frame->ss = USER_DS;
+    task_start(pcb);
+}
+
+/**
+ * int32_t spawn(const uint8_t* command):
+ * DESCRIPTION: starts a program like execute, but returns at once;
+ *              the child runs alongside the caller, on its terminal,
+ *              from the first time the scheduler picks it, and the
+ *              caller collects its status with waitpid
+ * INPUTS: command -- the program name followed by the arguments
+ * OUTPUTS: none
+ * RETURN: the child's pid, or -1 if it is not a program or there is
+ *         no free pid
+ */
+int32_t spawn(const uint8_t* command){
+    int32_t pid;
+    uint32_t eip, flags;
+    pcb_t* pcb;
+
+    if (command == NULL)
+        return -1;
+    cli_and_save(flags);
+    if ((pid = task_alloc()) == -1 || task_create(pid, command, current_pcb(), &eip) == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    pcb = GET_PCB(pid);
+    pcb->async = 1;
+    task_entry(pcb, eip, USER_STACK);
+    pcb->present = 1;
+    restore_flags(flags);
+    return pid;
+}
+
+/**
+ * int32_t waitpid(int32_t pid, int32_t* status, int32_t options):
+ * DESCRIPTION: collects a child made by fork or spawn once it halts,
+ *              sleeping until then unless WNOHANG is given
+ * INPUTS: pid -- the child, or -1 for any of them
+ *         options -- WNOHANG to return 0 while the child still runs
+ * OUTPUTS: status -- what the child passed to halt, 256 if it died
+ *                    by an exception; may be NULL
+ * RETURN: the pid collected, 0 for WNOHANG and no child done yet,
+ *         or -1 if there is no such child
+ */
+int32_t waitpid(int32_t pid, int32_t* status, int32_t options){
+    pcb_t* pcb = current_pcb();
+    pcb_t* child;
+    uint32_t flags;
+    int32_t i, found;
+
+    if ((status != NULL && ((uint32_t)status >> 22) != USER_ENTRY) || pid < -1 || pid >= MAX_TASKS)
+        return -1;
+
+    cli_and_save(flags);
+    while (1) {
+        found = 0;
+        for (i = 0; i < MAX_TASKS; i++) {
+            child = GET_PCB(i);
+            if ((pid != -1 && pid != i) || !child->async || child->parent != pcb
+                || child->leader != child || !(child->present || child->zombie))
+                continue;               /* threads are collected by thread_join */
+            if (child->zombie) {
+                child->zombie = 0;              /* the pid is free again */
+                found = child->exit_status;
+                restore_flags(flags);
+                if (status != NULL)
+                    *status = found;
+                return i;
+            }
+            found = 1;
+        }
+        if (!found || (options & WNOHANG)) {
+            restore_flags(flags);
+            return found ? 0 : -1;
+        }
+        sleep_on(&pcb->exitq);                  /* a child's halt wakes us up */
+    }
 }
 
 /**
@@ -256,13 +523,14 @@ int32_t execute(const uint8_t* command){
  * RETURNS: the number of bytes read, or -1 if failed
  */
 int32_t read(int32_t fd, void* buf, int32_t nbytes) {
-    pcb_t* curr_pcb = current_pcb();    /* current pcb for fd array */
-    uint32_t result;
+    pcb_t* curr_pcb = current_process();    /* current pcb for fd array */
+    int32_t result;
     if(fd < 0 || fd >= MAX_FILES || curr_pcb->fd[fd].flags==0) {
         return -1;                      /* the argument is illegal*/
     }
     result = curr_pcb->fd[fd].file_ops->read(fd, buf, nbytes);  /* call the interfance */
-    curr_pcb->fd[fd].file_position += result; 
+    if (result > 0)
+        curr_pcb->fd[fd].file_position += result;
     return result;
 }
 
@@ -277,7 +545,7 @@ int32_t read(int32_t fd, void* buf, int32_t nbytes) {
  * RETURNS: the number of byte wrote, or -1 if failed to write
  */
 int32_t write(int32_t fd, const void* buf, int32_t nbytes){
-    pcb_t* curr_pcb = current_pcb();
+    pcb_t* curr_pcb = current_process();
     if(fd < 0 || fd >= MAX_FILES || curr_pcb->fd[fd].flags==0){
         return -1; /* illegal argument */
     }
@@ -288,37 +556,32 @@ int32_t write(int32_t fd, const void* buf, int32_t nbytes){
  * int32_t open(const uint8_t* filename):
  * DESCRIPTION: opens a files at the given \p filename
  *              open should be called BEFORE any other manipulations
+ *              the path is resolved by the VFS, which also picks the
+ *              interface from the filesystem it lands in
  * INPUTS: filename - the file name
  * OUTPUTS: none
  * RETURN: the file descriptor of the file, or -1 otherwise
  */
 int32_t open(const uint8_t* filename){
     int i;
-    dentry_t dentry;
-    pcb_t* curr_pcb = current_pcb();                    /* the process to open the file */
+    vfs_inode_t inode;
+    pcb_t* curr_pcb = current_process();                    /* the process to open the file */
 
-    if(filename == NULL || read_dentry_by_name(filename, &dentry) == -1) {
+    if(filename == NULL || vfs_lookup(filename, &inode) == -1) {
         return -1;                                      /* the file name is invalid */
     }
 
     for(i=2; i<MAX_FILES; i++){                         /* seeks for a idle fd */
         if( curr_pcb->fd[i].flags == 0){
             curr_pcb->fd[i].flags = 1;                  /* marks it open */
-            curr_pcb->fd[i].inode = dentry.inode_num;
+            curr_pcb->fd[i].sb = inode.sb;
+            curr_pcb->fd[i].inode = inode.ino;
             curr_pcb->fd[i].file_position = 0;          /* marks the position to the beginning */
-            switch(dentry.file_type) {                  /* assigns the corresponding interface */
-                case 0:
-                    curr_pcb->fd[i].file_ops = (file_operations_t*)&rtc_op;
-                    break;
-                case 1:
-                    curr_pcb->fd[i].file_ops = (file_operations_t*)&dir_op;
-                    break;
-                case 2:
-                    curr_pcb->fd[i].file_ops = (file_operations_t*)&file_op;
-                    break;
-                default:
-                    break;
-            }
+            curr_pcb->fd[i].dir_index = 0;
+            curr_pcb->fd[i].ra_window = 0;              /* no read-ahead until reads look sequential */
+            curr_pcb->fd[i].ra_next = 0;
+            curr_pcb->fd[i].ra_end = 0;
+            curr_pcb->fd[i].file_ops = vfs_fops(&inode); /* assigns the corresponding interface */
             if (curr_pcb->fd[i].file_ops->open(filename)) {
                 curr_pcb->fd[i].flags = 0;
                 return 0;
@@ -337,7 +600,7 @@ int32_t open(const uint8_t* filename){
  * RETURN: 0 if closed, or -1 otherwise
  */
 int32_t close(int32_t fd){
-    pcb_t* curr_pcb = current_pcb();
+    pcb_t* curr_pcb = current_process();
     if(fd < 2 || fd >= MAX_FILES || curr_pcb->fd[fd].flags==0) {
         return -1; /* illegal arguments */
     }
@@ -357,7 +620,7 @@ int32_t getargs(uint8_t* buf, int32_t nbytes){
         return -1;
     }
     
-    pcb_t* pcb = current_pcb();
+    pcb_t* pcb = current_process();
     if (!pcb->args[0]) {                /* check if the process has an argument*/
         *buf = 0;
         return -1;
@@ -390,49 +653,338 @@ int32_t vidmap(uint8_t** screen_start) {
         return -1;
     }
 
-    current_pcb()->vidmap = 1;
-    page_table_user_vidmem[VIDEO_MEMORY_PTE].present = 1;
-    if (*get_active_terminal() == *get_current_terminal()) {
-        page_table_user_vidmem[VIDEO_MEMORY_PTE].page_base_address = VIDEO_MEMORY_PTE;
-    } else {
-        page_table_user_vidmem[VIDEO_MEMORY_PTE].page_base_address = VIDEO_MEMORY_PTE + current_pcb()->pid + 2;
-    }
+    current_process()->vidmap = 1;
+    user_vidmap(current_process()->pid, current_process()->terminal);  /* follows terminal switches by itself */
 
     /* assigns page address */
-    *screen_start = (uint8_t*)((VIDEO_MEMORY_PTE << 22) | (VIDEO_MEMORY_PTE << 12));
-
-    asm volatile (
-        "movl %%cr3, %%eax\n"
-        "movl %%eax, %%cr3\n"
-        :
-        :
-        : "%eax"
-    );
+    *screen_start = (uint8_t*)USER_VIDMAP_ADDR;
 
     return 0; /* succeed */
 }
 
 /**
  * int32_t set_handler(int32_t signum, void* handler_address):
- * DESCRIPTION: for cp4
+ * DESCRIPTION: installs the function the process runs when \p signum
+ *              is raised, for all its threads; it is called with the
+ *              signal number and must return to let sigreturn resume
  * INPUTS: signum - the index of the signal
- *         handler_address - the function pointer of the handler
+ *         handler_address - the function pointer of the handler,
+ *                           NULL for the default action
  * OUTPUTS: none
- * RETURN: (pending for cp4)
+ * RETURN: 0 if succeed, -1 for a bad signal or a handler outside the
+ *         program
  */
 int32_t set_handler(int32_t signum, void* handler_address){
-    return -1;
+    if (signum < 0 || signum >= NUM_SIGNALS
+        || (handler_address != NULL && ((uint32_t)handler_address >> 22) != USER_ENTRY))
+        return -1;
+    current_process()->sig_handler[signum] = handler_address;
+    return 0;
 }
 
 /**
  * int32_t sigreturn(void):
- * DESCRIPTION: for cp4
+ * DESCRIPTION: called by the trampoline a signal handler returns into,
+ *              resumes what the signal interrupted
  * INPUTS: none
  * OUTPUTS: none
- * RETURN: (pending for cp4)
+ * RETURN: the interrupted context's eax, -1 outside a handler
  */
 int32_t sigreturn(void){
-    return -1;
+    return signal_return((syscall_frame_t*)(tss.esp0 - sizeof(syscall_frame_t)));
+}
+
+/**
+ * int32_t alarm(int32_t interval_ms):
+ * DESCRIPTION: sets how often the process gets ALARM, counted from now;
+ *              every process starts at ALARM_DEFAULT_MS
+ * INPUTS: interval_ms - the interval, 0 to stop
+ * OUTPUTS: none
+ * RETURN: the previous interval in ms, -1 if negative or over
+ *         ALARM_MAX_MS
+ */
+int32_t alarm(int32_t interval_ms){
+    pcb_t* pcb = current_process();
+    int32_t old = pcb->alarm_ticks * 1000 / SIGNAL_TICK_HZ;
+
+    if (interval_ms < 0 || interval_ms > ALARM_MAX_MS)
+        return -1;
+    pcb->alarm_ticks = ((uint32_t)interval_ms * SIGNAL_TICK_HZ + 999) / 1000;  /* rounds up to a tick */
+    pcb->alarm_left = pcb->alarm_ticks;
+    return old;
+}
+
+/**
+ * int32_t create(const uint8_t* filename):
+ * DESCRIPTION: creates an empty tmpfs file, or truncates it if it
+ *              already exists; writes to it always append
+ * INPUTS: filename - the file name
+ * OUTPUTS: none
+ * RETURN: 0 if succeed, -1 otherwise
+ */
+int32_t create(const uint8_t* filename){
+    return tmpfs_create(filename);
+}
+
+/**
+ * int32_t unlink(const uint8_t* filename):
+ * DESCRIPTION: removes a tmpfs file, open fds keep reading it
+ *              until they are closed
+ * INPUTS: filename - the file name
+ * OUTPUTS: none
+ * RETURN: 0 if succeed, -1 otherwise
+ */
+int32_t unlink(const uint8_t* filename){
+    return tmpfs_unlink(filename);
+}
+
+/**
+ * int32_t fork(void):
+ * DESCRIPTION: creates a child running the same program from the
+ *              same point; the user pages are shared copy-on-write,
+ *              the open files are copied, and the child's kernel
+ *              stack gets a copy of this system call's frame so it
+ *              returns to user mode on its own when scheduled
+ * INPUTS: none
+ * OUTPUTS: none
+ * RETURN: the child's pid in the parent, 0 in the child, -1 if there
+ *         is no free pid
+ */
+int32_t fork(void){
+    pcb_t* parent = current_pcb();
+    pcb_t* process = parent->leader;
+    pcb_t* child;
+    int32_t pid;
+    uint32_t flags;
+    int i;
+
+    cli_and_save(flags);
+    if ((pid = task_alloc()) == -1 || user_space_fork(process->pid, pid, 1) == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    child = GET_PCB(pid);
+    memcpy(child, process, sizeof(pcb_t));    /* a forked thread's child is a process of one thread */
+    child->pid = pid;
+    child->parent = parent;
+    child->leader = child;
+    child->async = 1;
+    child->waiting = 0;
+    child->sleeping = 0;
+    child->zombie = 0;
+    child->page_faults = 0;
+    child->exec_tsc = 0;
+    child->sig_pending = 0;
+    child->preempt_count = 0;
+    child->exitq.pids = 0;
+    child->waitq = NULL;
+    child->sig_masked = parent->sig_masked;     /* it returns on the same user stack, maybe in a handler */
+    for (i = 0; i < MAX_FILES; i++)
+        if (child->fd[i].flags)
+            fd_dup(&child->fd[i]);
+
+    /* the parent's user registers, then what switch_to restores */
+    child->esp0 = KSTACK_START - KSTACK_SIZE * pid;
+    memcpy((void*)(child->esp0 - sizeof(syscall_frame_t)), (void*)(tss.esp0 - sizeof(syscall_frame_t)), sizeof(syscall_frame_t));
+    task_start(child);
+
+    child->present = 1;
+    restore_flags(flags);
+    return pid;
+}
+
+/**
+ * int32_t pipe(int32_t* fds):
+ * DESCRIPTION: creates a pipe and opens both of its ends; reads
+ *              sleep while it is empty and writes while it is full
+ * INPUTS: none
+ * OUTPUTS: fds -- the read end in fds[0], the write end in fds[1]
+ * RETURN: 0 if created, -1 if fds is not in user space or there is
+ *         no free pipe or fd
+ */
+int32_t pipe(int32_t* fds){
+    pcb_t* pcb = current_process();
+    int32_t i, p, ends[2], n = 0;
+
+    if (fds == NULL || ((uint32_t)fds >> 22) != USER_ENTRY || ((uint32_t)(fds + 1) >> 22) != USER_ENTRY)
+        return -1;
+    for (i = 2; i < MAX_FILES && n < 2; i++)
+        if (!pcb->fd[i].flags)
+            ends[n++] = i;
+    if (n < 2 || (p = pipe_create()) == -1)
+        return -1;
+
+    for (i = 0; i < 2; i++) {
+        pcb->fd[ends[i]].file_ops = (file_operations_t*)(i ? &pipe_write_op : &pipe_read_op);
+        pcb->fd[ends[i]].sb = NULL;
+        pcb->fd[ends[i]].inode = p;
+        pcb->fd[ends[i]].file_position = 0;
+        pcb->fd[ends[i]].flags = 1;
+        fds[i] = ends[i];
+    }
+    return 0;
+}
+
+/**
+ * int32_t dup2(int32_t oldfd, int32_t newfd):
+ * DESCRIPTION: makes \p newfd refer to the same open file as \p oldfd,
+ *              closing what \p newfd had open first; stdin and stdout
+ *              can be replaced this way, and are what a new process
+ *              inherits
+ * INPUTS: oldfd -- an open fd
+ *         newfd -- the fd to replace
+ * OUTPUTS: none
+ * RETURN: newfd, or -1 if either fd is invalid
+ */
+int32_t dup2(int32_t oldfd, int32_t newfd){
+    pcb_t* pcb = current_process();
+
+    if (oldfd < 0 || oldfd >= MAX_FILES || newfd < 0 || newfd >= MAX_FILES || !pcb->fd[oldfd].flags)
+        return -1;
+    if (oldfd == newfd)
+        return newfd;
+    if (pcb->fd[newfd].flags) {
+        pcb->fd[newfd].flags = 0;
+        pcb->fd[newfd].file_ops->close(newfd);
+    }
+    pcb->fd[newfd] = pcb->fd[oldfd];
+    fd_dup(&pcb->fd[newfd]);
+    return newfd;
+}
+
+/**
+ * int32_t isatty(int32_t fd):
+ * DESCRIPTION: tells whether \p fd is the terminal, so that a program
+ *              can read a pipe on its stdin instead of its usual input
+ * INPUTS: fd -- an open fd
+ * OUTPUTS: none
+ * RETURN: 1 if it is the terminal, 0 if not, -1 if it is not open
+ */
+int32_t isatty(int32_t fd){
+    pcb_t* pcb = current_process();
+
+    if (fd < 0 || fd >= MAX_FILES || !pcb->fd[fd].flags)
+        return -1;
+    return pcb->fd[fd].file_ops->close == terminal_close;
+}
+
+/**
+ * int32_t shm_create(int32_t key, uint32_t size):
+ * DESCRIPTION: makes a shared memory segment that processes attach by
+ *              its key; it lasts until the last one attached exits
+ * INPUTS: key -- a nonzero name the programs agree on
+ *         size -- bytes, up to SHM_SEGMENT_SIZE
+ * OUTPUTS: none
+ * RETURN: 0 if it exists now, -1 otherwise
+ */
+int32_t shm_create(int32_t key, uint32_t size){
+    return shm_segment_create(key, size);
+}
+
+/**
+ * int32_t shm_attach(int32_t key):
+ * DESCRIPTION: maps a shared memory segment into the process, at the
+ *              same address in every process that attaches it
+ * INPUTS: key -- the segment
+ * OUTPUTS: none
+ * RETURN: the address of the segment, or -1 if there is none
+ */
+int32_t shm_attach(int32_t key){
+    return shm_segment_attach(current_process()->pid, key);
+}
+
+/**
+ * int32_t thread_create(void* entry, void* stack):
+ * DESCRIPTION: starts another thread of the calling process at \p entry
+ *              with its stack pointer at \p stack; it shares the
+ *              address space and the fds, has a kernel stack of its
+ *              own and is scheduled like any process. The user library
+ *              puts the function and its argument on the stack
+ * INPUTS: entry -- a user address to start at
+ *         stack -- the top of the thread's user stack
+ * OUTPUTS: none
+ * RETURN: the thread's id, a pid, or -1 if there is no free pid or
+ *         the addresses are not user memory
+ */
+int32_t thread_create(void* entry, void* stack){
+    pcb_t* creator = current_pcb();
+    pcb_t* pcb;
+    int32_t pid, i;
+    uint32_t flags;
+
+    if (((uint32_t)entry >> 22) != USER_ENTRY
+        || (((uint32_t)stack - 1) >> 22 != USER_ENTRY && ((uint32_t)stack - 1) >> 22 != SHM_ENTRY))
+        return -1;
+    cli_and_save(flags);
+    if ((pid = task_alloc()) == -1) {
+        restore_flags(flags);
+        return -1;
+    }
+    pcb = GET_PCB(pid);
+    pcb->pid = pid;
+    pcb->parent = creator;
+    pcb->leader = creator->leader;
+    pcb->terminal = creator->leader->terminal;
+    pcb->waiting = 0;
+    pcb->sleeping = 0;
+    pcb->async = 1;
+    pcb->zombie = 0;
+    pcb->vidmap = 0;
+    pcb->rtc = 0;
+    pcb->exec_tsc = 0;
+    pcb->page_faults = 0;
+    pcb->sig_pending = 0;
+    pcb->preempt_count = 0;
+    pcb->exitq.pids = 0;
+    pcb->waitq = NULL;
+    pcb->sig_masked = 0;
+    for (i = 0; i < MAX_FILES; i++)
+        pcb->fd[i].flags = 0;       /* the leader's are the process's */
+    pcb->esp0 = KSTACK_START - KSTACK_SIZE * pid;
+    task_entry(pcb, (uint32_t)entry, (uint32_t)stack);
+    pcb->present = 1;
+    restore_flags(flags);
+    return pid;
+}
+
+/**
+ * int32_t thread_join(int32_t tid, int32_t* status):
+ * DESCRIPTION: waits for another thread of the process to halt and
+ *              collects it; any thread can join any other
+ * INPUTS: tid -- from thread_create
+ * OUTPUTS: status -- what the thread passed to halt, 256 if it died by
+ *                    an exception; may be NULL
+ * RETURN: tid, or -1 if it is not another thread of this process or
+ *         status is not in user space
+ */
+int32_t thread_join(int32_t tid, int32_t* status){
+    pcb_t* pcb = current_pcb();
+    pcb_t* thread;
+    uint32_t flags;
+    int32_t result;
+
+    if ((status != NULL && ((uint32_t)status >> 22) != USER_ENTRY) || tid < 0 || tid >= MAX_TASKS)
+        return -1;
+    thread = GET_PCB(tid);
+
+    cli_and_save(flags);
+    while (1) {
+        if (thread == pcb || thread->leader == thread || thread->leader != current_process()
+            || !(thread->present || thread->zombie)) {
+            restore_flags(flags);
+            return -1;
+        }
+        if (thread->zombie) {
+            thread->zombie = 0;                 /* the pid is free again */
+            result = thread->exit_status;
+            restore_flags(flags);
+            if (status != NULL)
+                *status = result;
+            return tid;
+        }
+        sleep_on(&current_process()->exitq);    /* the thread's halt wakes us up */
+    }
 }
 
 /**
@@ -495,3 +1047,17 @@ pcb_t* current_pcb(){
     );
     return (pcb_t*)(esp & (KSTACK_START - KSTACK_SIZE));
 }
+
+/**
+ * pcb_t* current_process():
+ * DESCRIPTION: gets the process the running thread belongs to, the
+ *              pcb that holds the fds and names the address space
+ * INPUTS: none
+ * OUTPUTS: none
+ * RETURN: the main thread's pcb; the running pcb itself if it never
+ *         ran a program, as at boot
+ */
+pcb_t* current_process(){
+    pcb_t* pcb = current_pcb();
+    return pcb->leader ? pcb->leader : pcb;
+}
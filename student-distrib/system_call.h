@@ -7,27 +7,61 @@
 #include "rtc.h"
 #include "terminal.h"
 #include "filesys.h"
+#include "tmpfs.h"
+#include "bcache.h"
+#include "pipe.h"
+#include "shm.h"
+#include "futex.h"
+#include "signal.h"
+#include "pit.h"
 
 #define MAX_FILES 8
 #define MAGIC_SIZE 4
 #define MAGIC_NUM 0x464C457F
 #define USER_ENTRY 32
-#define MAX_TASKS 6
+#define TASK_HEADROOM 3                     /* pids for programs besides one shell per console */
+#ifndef MAX_TASKS
+#define MAX_TASKS (NUM_TERMINAL + TASK_HEADROOM)    /* each one takes 4MB of the user pool */
+#endif
+#if MAX_TASKS < NUM_TERMINAL + TASK_HEADROOM
+#error "MAX_TASKS must leave TASK_HEADROOM pids besides the NUM_TERMINAL shells"
+#endif
+#if MAX_TASKS > 32
+#error "wait queues keep one bit per pid in a uint32_t"
+#endif
 #define PROGRAM_IMAGE_ADDR 0x8048000        /* virtual address of the program image */
 #define PROGRAM_IMAGE_LIMIT 0x3B8000        /* limit of size of program image */
 #define USER_STACK 0x8400000
 #define KSTACK_START 0x800000
 #define KSTACK_SIZE 0x2000
 
+#define USER_EFLAGS 0x202                   /* IF set, bit 1 always reads 1 */
+#define WNOHANG 1                           /* waitpid option: return 0 instead of sleeping */
+
 #define GET_PCB(pid) ((pcb_t*)(KSTACK_START - KSTACK_SIZE - KSTACK_SIZE * pid))
 
+/* the top of a kernel stack during a system call, interrupt or exception:
+ * the linkage's pushes, the error code (0 if the CPU pushed none), then the
+ * iret frame; a signal handler finds the same layout on its user stack */
+typedef struct syscall_frame {
+    uint32_t ebx, ecx, edx, esi, edi, ebp, eax;
+    uint16_t pad_ds, ds, pad_es, es, pad_fs, fs;
+    uint32_t error;
+    uint32_t eip, cs, eflags, esp, ss;
+} syscall_frame_t;
+
+/*
+ * One schedulable context: a kernel stack with its pcb at the bottom. A
+ * process is its main thread's pcb, which also holds what the threads
+ * share (the fds, the arguments, the program and the address space,
+ * named by the main thread's pid); other threads point at it as leader.
+ */
 typedef struct pcb {
-    file_descriptor_t fd[MAX_FILES];
+    file_descriptor_t fd[MAX_FILES];    /* process-wide, only the leader's are used */
     uint8_t present;
     uint32_t pid;
     struct pcb* parent;
-    uint32_t eebp;
-    uint32_t ebp;
+    uint32_t ksp;                       /* kernel esp switch_to saved, while it is not running */
     uint32_t esp0;
     uint32_t vidmap;
     uint8_t rtc;
@@ -35,6 +69,24 @@ typedef struct pcb {
     uint32_t rtc_curr;
     uint32_t rtc_rate;
     char args[READBUF_SIZE];
+    uint32_t terminal;                  /* the terminal it was started on */
+    uint32_t exec_inode;                /* the program file, pages load from it on demand */
+    uint32_t page_faults;               /* demand faults since execute */
+    uint64_t exec_tsc;                  /* TSC at execute, 0 once the first instruction ran */
+    uint8_t waiting;                    /* blocked in execute until its child halts, not scheduled */
+    uint8_t sleeping;                   /* blocked in waitpid or on a wait queue, not scheduled */
+    uint8_t async;                      /* made by fork or spawn, runs alongside its parent */
+    uint8_t zombie;                     /* halted async child, keeps its pid until waitpid */
+    int32_t exit_status;                /* for waitpid, 256 after an exception */
+    struct pcb* leader;                 /* the process's main thread, itself for a main thread */
+    uint32_t sig_pending;               /* raised signals, a bit each, delivered on the way to user mode */
+    uint8_t sig_masked;                 /* in a handler, nothing else is delivered until sigreturn */
+    void* sig_handler[NUM_SIGNALS];     /* process-wide, NULL for the default action */
+    uint32_t alarm_ticks;               /* process-wide ALARM interval in PIT ticks, 0 for none */
+    uint32_t alarm_left;                /* PIT ticks until the next ALARM */
+    uint32_t preempt_count;             /* preempt_disable depth, not switched on interrupt returns while nonzero */
+    wait_queue_t* waitq;                /* the queue sleep_on put it on, NULL while it runs */
+    wait_queue_t exitq;                 /* waitpid sleeps here until a child halts, thread_join in the leader's until a thread does */
 }pcb_t;
 
 
@@ -78,6 +130,55 @@ static const struct file_operations dir_op = {
     .close = dir_close
 };
 
+static const struct file_operations tmpfs_op = {
+    .open = tmpfs_open,
+    .read = tmpfs_read,
+    .write = tmpfs_write,
+    .close = tmpfs_close
+};
+
+static const struct file_operations bdev_op = {
+    .open = bdev_open,
+    .read = bdev_read,
+    .write = bdev_write,
+    .close = bdev_close
+};
+
+static const struct file_operations bcstat_op = {
+    .open = bcstat_open,
+    .read = bcstat_read,
+    .write = null_write,
+    .close = file_close
+};
+
+static const struct file_operations pfstat_op = {
+    .open = pfstat_open,
+    .read = pfstat_read,
+    .write = null_write,
+    .close = file_close
+};
+
+static const struct file_operations schedstat_op = {
+    .open = schedstat_open,
+    .read = schedstat_read,
+    .write = null_write,
+    .close = file_close
+};
+
+static const struct file_operations pipe_read_op = {
+    .open = null_open,
+    .read = pipe_read,
+    .write = null_write,
+    .close = pipe_read_close
+};
+
+static const struct file_operations pipe_write_op = {
+    .open = null_open,
+    .read = null_read,
+    .write = pipe_write,
+    .close = pipe_write_close
+};
+
 static const struct file_operations null_op = {
     .open = null_open,
     .read = null_read,
@@ -86,6 +187,7 @@ static const struct file_operations null_op = {
 };
 
 pcb_t* current_pcb();
+pcb_t* current_process();
 
 int32_t halt(uint8_t status);
 int32_t execute(const uint8_t* command);
@@ -97,6 +199,19 @@ int32_t getargs(uint8_t* buf, int32_t nbytes);
 int32_t vidmap(uint8_t** screen_start);
 int32_t set_handler(int32_t signum, void* handler_address);
 int32_t sigreturn(void);
+int32_t create(const uint8_t* filename);
+int32_t unlink(const uint8_t* filename);
+int32_t fork(void);
+int32_t spawn(const uint8_t* command);
+int32_t waitpid(int32_t pid, int32_t* status, int32_t options);
+int32_t pipe(int32_t* fds);
+int32_t dup2(int32_t oldfd, int32_t newfd);
+int32_t isatty(int32_t fd);
+int32_t shm_create(int32_t key, uint32_t size);
+int32_t shm_attach(int32_t key);
+int32_t thread_create(void* entry, void* stack);
+int32_t thread_join(int32_t tid, int32_t* status);
+int32_t alarm(int32_t interval_ms);
 
 
 #endif
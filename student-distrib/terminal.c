@@ -35,16 +35,23 @@ int32_t terminal_read(int32_t file, void* buf, int32_t nbytes){
 *           nbytes - number of bytes to write
 *   OUTPUTS: none
 *   RETURN VALUE: The number of bytes written
-*   SIDE EFFECTS: Outputs the content of buf to the terminal
+*   SIDE EFFECTS: Outputs the content of buf to the terminal; interrupts are
+*                 only disabled for TERMINAL_WRITE_CHUNK characters at a time, so
+*                 a long write neither holds off keyboard echo nor other processes
 */
 int32_t terminal_write(int32_t file, const void* buf, int32_t nbytes){
-    cli();
-    int i;
-    for (i = 0; i < nbytes; i++)        // Traverse through the buffer
-        if (((char*)buf)[i])            // Print to terminal if not null character
-            putc(((char*)buf)[i]);
-    reset_buf();                        // In case for asychronous write
-    sti();
+    uint32_t flags;
+    int i = 0, end;
+    do {
+        end = (nbytes - i > TERMINAL_WRITE_CHUNK) ? i + TERMINAL_WRITE_CHUNK : nbytes;
+        cli_and_save(flags);
+        for (; i < end; i++)            // Traverse through the buffer
+            if (((char*)buf)[i])        // Print to terminal if not null character
+                putc(((char*)buf)[i]);
+        if (i >= nbytes)
+            reset_buf();                // In case for asychronous write
+        restore_flags(flags);
+    } while (i < nbytes);
     return nbytes;
 }
 
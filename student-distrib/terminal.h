@@ -2,6 +2,8 @@
 #define TERMINAL
 #include "types.h"
 
+#define TERMINAL_WRITE_CHUNK 64    /* characters written per interrupts-off section */
+
 /*
 * terminal_read
 *   DESCRIPTION: Read user keyboard inputs
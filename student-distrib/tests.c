@@ -7,6 +7,14 @@
 #include "terminal.h"
 #include "filesys.h"
 #include "malloc.h"
+#include "pit.h"
+#include "tmpfs.h"
+#include "system_call.h"
+#include "ata.h"
+#include "bcache.h"
+#include "vfs.h"
+#include "devfs.h"
+#include "common_asm_link.h"
 
 #define PASS 1
 #define FAIL 0
@@ -377,8 +385,12 @@ int dir_read_test( void )
     uint8_t test_buf[MAX_FILE_NAME+1];
     char test_dir[] = ".";
     int32_t test_fd = 2;
+    file_descriptor_t* fd = &current_pcb()->fd[test_fd];
     clear();
     dir_open((const uint8_t*) test_dir);
+    fd->sb = NULL;                                  /* "." is the root of the namespace */
+    fd->inode = 0;
+    fd->dir_index = 0;
 
     while(dir_read(test_fd, test_buf, MAX_FILE_NAME) > 0) {
         printf("file_name: ");
@@ -413,10 +425,1064 @@ int file_read_test(uint8_t* filename) {
 }
 
 
+#define ATA_BENCH_SEQ_BYTES 0x400000        /* 4MB sequential */
+#define ATA_BENCH_SEQ_CHUNK 128             /* sectors per sequential request */
+#define ATA_BENCH_RANDOM_OPS 256            /* random 4KB reads */
+#define ATA_BENCH_DEPTH 16                  /* random reads queued at once */
+
+/*
+* ata_bench_test
+*   DESCRIPTION: Reads the disk sequentially in 64KB requests, then at
+*                random 4KB-aligned spots with 16 requests in the
+*                elevator at a time, and prints MB/s and IOPS
+*   INPUTS: dma - 1 for bus-master DMA, 0 for PIO
+*   OUTPUTS: throughput
+*   RETURN VALUE: PASS if every read succeeded
+*   SIDE EFFECTS: leaves the driver in the tested mode
+*/
+int ata_bench_test(int32_t dma) {
+    TEST_HEADER;
+    ata_request_t reqs[ATA_BENCH_DEPTH];
+    uint8_t* buf;
+    uint32_t lba, seq_sectors, us, i, j, seed = 391;
+    uint64_t start;
+    int result = PASS;
+
+    if (!ata_sectors || ata_set_dma(dma) != 0
+        || !(buf = malloc(ATA_BENCH_DEPTH * BLOCK_SIZE)))
+        return FAIL;
+
+    seq_sectors = ATA_BENCH_SEQ_BYTES / ATA_SECTOR_SIZE;
+    if (seq_sectors > ata_sectors)
+        seq_sectors = ata_sectors - ata_sectors % ATA_BENCH_SEQ_CHUNK;
+    start = rdtsc();
+    for (lba = 0; lba < seq_sectors; lba += ATA_BENCH_SEQ_CHUNK)
+        if (ata_read(lba, ATA_BENCH_SEQ_CHUNK, buf) != 0)
+            result = FAIL;
+    us = tsc_to_us(rdtsc() - start);
+    printf("%s sequential: %d KB in %d us", dma ? "DMA" : "PIO", seq_sectors / 2, us);
+    if (us)
+        printf(", %d MB/s", seq_sectors * ATA_SECTOR_SIZE / us);
+    printf("\n");
+
+    start = rdtsc();
+    for (i = 0; i < ATA_BENCH_RANDOM_OPS; i += ATA_BENCH_DEPTH) {
+        for (j = 0; j < ATA_BENCH_DEPTH; j++) {
+            seed = seed * 1103515245 + 12345;
+            reqs[j].lba = (seed % (ata_sectors / 8)) * 8;
+            reqs[j].count = BLOCK_SIZE / ATA_SECTOR_SIZE;
+            reqs[j].buf = buf + j * BLOCK_SIZE;
+            reqs[j].write = 0;
+            reqs[j].complete = NULL;
+            reqs[j].status = ATA_FAILED;        /* stays failed if submit rejects it */
+            if (ata_submit(&reqs[j]) != 0)
+                result = FAIL;
+        }
+        for (j = 0; j < ATA_BENCH_DEPTH; j++)
+            if (ata_wait(&reqs[j]) != 0)
+                result = FAIL;
+    }
+    us = tsc_to_us(rdtsc() - start);
+    printf("%s random 4KB: %d reads in %d us", dma ? "DMA" : "PIO", ATA_BENCH_RANDOM_OPS, us);
+    if (us)
+        printf(", %d IOPS, %d KB/s", ATA_BENCH_RANDOM_OPS * 1000000 / us,
+               ATA_BENCH_RANDOM_OPS * BLOCK_SIZE * 1000 / us);
+    printf("\n");
+
+    free(buf);
+    return result;
+}
+
+/*
+* bcache_test
+*   DESCRIPTION: Reads the first blocks of hda twice through the cache;
+*                the second pass must be all hits with the same data
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS/FAIL
+*   SIDE EFFECTS: none
+*/
+int bcache_test() {
+    TEST_HEADER;
+    buffer_t* b;
+    uint32_t block, hits, sum[2] = {0, 0};
+    int pass, i;
+
+    for (pass = 0; pass < 2; pass++) {
+        hits = bcache_stats.hits;
+        for (block = 0; block < 16; block++) {
+            if (!(b = bread(BCACHE_DEV_HDA, block)))
+                return FAIL;
+            for (i = 0; i < BLOCK_SIZE; i++)
+                sum[pass] = sum[pass] * 31 + b->data[i];
+            brelse(b);
+        }
+    }
+    return (sum[0] == sum[1] && bcache_stats.hits - hits == 16) ? PASS : FAIL;
+}
+
 /* Checkpoint 3 tests */
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/*
+* tmpfs_test
+*   DESCRIPTION: Creates, appends to, truncates and unlinks a tmpfs file
+*                through the fd interface, checking it is visible to
+*                open() and dir_read() only while it is linked
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS/FAIL
+*   SIDE EFFECTS: uses fd 2 of the current pcb
+*/
+int tmpfs_test() {
+    TEST_HEADER;
+    uint8_t name[] = "tmpfs_test.txt";
+    uint8_t buf[BLOCK_SIZE + 8];
+    file_descriptor_t* fd = &current_pcb()->fd[2];
+    int i, result = PASS;
+
+    if (tmpfs_create((uint8_t*)"frame0.txt") != -1 || tmpfs_create(name) != 0)
+        return FAIL;
+    fd->inode = tmpfs_lookup(name);
+    fd->file_position = 0;
+    tmpfs_open(name);
+
+    memset(buf, 'x', sizeof(buf));
+    for (i = 0; i < 3; i++)                         /* crosses page boundaries */
+        if (tmpfs_write(2, buf, sizeof(buf)) != sizeof(buf))
+            result = FAIL;
+    if (tmpfs_size(fd->inode) != 3 * sizeof(buf))
+        result = FAIL;
+    fd->file_position = BLOCK_SIZE;
+    if (tmpfs_read(2, buf, sizeof(buf)) != sizeof(buf) || buf[0] != 'x')
+        result = FAIL;
+
+    if (tmpfs_create(name) != 0 || tmpfs_size(fd->inode) != 0)
+        result = FAIL;                              /* truncated */
+    if (tmpfs_unlink(name) != 0 || tmpfs_lookup(name) != -1)
+        result = FAIL;
+    tmpfs_close(2);
+    return result;
+}
+
+/*
+* fs_subdir_test
+*   DESCRIPTION: Resolves every entry of every top-level subdirectory by
+*                its path, and checks that paths through a file fail
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if each path finds the entry it names
+*   SIDE EFFECTS: none
+*/
+int fs_subdir_test() {
+    TEST_HEADER;
+    uint8_t path[2 * MAX_FILE_NAME + 2];
+    dentry_t top, entry, found;
+    uint32_t i, j;
+    int result = PASS;
+
+    if (read_dentry_by_name((uint8_t*)"./frame0.txt", &found) || read_dentry_by_name((uint8_t*)"frame0.txt", &entry)
+        || found.inode_num != entry.inode_num || read_dentry_by_name((uint8_t*)"frame0.txt/x", &found) != -1)
+        return FAIL;
+
+    for (i = 0; read_dentry_by_index(i, &top) == 0; i++) {
+        if (top.file_type != 1 || fs_dir_number(&top) == FS_ROOT_DIR)
+            continue;
+        for (j = 0; read_dir_entry(top.inode_num, j, &entry) == 0; j++) {
+            memset(path, 0, sizeof(path));
+            strncpy((int8_t*)path, (int8_t*)top.file_name, MAX_FILE_NAME);
+            path[strlen((int8_t*)path)] = '/';
+            strncpy((int8_t*)path + strlen((int8_t*)path), (int8_t*)entry.file_name, MAX_FILE_NAME);
+            if (read_dentry_by_name(path, &found) || found.inode_num != entry.inode_num)
+                result = FAIL;
+        }
+    }
+    return result;
+}
+
+/*
+* fs_lz4_test
+*   DESCRIPTION: Reads a file whole and then a byte at a time; on a
+*                compressed image the small reads must come from the
+*                decompressed block cache
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if both reads agree
+*   SIDE EFFECTS: none
+*/
+int fs_lz4_test() {
+    TEST_HEADER;
+    static uint8_t whole[8192];
+    dentry_t dentry;
+    uint8_t byte;
+    uint32_t i, hits;
+    int32_t size;
+
+    if (read_dentry_by_name((uint8_t*)"syserr", &dentry)
+        || (size = read_data(dentry.inode_num, 0, whole, sizeof(whole))) <= BLOCK_SIZE)
+        return FAIL;
+    hits = fs_zstats.hits;
+    for (i = 0; i < (uint32_t)size; i++) {
+        if (read_data(dentry.inode_num, i, &byte, 1) != 1 || byte != whole[i])
+            return FAIL;
+    }
+    if (read_data(dentry.inode_num, size, &byte, 1) != 0)
+        return FAIL;
+    printf("%d compressed bytes decoded to %d, %d cache hits\n",
+           fs_zstats.bytes_in, fs_zstats.bytes_out, fs_zstats.hits - hits);
+    return PASS;
+}
+
+/*
+* frame_alloc_test
+*   DESCRIPTION: Takes every frame of the user pool, checks that they are
+*                distinct 4KB frames past the boot module, that sharing one
+*                stops at FRAME_REF_MAX instead of wrapping, and gives them back
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if the pool hands out each frame once
+*   SIDE EFFECTS: none
+*/
+int frame_alloc_test() {
+    TEST_HEADER;
+    static uint32_t frames[MAX_TASKS * PAGE_TABLE_COUNT];
+    uint32_t used = paging_stats.frames_used, n, i;
+    int result = PASS;
+
+    for (n = 0; n < MAX_TASKS * PAGE_TABLE_COUNT && (frames[n] = frame_alloc()); n++) {
+        if ((frames[n] & (PAGE_SIZE - 1)) || frames[n] < (USER_FRAME(0) << FRAME_SHIFT)
+            || frames[n] >= (USER_FRAME(MAX_TASKS) << FRAME_SHIFT))
+            result = FAIL;
+    }
+    if (n + used != MAX_TASKS * PAGE_TABLE_COUNT || frame_alloc() != 0)
+        result = FAIL;
+    for (i = 1; i < n; i++) {
+        if (frames[i] == frames[i - 1])
+            result = FAIL;
+    }
+    if (n) {
+        for (i = 1; i < FRAME_REF_MAX; i++)
+            frame_share(frames[0]);
+        if (frame_refs(frames[0]) != FRAME_REF_MAX || frame_share(frames[0]) != -1)
+            result = FAIL;
+        for (i = 1; i < FRAME_REF_MAX; i++)
+            frame_free(frames[0]);
+    }
+    for (i = 0; i < n; i++)
+        frame_free(frames[i]);
+    if (paging_stats.frames_used != used)
+        result = FAIL;
+    return result;
+}
+
+/*
+* task_directory_test
+*   DESCRIPTION: Switches to every task's page directory and checks that
+*                the kernel, the video memory and the heap read the same
+*                through it, then goes back to the kernel directory
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if the kernel mappings are shared
+*   SIDE EFFECTS: none
+*/
+int task_directory_test() {
+    TEST_HEADER;
+    uint32_t* heap = malloc(sizeof(uint32_t));
+    uint32_t kernel_word = *(uint32_t*)KERNEL_ADDR, video_word = *(uint32_t*)VIDEO_MEMORY_ADDR;
+    uint32_t pid, flags;
+    int result = PASS;
+
+    if (!heap)
+        return FAIL;
+    *heap = 0x391;
+    cli_and_save(flags);
+    for (pid = 0; pid < MAX_TASKS; pid++) {
+        user_space_switch(pid);
+        if (*(uint32_t*)KERNEL_ADDR != kernel_word || *(uint32_t*)VIDEO_MEMORY_ADDR != video_word || *heap != 0x391)
+            result = FAIL;
+    }
+    asm volatile ("movl %0, %%cr3" : : "r" (page_directory) : "memory");
+    restore_flags(flags);
+    free(heap);
+    return result;
+}
+
+/*
+* ctx_switch_round_trip
+*   DESCRIPTION: Switches between two tasks' page directories, touching
+*                the kernel, the video pages and the heap after each
+*                switch the way the scheduler and putc do
+*   INPUTS: rounds - the number of round trips, heap - a heap word
+*   OUTPUTS: none
+*   RETURN VALUE: TSC cycles per round trip
+*   SIDE EFFECTS: leaves the kernel directory loaded
+*/
+static uint32_t ctx_switch_round_trip(uint32_t rounds, volatile uint32_t* heap) {
+    volatile uint32_t sink = 0;
+    uint64_t start, end;
+    uint32_t i, page, flags;
+
+    cli_and_save(flags);
+    start = rdtsc();
+    for (i = 0; i < rounds; i++) {
+        user_space_switch(i & 1);
+        sink += *(volatile uint32_t*)KERNEL_ADDR + *heap;
+        for (page = 0; page < 5; page++)
+            sink += *(volatile uint32_t*)(VIDEO_MEMORY_ADDR + page * PAGE_SIZE);
+    }
+    end = rdtsc();
+    asm volatile ("movl %0, %%cr3" : : "r" (page_directory) : "memory");
+    restore_flags(flags);
+    return (uint32_t)(end - start) / rounds;    /* no 64-bit division without libgcc */
+}
+
+/*
+* ctx_switch_bench_test
+*   DESCRIPTION: Times address space round trips with CR4.PGE off, as
+*                every switch used to flush the kernel and video
+*                translations, and on, where they stay in the TLB
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS
+*   SIDE EFFECTS: none
+*/
+int ctx_switch_bench_test() {
+    TEST_HEADER;
+    uint32_t* heap = malloc(sizeof(uint32_t));
+    uint32_t flushed, global;
+
+    if (!heap)
+        return FAIL;
+    *heap = 0;
+    paging_global(0);
+    flushed = ctx_switch_round_trip(20000, heap);
+    paging_global(1);
+    global = ctx_switch_round_trip(20000, heap);
+    free(heap);
+    printf("round trip: %d cycles without global pages, %d with", flushed, global);
+    if (tsc_mhz)
+        printf(" (%d / %d ns)", flushed * 1000 / tsc_mhz, global * 1000 / tsc_mhz);
+    printf("\n");
+    return PASS;
+}
+
+#define SWITCH_BENCH_ROUNDS 100000
+
+static uint32_t switch_bench_sp[2];         /* the test's kernel esp, the peer's */
+
+/*
+* switch_bench_peer
+*   DESCRIPTION: The other end of the ping-pong, on the spare pid's kernel
+*                stack: switches straight back every time it is resumed
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: never returns
+*   SIDE EFFECTS: none
+*/
+static void switch_bench_peer() {
+    while (1)
+        switch_to(&switch_bench_sp[1], &switch_bench_sp[0]);
+}
+
+/*
+* switch_bench_test
+*   DESCRIPTION: Ping-pongs with switch_to between this kernel stack and
+*                a context on the spare pid's, the kernel stack part of a
+*                context switch without the page directory load
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS, FAIL if the spare pid is in use
+*   SIDE EFFECTS: prints cycles per switch
+*/
+int switch_bench_test() {
+    TEST_HEADER;
+    uint32_t* stack = (uint32_t*)(KSTACK_START - KSTACK_SIZE * (MAX_TASKS - 1));
+    uint64_t start, end;
+    uint32_t i, flags;
+
+    if (GET_PCB(MAX_TASKS - 1)->present || GET_PCB(MAX_TASKS - 1)->zombie)
+        return FAIL;
+    *--stack = 0;                                           /* the peer's own return address, unused */
+    *--stack = (uint32_t)switch_bench_peer;
+    for (i = 0; i < 4; i++)
+        *--stack = 0;                                       /* ebp, ebx, esi, edi */
+    switch_bench_sp[1] = (uint32_t)stack;
+
+    cli_and_save(flags);
+    start = rdtsc();
+    for (i = 0; i < SWITCH_BENCH_ROUNDS; i++)
+        switch_to(&switch_bench_sp[0], &switch_bench_sp[1]);
+    end = rdtsc();
+    restore_flags(flags);
+    printf("switch_to: %d cycles per switch\n", (uint32_t)(end - start) / (2 * SWITCH_BENCH_ROUNDS));
+    return PASS;
+}
+
+#define FORK_BENCH_PAGES 32                 /* a 128KB image, program and stack */
+
+/*
+* fork_round_trip
+*   DESCRIPTION: Forks a populated address space and empties the child
+*                again, the address space side of a fork and an exit
+*   INPUTS: parent, child - unused pids, parent's directory loaded
+*           cow - share the frames or copy them, rounds - repetitions
+*   OUTPUTS: committed - frames the child took right after the fork
+*   RETURN VALUE: TSC cycles per round trip
+*   SIDE EFFECTS: none
+*/
+static uint32_t fork_round_trip(uint32_t parent, uint32_t child, int32_t cow, uint32_t rounds, uint32_t* committed) {
+    uint64_t start;
+    uint32_t i, used;
+
+    *committed = 0;
+    start = rdtsc();
+    for (i = 0; i < rounds; i++) {
+        used = paging_stats.frames_used;
+        if (user_space_fork(parent, child, cow) == -1)
+            return 0;
+        *committed = paging_stats.frames_used - used;
+        user_space_reset(child);
+    }
+    return (uint32_t)(rdtsc() - start) / rounds;
+}
+
+/*
+* fork_child_matches
+*   DESCRIPTION: Forks once and reads every page back through the child
+*   INPUTS: parent, child - unused pids, parent's directory loaded
+*           cow - share the frames or copy them
+*   OUTPUTS: none
+*   RETURN VALUE: 1 if the child sees the parent's data
+*   SIDE EFFECTS: leaves the parent's directory loaded
+*/
+static int fork_child_matches(uint32_t parent, uint32_t child, int32_t cow) {
+    uint32_t page;
+    int match = 1;
+
+    if (user_space_fork(parent, child, cow) == -1)
+        return 0;
+    user_space_switch(child);
+    for (page = 0; page < FORK_BENCH_PAGES; page++) {
+        if (*(uint32_t*)(PROGRAM_IMAGE_ADDR + page * PAGE_SIZE) != page)
+            match = 0;
+    }
+    user_space_reset(child);
+    user_space_switch(parent);
+    return match;
+}
+
+/*
+* fork_bench_test
+*   DESCRIPTION: Builds a FORK_BENCH_PAGES address space in a spare pid
+*                and times fork + exit sharing the frames copy-on-write
+*                against copying the whole image, with the frames each
+*                child commits; both children must see the parent's data
+*   INPUTS: none
+*   OUTPUTS: cycles and frames per fork
+*   RETURN VALUE: PASS if both forks copy the address space faithfully
+*   SIDE EFFECTS: none, the spare pids are emptied again
+*/
+int fork_bench_test() {
+    TEST_HEADER;
+    uint32_t parent = MAX_TASKS - 2, child = MAX_TASKS - 1;
+    uint32_t page, flags, copied, shared, copy_frames, cow_frames;
+    int result = PASS;
+
+    if (GET_PCB(parent)->present || GET_PCB(child)->present)
+        return FAIL;
+    cli_and_save(flags);
+    user_space_switch(parent);
+    for (page = 0; page < FORK_BENCH_PAGES; page++) {
+        if (user_page_map(parent, PROGRAM_IMAGE_ADDR + page * PAGE_SIZE) == -1) {
+            result = FAIL;
+            break;
+        }
+        *(uint32_t*)(PROGRAM_IMAGE_ADDR + page * PAGE_SIZE) = page;
+    }
+    if (result == PASS) {
+        copied = fork_round_trip(parent, child, 0, 100, &copy_frames);
+        shared = fork_round_trip(parent, child, 1, 100, &cow_frames);
+        if (!fork_child_matches(parent, child, 0) || !fork_child_matches(parent, child, 1))
+            result = FAIL;
+        if (copy_frames != FORK_BENCH_PAGES || cow_frames != 0)
+            result = FAIL;
+    }
+    user_space_reset(parent);
+    asm volatile ("movl %0, %%cr3" : : "r" (page_directory) : "memory");
+    restore_flags(flags);
+
+    if (result == PASS) {
+        printf("fork + exit of %d pages: copy %d cycles, %d frames; cow %d cycles, %d frames",
+               FORK_BENCH_PAGES, copied, copy_frames, shared, cow_frames);
+        if (tsc_mhz)
+            printf(" (%d / %d us)", copied / tsc_mhz, shared / tsc_mhz);
+        printf("\n");
+    }
+    return result;
+}
+
+#define SPARE_PID (MAX_TASKS - 1)
+
+/*
+* spare_pcb_take
+*   DESCRIPTION: Hands out the last pid as a task of the running context
+*                that no scheduler will pick: a spawned child, or a
+*                thread of leader. No signals, handlers or alarm
+*   INPUTS: leader - the process it is a thread of, NULL for its own
+*   OUTPUTS: none
+*   RETURN VALUE: its pcb, NULL if the pid is in use
+*   SIDE EFFECTS: the pid is taken until spare_pcb_free
+*/
+static pcb_t* spare_pcb_take(pcb_t* leader) {
+    pcb_t* pcb = GET_PCB(SPARE_PID);
+
+    if (pcb->present || pcb->zombie)
+        return NULL;
+    pcb->async = 1;
+    pcb->parent = current_pcb();
+    pcb->leader = leader ? leader : pcb;
+    pcb->exit_status = 0;
+    pcb->sig_pending = 0;
+    memset(pcb->sig_handler, 0, sizeof(pcb->sig_handler));
+    pcb->alarm_ticks = pcb->alarm_left = 0;
+    return pcb;
+}
+
+/*
+* spare_pcb_free
+*   DESCRIPTION: Gives back what spare_pcb_take handed out, whatever the
+*                test did to it
+*   INPUTS: pcb - the spare pcb
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: the pid is free again
+*/
+static void spare_pcb_free(pcb_t* pcb) {
+    pcb->present = 0;
+    pcb->zombie = 0;
+    pcb->async = 0;
+    pcb->parent = NULL;
+    pcb->leader = NULL;
+    pcb->sig_pending = 0;
+    memset(pcb->sig_handler, 0, sizeof(pcb->sig_handler));
+    pcb->alarm_ticks = pcb->alarm_left = 0;
+}
+
+/*
+* waitpid_test
+*   DESCRIPTION: Plants a halted spawned child of the running context in
+*                the spare pid and checks that waitpid collects it exactly
+*                once, and that bad arguments and no children give -1.
+*                proctest covers spawn and a blocking waitpid
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if waitpid finds, frees and then forgets the child
+*   SIDE EFFECTS: none
+*/
+int waitpid_test() {
+    TEST_HEADER;
+    pcb_t* child;
+    int result = PASS;
+
+    if (waitpid(-1, NULL, WNOHANG) != -1 || waitpid(MAX_TASKS, NULL, 0) != -1
+        || waitpid(-1, (int32_t*)KERNEL_ADDR, WNOHANG) != -1)
+        result = FAIL;
+
+    if (!(child = spare_pcb_take(NULL)))
+        return FAIL;
+    child->exit_status = 42;
+    child->zombie = 1;
+    if (waitpid(SPARE_PID - 1, NULL, WNOHANG) != -1)            /* not that child */
+        result = FAIL;
+    if (waitpid(-1, NULL, WNOHANG) != SPARE_PID || child->zombie)
+        result = FAIL;
+    if (waitpid(SPARE_PID, NULL, WNOHANG) != -1)                /* already collected */
+        result = FAIL;
+    spare_pcb_free(child);
+    return result;
+}
+
+/*
+* thread_test
+*   DESCRIPTION: Makes the spare pid look like a halted thread of the
+*                current process and collects it: waitpid must not see
+*                it, thread_join must, once, with its status. Bad entry
+*                points and stacks are refused. proctest runs real threads
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if only thread_join collects the thread
+*   SIDE EFFECTS: none
+*/
+int thread_test() {
+    TEST_HEADER;
+    pcb_t* thread;
+    int result = PASS;
+
+    if (thread_create((void*)KERNEL_ADDR, (void*)USER_STACK) != -1
+        || thread_create((void*)(USER_ENTRY << 22), (void*)KERNEL_ADDR) != -1)
+        result = FAIL;
+
+    if (!(thread = spare_pcb_take(current_process())))
+        return FAIL;
+    thread->exit_status = 7;
+    thread->zombie = 1;
+    if (waitpid(-1, NULL, WNOHANG) != -1)                       /* threads are not children */
+        result = FAIL;
+    if (thread_join(current_pcb()->pid, NULL) != -1)            /* not itself */
+        result = FAIL;
+    if (thread_join(SPARE_PID, NULL) != SPARE_PID || thread->zombie)
+        result = FAIL;
+    if (thread_join(SPARE_PID, NULL) != -1)                     /* already collected */
+        result = FAIL;
+    spare_pcb_free(thread);
+    return result;
+}
+
+/*
+* signal_test
+*   DESCRIPTION: Makes the spare pid look like a process with an ALARM
+*                handler and an interval of two ticks: set_handler
+*                refuses bad arguments, a signal without a handler is
+*                left to the default action, and ALARM is raised on the
+*                second tick with the interval reloaded. proctest has a
+*                handler run and return through sigreturn
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if only the handled signal becomes pending
+*   SIDE EFFECTS: none
+*/
+int signal_test() {
+    TEST_HEADER;
+    pcb_t* pcb;
+    uint32_t flags;
+    int result = PASS;
+
+    if (set_handler(NUM_SIGNALS, NULL) != -1 || set_handler(SIG_ALARM, (void*)KERNEL_ADDR) != -1)
+        result = FAIL;
+
+    cli_and_save(flags);                                        /* not to be scheduled */
+    if (!(pcb = spare_pcb_take(NULL))) {
+        restore_flags(flags);
+        return FAIL;
+    }
+    pcb->present = 1;
+    pcb->alarm_ticks = pcb->alarm_left = 2;
+    if (signal_send(SPARE_PID, SIG_INTERRUPT) != -1 || pcb->sig_pending)
+        result = FAIL;
+    pcb->sig_handler[SIG_ALARM] = (void*)(USER_ENTRY << 22);
+    signal_tick();
+    if (pcb->sig_pending)
+        result = FAIL;
+    signal_tick();
+    if (pcb->sig_pending != 1 << SIG_ALARM || pcb->alarm_left != 2)
+        result = FAIL;
+    spare_pcb_free(pcb);
+    restore_flags(flags);
+    return result;
+}
+
+/*
+* preempt_test
+*   DESCRIPTION: With interrupts off, asks for a switch the way a PIT tick
+*                does and checks that preempt_check leaves it for later
+*                inside preempt_disable and inside an interrupt handler,
+*                that preempt_enable nests, and that /dev/schedstat reads
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if nothing switches and the counts add up
+*   SIDE EFFECTS: uses fd 2 of the current pcb, clears need_resched
+*/
+int preempt_test() {
+    TEST_HEADER;
+    pcb_t* pcb = current_pcb();
+    uint32_t flags, count = pcb->preempt_count, deferred = sched_stats.deferred;
+    int8_t text[32] = {0};
+    int result = PASS;
+
+    cli_and_save(flags);
+    need_resched = 1;
+    preempt_disable();
+    preempt_disable();
+    preempt_check();                                            /* held off, counted */
+    preempt_enable();
+    irq_depth++;
+    preempt_check();                                            /* held off, not counted */
+    irq_depth--;
+    if (sched_stats.deferred != deferred + 1 || !need_resched || pcb->preempt_count != count + 1)
+        result = FAIL;
+    need_resched = 0;
+    preempt_enable();
+    if (pcb->preempt_count != count)
+        result = FAIL;
+    restore_flags(flags);
+
+    pcb->fd[2].file_position = 0;
+    if (schedstat_open((uint8_t*)"schedstat") || schedstat_read(2, text, sizeof(text) - 1) != sizeof(text) - 1
+        || strncmp(text, "context switches: ", 18))
+        result = FAIL;
+    return result;
+}
+
+/*
+* pipe_test
+*   DESCRIPTION: Opens both ends of a pipe in the current pcb and moves
+*                data through the ring without ever blocking: a wrap
+*                around the end of the buffer, a dup2 copy of the write
+*                end, end of file once every writer closes, and -1 for
+*                writes once the reader is gone
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if the bytes come out in order and the ends close
+*   SIDE EFFECTS: uses fds 2-4 of the current pcb
+*/
+int pipe_test() {
+    TEST_HEADER;
+    pcb_t* pcb = current_pcb();
+    static uint8_t in[2 * PIPE_SIZE], out[PIPE_SIZE];
+    int32_t p, i, result = PASS;
+
+    if ((p = pipe_create()) == -1)
+        return FAIL;
+    for (i = 2; i <= 3; i++) {
+        pcb->fd[i].file_ops = (file_operations_t*)(i == 2 ? &pipe_read_op : &pipe_write_op);
+        pcb->fd[i].sb = NULL;
+        pcb->fd[i].inode = p;
+        pcb->fd[i].flags = 1;
+    }
+    for (i = 0; i < 2 * PIPE_SIZE; i++)
+        in[i] = 'a' + i % 26;                                   /* no NUL, strncmp compares it all */
+
+    if (write(3, in, 3000) != 3000 || read(2, out, 2000) != 2000 || strncmp((int8_t*)in, (int8_t*)out, 2000))
+        result = FAIL;
+    if (write(3, in + 3000, 3000) != 3000)                     /* wraps, the buffer is nearly full */
+        result = FAIL;
+    if (read(2, out, PIPE_SIZE) != 4000 || strncmp((int8_t*)in + 2000, (int8_t*)out, 4000))
+        result = FAIL;
+
+    if (dup2(3, 4) != 4 || close(3) || write(4, in, 10) != 10)
+        result = FAIL;
+    close(4);
+    if (read(2, out, PIPE_SIZE) != 10 || read(2, out, PIPE_SIZE) != 0)
+        result = FAIL;                                          /* then end of file, no writers */
+    close(2);
+
+    if ((p = pipe_create()) == -1)
+        return FAIL;
+    pcb->fd[3].file_ops = (file_operations_t*)&pipe_write_op;
+    pcb->fd[3].inode = p;
+    pcb->fd[3].flags = 1;
+    pcb->fd[2].file_ops = (file_operations_t*)&pipe_read_op;
+    pcb->fd[2].inode = p;
+    pcb->fd[2].flags = 1;
+    close(2);
+    if (write(3, in, 10) != -1)                                 /* no reader left */
+        result = FAIL;
+    close(3);
+    return result;
+}
+
+/*
+* page_loan_test
+*   DESCRIPTION: Lends a page of one spare pid and maps it into another,
+*                the way a page-aligned pipe write reaches its reader:
+*                the reader sees the data in the same frame, the lender's
+*                page turns copy-on-write, and emptying both address
+*                spaces frees the frame
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if the frame is shared and then freed
+*   SIDE EFFECTS: none, the spare pids are emptied again
+*/
+int page_loan_test() {
+    TEST_HEADER;
+    uint32_t writer = MAX_TASKS - 2, reader = MAX_TASKS - 1;
+    uint32_t src = PROGRAM_IMAGE_ADDR, dst = PROGRAM_IMAGE_ADDR + 4 * PAGE_SIZE;
+    uint32_t flags, frame, used = paging_stats.frames_used;
+    int result = PASS;
+
+    if (GET_PCB(writer)->present || GET_PCB(reader)->present)
+        return FAIL;
+    cli_and_save(flags);
+    user_space_switch(writer);
+    if (user_page_map(writer, src) == -1) {
+        result = FAIL;
+    } else {
+        *(uint32_t*)src = 0x10AD;
+        if ((frame = user_page_loan(writer, src)) == 0 || frame_refs(frame) != 2)
+            result = FAIL;
+        user_space_switch(reader);
+        user_page_map(reader, dst);                 /* replaced, and freed, by the loaned frame */
+        user_page_accept(reader, dst, frame);
+        if (*(uint32_t*)dst != 0x10AD || frame_refs(frame) != 2 || paging_stats.frames_used != used + 1)
+            result = FAIL;
+        user_space_reset(reader);
+    }
+    user_space_reset(writer);
+    asm volatile ("movl %0, %%cr3" : : "r" (page_directory) : "memory");
+    restore_flags(flags);
+    if (paging_stats.frames_used != used)
+        result = FAIL;
+    return result;
+}
+
+/*
+* shm_test
+*   DESCRIPTION: Attaches a shared memory segment in two spare pids and
+*                checks that a write through one is read through the
+*                other at the same address, that the segment outlives
+*                the first to exit and is freed with the second
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if the memory is shared and then freed
+*   SIDE EFFECTS: none, the spare pids are emptied again
+*/
+int shm_test() {
+    TEST_HEADER;
+    uint32_t a = MAX_TASKS - 2, b = MAX_TASKS - 1;
+    uint32_t flags, used = paging_stats.frames_used;
+    int32_t key = 0x5348, addr;
+    int result = PASS;
+
+    if (GET_PCB(a)->present || GET_PCB(b)->present)
+        return FAIL;
+    if (shm_segment_create(key, 2 * PAGE_SIZE) || shm_segment_create(key, PAGE_SIZE)
+        || shm_segment_create(key, SHM_SEGMENT_SIZE) != -1 || paging_stats.frames_used != used + 2)
+        return FAIL;
+    cli_and_save(flags);
+    if ((addr = shm_segment_attach(a, key)) == -1 || shm_segment_attach(b, key) != addr)
+        result = FAIL;
+    if (result == PASS) {
+        user_space_switch(a);
+        *(uint32_t*)(addr + PAGE_SIZE) = 0x5348;
+        user_space_switch(b);
+        if (*(uint32_t*)(addr + PAGE_SIZE) != 0x5348 || *(uint32_t*)addr != 0)
+            result = FAIL;
+    }
+    asm volatile ("movl %0, %%cr3" : : "r" (page_directory) : "memory");
+    user_space_reset(a);
+    if (shm_segment_attach(a, key) != addr)                    /* still there for b */
+        result = FAIL;
+    user_space_reset(a);
+    user_space_reset(b);
+    restore_flags(flags);
+    if (shm_segment_attach(a, key) != -1 || paging_stats.frames_used != used)
+        result = FAIL;
+    return result;
+}
+
+/*
+* futex_test
+*   DESCRIPTION: Maps a user page for the running context and checks the
+*                futex calls that return without sleeping: a wait on a
+*                word that changed already, a wake with nobody waiting,
+*                and words that are misaligned or not user memory
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if none of them sleeps or wakes anything
+*   SIDE EFFECTS: none, the page is unmapped again
+*/
+int futex_test() {
+    TEST_HEADER;
+    uint32_t pid = current_pcb()->pid, flags;
+    int32_t* word = (int32_t*)PROGRAM_IMAGE_ADDR;
+    int result = PASS;
+
+    if (current_pcb()->present)
+        return FAIL;
+    cli_and_save(flags);
+    user_space_switch(pid);
+    if (user_page_map(pid, (uint32_t)word) == -1) {
+        result = FAIL;
+    } else {
+        *word = 1;
+        if (user_virt_to_phys(pid, (uint32_t)word) == 0 || user_virt_to_phys(pid, KERNEL_ADDR) != 0)
+            result = FAIL;
+        if (futex_wait(word, 0) != -1 || futex_wake(word, 1) != 0)
+            result = FAIL;
+        if (futex_wait((int32_t*)((uint32_t)word + 1), 1) != -1 || futex_wake((int32_t*)KERNEL_ADDR, 1) != -1)
+            result = FAIL;
+    }
+    user_space_reset(pid);
+    asm volatile ("movl %0, %%cr3" : : "r" (page_directory) : "memory");
+    restore_flags(flags);
+    return result;
+}
+
+/*
+* terminal_video_test
+*   DESCRIPTION: Prints on a terminal that is not shown and checks that
+*                the character lands in its own VGA page at its own
+*                cursor, leaving the shown screen and its cursor alone
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if the output went to the right terminal
+*   SIDE EFFECTS: prints an 'X' on a background terminal
+*/
+int terminal_video_test() {
+    TEST_HEADER;
+    uint32_t saved = *get_current_terminal(), other = (*get_active_terminal() + 1) % NUM_TERMINAL;
+    terminal_t* shown = get_terminal(*get_active_terminal());
+    terminal_t* term = get_terminal(other);
+    uint8_t cx = term->cx, cy = term->cy, shown_cx = shown->cx, shown_cy = shown->cy;
+    uint32_t flags;
+    int result = PASS;
+
+    if (term->video == shown->video || shown->video != (uint8_t*)VIDEO_MEMORY_ADDR + *get_active_terminal() * PAGE_SIZE)
+        return FAIL;
+    cli_and_save(flags);
+    *get_current_terminal() = other;
+    putc('X');
+    *get_current_terminal() = saved;
+    restore_flags(flags);
+    if (term->video[(cy * 80 + cx) << 1] != 'X' || shown->cx != shown_cx || shown->cy != shown_cy)
+        result = FAIL;
+    if (term->cx == cx && term->cy == cy)
+        result = FAIL;
+    return result;
+}
+
+/*
+* terminal_switch_bench_test
+*   DESCRIPTION: Times a terminal switch there and back against the two
+*                4KB screen copies each way that switching used to cost
+*   INPUTS: none
+*   OUTPUTS: cycles per switch, copied and through the CRTC
+*   RETURN VALUE: PASS if the shown terminal is restored
+*   SIDE EFFECTS: flips the screen to the next terminal and back
+*/
+int terminal_switch_bench_test() {
+    TEST_HEADER;
+    uint32_t active = *get_active_terminal(), other = (active + 1) % NUM_TERMINAL;
+    uint8_t* shown = get_terminal(active)->video;
+    uint8_t* saved = malloc(PAGE_SIZE);
+    uint32_t copied, crtc;
+    uint64_t start;
+
+    if (!saved)
+        return FAIL;
+    start = rdtsc();                        /* what a switch used to do: save the screen, load the other */
+    memcpy(saved, shown, PAGE_SIZE);
+    memcpy(shown, get_terminal(other)->video, PAGE_SIZE);
+    copied = (uint32_t)(rdtsc() - start);
+    memcpy(shown, saved, PAGE_SIZE);
+    free(saved);
+
+    start = rdtsc();
+    switch_terminal(other);
+    switch_terminal(active);
+    crtc = (uint32_t)(rdtsc() - start) / 2;
+
+    printf("terminal switch: %d cycles copying, %d through the CRTC", copied, crtc);
+    if (tsc_mhz)
+        printf(" (%d / %d ns)", copied * 1000 / tsc_mhz, crtc * 1000 / tsc_mhz);
+    printf("\n");
+    return *get_active_terminal() == active ? PASS : FAIL;
+}
+
+/*
+* console_test
+*   DESCRIPTION: Checks that only consoles in use can be shown, that each
+*                running console has its shell at the bottom of its
+*                process chain, and that unused consoles have no process
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if the consoles are set up as described
+*   SIDE EFFECTS: none
+*/
+int console_test() {
+    TEST_HEADER;
+    uint32_t i, active = *get_active_terminal();
+    pcb_t* pcb;
+    int result = PASS;
+
+    switch_terminal(get_num_terminals());               /* not in use, ignored */
+    if (*get_active_terminal() != active || get_num_terminals() > NUM_TERMINAL)
+        return FAIL;
+    for (i = 0; i < NUM_TERMINAL; i++) {
+        if (get_terminal(i)->pid == -1)
+            continue;
+        if (i >= get_num_terminals())
+            result = FAIL;
+        for (pcb = GET_PCB(get_terminal(i)->pid); pcb->parent; pcb = pcb->parent);
+        if (pcb->terminal != i)
+            result = FAIL;
+    }
+    return result;
+}
+
+/*
+* vfs_test
+*   DESCRIPTION: Resolves paths through the mount table and checks that
+*                repeating a lookup is served by the dentry cache
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: PASS if the paths resolve to the right filesystems
+*   SIDE EFFECTS: none
+*/
+int vfs_test() {
+    TEST_HEADER;
+    vfs_inode_t inode;
+    uint32_t hits, misses;
+    int result = PASS;
+
+    if (vfs_lookup((uint8_t*)"/frame0.txt", &inode) || inode.sb != &filesys_super || inode.type != 2)
+        result = FAIL;
+    if (vfs_lookup((uint8_t*)"/dev/rtc", &inode) || inode.sb != &devfs_super)
+        result = FAIL;
+    if (vfs_lookup((uint8_t*)"/frame0.txt/x", &inode) != -1 || vfs_lookup((uint8_t*)"/nothere", &inode) != -1)
+        result = FAIL;
+    if (tmpfs_create((uint8_t*)"vfs_test") || vfs_lookup((uint8_t*)"vfs_test", &inode) || inode.sb != &tmpfs_super)
+        result = FAIL;
+    if (tmpfs_unlink((uint8_t*)"vfs_test") || vfs_lookup((uint8_t*)"vfs_test", &inode) != -1)
+        result = FAIL;                              /* the cached component is gone */
+
+    hits = vfs_stats.hits;
+    misses = vfs_stats.misses;
+    vfs_lookup((uint8_t*)"/dev/bcstat", &inode);
+    vfs_lookup((uint8_t*)"/dev/bcstat", &inode);
+    if (vfs_stats.misses - misses > 2 || vfs_stats.hits - hits < 2)
+        result = FAIL;                              /* the second walk hits for both components */
+    return result;
+}
+
+/* Performance tests */
+
+/*
+* fs_read_throughput_test
+*   DESCRIPTION: Reads a whole file with read_data in chunks of the given
+*                size and prints the throughput; big.dat in the image from
+*                fstools/mkbigfs.sh exercises the indirect blocks
+*   INPUTS: filename - file to read, chunk - bytes per read_data call
+*   OUTPUTS: MB/s
+*   RETURN VALUE: PASS if every byte of the file was read
+*   SIDE EFFECTS: none
+*/
+int fs_read_throughput_test(uint8_t* filename, uint32_t chunk) {
+    TEST_HEADER;
+    dentry_t dentry;
+    uint8_t* buf;
+    uint32_t size, offset = 0, us;
+    int32_t count;
+    uint64_t start;
+
+    if (read_dentry_by_name(filename, &dentry) != 0 || !(buf = malloc(chunk)))
+        return FAIL;
+    size = inode_block[dentry.inode_num].file_size;
+
+    start = rdtsc();
+    while ((count = read_data(dentry.inode_num, offset, buf, chunk)) > 0)
+        offset += count;
+    us = tsc_to_us(rdtsc() - start);
+    free(buf);
+
+    printf("%s: %d bytes, %d byte reads, %d us", filename, offset, chunk, us);
+    if (us)
+        printf(", %d MB/s", offset / us);
+    printf("\n");
+    return offset == size ? PASS : FAIL;
+}
+
 /* Test suite entry point */
 void launch_tests(){
 	// TEST_OUTPUT("idt_test", idt_test());
@@ -431,6 +1497,22 @@ void launch_tests(){
 	//TEST_OUTPUT("IRQ enable test", irq_enable_test(100));
 	//TEST_OUTPUT("IRQ disable test", irq_disable_test(1));
 	// TEST_OUTPUT("All paging test", all_paging());
+	// TEST_OUTPUT("frame allocator test", frame_alloc_test());
+	// TEST_OUTPUT("task page directory test", task_directory_test());
+	// TEST_OUTPUT("context switch benchmark", ctx_switch_bench_test());
+	// TEST_OUTPUT("switch_to ping-pong benchmark", switch_bench_test());
+	// TEST_OUTPUT("fork benchmark", fork_bench_test());
+	// TEST_OUTPUT("waitpid test", waitpid_test());
+	// TEST_OUTPUT("thread test", thread_test());
+	// TEST_OUTPUT("signal test", signal_test());
+	// TEST_OUTPUT("preempt test", preempt_test());
+	// TEST_OUTPUT("pipe test", pipe_test());
+	// TEST_OUTPUT("pipe page loan test", page_loan_test());
+	// TEST_OUTPUT("shared memory test", shm_test());
+	// TEST_OUTPUT("futex test", futex_test());
+	// TEST_OUTPUT("terminal video test", terminal_video_test());
+	// TEST_OUTPUT("terminal switch benchmark", terminal_switch_bench_test());
+	// TEST_OUTPUT("console test", console_test());
 
 
 	
@@ -453,6 +1535,16 @@ void launch_tests(){
 	// TEST_OUTPUT("RTC Driver Test", rtc_driver_test_timer());
 	// TEST_OUTPUT("RTC Driver Test", rtc_driver_test('0'));
 
+	// TEST_OUTPUT("tmpfs test", tmpfs_test());
+	// TEST_OUTPUT("vfs test", vfs_test());
+	// TEST_OUTPUT("subdirectory test", fs_subdir_test());
+	// TEST_OUTPUT("lz4 image test", fs_lz4_test());
+	// TEST_OUTPUT("buffer cache test", bcache_test());
+	// TEST_OUTPUT("ata benchmark (PIO)", ata_bench_test(0));
+	// TEST_OUTPUT("ata benchmark (DMA)", ata_bench_test(1));
+	// TEST_OUTPUT("fs read throughput", fs_read_throughput_test((uint8_t*)"big.dat", 4096));
+	// TEST_OUTPUT("fs read throughput", fs_read_throughput_test((uint8_t*)"big.dat", 0x100000));
+
 	void *zero = malloc(0);
 	TEST_OUTPUT("zero-size memory", !zero);
 	
@@ -0,0 +1,404 @@
+#include "tmpfs.h"
+#include "malloc.h"
+#include "system_call.h"
+
+static tmpfs_file_t tmpfs_files[TMPFS_MAX_FILES];
+static void* free_pages = NULL;        /* recycled pages, linked through their first word */
+
+/*
+* tmpfs_alloc_page
+*   DESCRIPTION: Takes a page from the recycled list, or a fresh
+*                page-sized chunk from the kernel heap
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: the page, or NULL if the heap is exhausted
+*   SIDE EFFECTS: none
+*/
+static void* tmpfs_alloc_page(){
+    void* page = free_pages;
+    if(page){
+        free_pages = *(void**)page;
+        return page;
+    }
+    return malloc(TMPFS_PAGE_SIZE);
+}
+
+/*
+* tmpfs_free_page
+*   DESCRIPTION: Returns a page to the recycled list. Pages are kept by
+*                tmpfs rather than handed back to malloc so that
+*                rewriting a file never fragments the heap
+*   INPUTS: page - the page to recycle
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+static void tmpfs_free_page(void* page){
+    *(void**)page = free_pages;
+    free_pages = page;
+}
+
+/*
+* tmpfs_page
+*   DESCRIPTION: Finds the page holding byte \p offset of a file
+*   INPUTS: file - the file, offset - a byte offset below its capacity
+*   OUTPUTS: none
+*   RETURN VALUE: the page, or NULL if it was never allocated
+*   SIDE EFFECTS: none
+*/
+static uint8_t* tmpfs_page(tmpfs_file_t* file, uint32_t offset){
+    uint8_t** index = file->index[offset / (TMPFS_PTRS_PER_PAGE * TMPFS_PAGE_SIZE)];
+    return index ? index[(offset / TMPFS_PAGE_SIZE) % TMPFS_PTRS_PER_PAGE] : NULL;
+}
+
+/*
+* tmpfs_release
+*   DESCRIPTION: Frees every data and index page of a file
+*   INPUTS: file - the file to empty
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: the file's size becomes 0
+*/
+static void tmpfs_release(tmpfs_file_t* file){
+    uint32_t i, j;
+    for(i = 0; i < TMPFS_INDEX_PAGES && file->index[i]; i++){
+        for(j = 0; j < TMPFS_PTRS_PER_PAGE && file->index[i][j]; j++){
+            tmpfs_free_page(file->index[i][j]);
+        }
+        tmpfs_free_page(file->index[i]);
+        file->index[i] = NULL;
+    }
+    file->size = 0;
+}
+
+/*
+* tmpfs_lookup
+*   DESCRIPTION: Finds a linked tmpfs file by name
+*   INPUTS: fname - the name of the file
+*   OUTPUTS: none
+*   RETURN VALUE: the slot of the file, -1 if there is none
+*   SIDE EFFECTS: none
+*/
+int32_t tmpfs_lookup(const uint8_t* fname){
+    int i;
+    if(fname == NULL || strlen((int8_t*)fname) > MAX_FILE_NAME){
+        return -1;
+    }
+    for(i = 0; i < TMPFS_MAX_FILES; i++){
+        if(tmpfs_files[i].present && strncmp((int8_t*)fname, tmpfs_files[i].name, MAX_FILE_NAME) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+* tmpfs_create
+*   DESCRIPTION: Creates an empty file, or truncates an existing one.
+*                Names that already resolve elsewhere, such as files of
+*                the read-only boot image, cannot be shadowed
+*   INPUTS: fname - the name of the file
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: open fds of a truncated file see it empty
+*/
+int32_t tmpfs_create(const uint8_t* fname){
+    vfs_inode_t inode;
+    uint32_t flags;
+    int32_t i, len;
+
+    if(fname == NULL || (len = strlen((int8_t*)fname)) == 0 || len > MAX_FILE_NAME){
+        return -1;
+    }
+    for(i = 0; i < len; i++){
+        if(fname[i] == '/'){
+            return -1;                              /* tmpfs has no directories */
+        }
+    }
+    if(vfs_lookup(fname, &inode) == 0 && inode.sb != &tmpfs_super){
+        return -1;                                  /* "." or a boot image file or mount point */
+    }
+
+    cli_and_save(flags);
+    if((i = tmpfs_lookup(fname)) >= 0){
+        tmpfs_release(&tmpfs_files[i]);
+        restore_flags(flags);
+        return 0;
+    }
+    for(i = 0; i < TMPFS_MAX_FILES; i++){
+        if(!tmpfs_files[i].present && !tmpfs_files[i].opens){
+            memset(tmpfs_files[i].name, 0, MAX_FILE_NAME);
+            memcpy(tmpfs_files[i].name, fname, len);
+            tmpfs_files[i].size = 0;
+            tmpfs_files[i].present = 1;
+            restore_flags(flags);
+            return 0;
+        }
+    }
+    restore_flags(flags);
+    return -1;
+}
+
+/*
+* tmpfs_unlink
+*   DESCRIPTION: Removes a file's name. Its pages are freed now, or when
+*                the last fd on it is closed
+*   INPUTS: fname - the name of the file
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+int32_t tmpfs_unlink(const uint8_t* fname){
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    if((i = tmpfs_lookup(fname)) < 0){
+        restore_flags(flags);
+        return -1;
+    }
+    tmpfs_files[i].present = 0;
+    vfs_dcache_forget(&tmpfs_super, i);
+    if(!tmpfs_files[i].opens){
+        tmpfs_release(&tmpfs_files[i]);
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* tmpfs_dentry_by_index
+*   DESCRIPTION: Describes the index-th linked file, so that directory
+*                reads of "/" can list tmpfs after the boot image
+*   INPUTS: index - the position among linked files
+*   OUTPUTS: dentry - name, TMPFS_FILE_TYPE and slot of the file
+*   RETURN VALUE: 0 if success, -1 past the last file
+*   SIDE EFFECTS: none
+*/
+int32_t tmpfs_dentry_by_index(uint32_t index, dentry_t* dentry){
+    int i;
+    for(i = 0; i < TMPFS_MAX_FILES; i++){
+        if(tmpfs_files[i].present && index-- == 0){
+            memcpy(dentry->file_name, tmpfs_files[i].name, MAX_FILE_NAME);
+            dentry->file_type = TMPFS_FILE_TYPE;
+            dentry->inode_num = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+* tmpfs_size
+*   DESCRIPTION: Gets the size of a file
+*   INPUTS: inode - the slot of the file
+*   OUTPUTS: none
+*   RETURN VALUE: the size in bytes
+*   SIDE EFFECTS: none
+*/
+uint32_t tmpfs_size(uint32_t inode){
+    return inode < TMPFS_MAX_FILES ? tmpfs_files[inode].size : 0;
+}
+
+/*
+* tmpfs_open
+*   DESCRIPTION: Opens a tmpfs file
+*   INPUTS: filename - the path of the file
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: the file is kept alive until closed
+*/
+int32_t tmpfs_open(const uint8_t* filename){
+    vfs_inode_t inode;
+    if(vfs_lookup(filename, &inode) || inode.sb != &tmpfs_super || inode.ino >= TMPFS_MAX_FILES){
+        return -1;
+    }
+    tmpfs_files[inode.ino].opens++;
+    return 0;
+}
+
+/*
+* tmpfs_read
+*   DESCRIPTION: Reads from the fd's position, read() advances it
+*   INPUTS: fd - the file descriptor
+*           nbytes - the number of bytes to read
+*   OUTPUTS: buf - the data
+*   RETURN VALUE: the number of bytes read, 0 at the end of the file
+*   SIDE EFFECTS: none; each page is looked up and copied with interrupts
+*                 off, so a truncate or unlink in between cannot free it
+*                 under the copy, the read just stops at the new size
+*/
+int32_t tmpfs_read(int32_t fd, void* buf, int32_t nbytes){
+    file_descriptor_t* desc = &current_process()->fd[fd];
+    tmpfs_file_t* file = &tmpfs_files[desc->inode];
+    uint32_t pos = desc->file_position, done = 0, n, flags;
+    uint8_t* page;
+
+    if(buf == NULL || nbytes < 0){
+        return -1;
+    }
+    while(done < (uint32_t)nbytes){
+        cli_and_save(flags);
+        if(pos + done >= file->size || (page = tmpfs_page(file, pos + done)) == NULL){
+            restore_flags(flags);
+            break;
+        }
+        n = TMPFS_PAGE_SIZE - (pos + done) % TMPFS_PAGE_SIZE;
+        if(n > nbytes - done){
+            n = nbytes - done;
+        }
+        if(n > file->size - (pos + done)){
+            n = file->size - (pos + done);
+        }
+        memcpy((uint8_t*)buf + done, page + (pos + done) % TMPFS_PAGE_SIZE, n);
+        restore_flags(flags);
+        done += n;
+    }
+    return done;
+}
+
+/*
+* tmpfs_write
+*   DESCRIPTION: Appends to the end of the file, allocating a page
+*                (and an index page every 4MB) only when one fills up
+*   INPUTS: fd - the file descriptor
+*           buf - the data
+*           nbytes - the number of bytes to write
+*   OUTPUTS: none
+*   RETURN VALUE: the number of bytes written, -1 if nothing fit
+*   SIDE EFFECTS: interrupts are off for one page at a time
+*/
+int32_t tmpfs_write(int32_t fd, const void* buf, int32_t nbytes){
+    tmpfs_file_t* file = &tmpfs_files[current_process()->fd[fd].inode];
+    uint32_t done = 0, n, off, flags;
+    uint8_t* page;
+
+    if(buf == NULL || nbytes < 0){
+        return -1;
+    }
+
+    while(done < (uint32_t)nbytes){
+        cli_and_save(flags);
+        if(file->size >= TMPFS_MAX_SIZE){
+            restore_flags(flags);
+            break;
+        }
+        off = file->size % TMPFS_PAGE_SIZE;
+        if(off == 0){                               /* the last page is full */
+            uint32_t idx = file->size / (TMPFS_PTRS_PER_PAGE * TMPFS_PAGE_SIZE);
+            if(!file->index[idx]){
+                if(!(file->index[idx] = tmpfs_alloc_page())){
+                    restore_flags(flags);
+                    break;
+                }
+                memset(file->index[idx], 0, TMPFS_PAGE_SIZE);
+            }
+            if(!(page = tmpfs_alloc_page())){
+                restore_flags(flags);
+                break;
+            }
+            file->index[idx][(file->size / TMPFS_PAGE_SIZE) % TMPFS_PTRS_PER_PAGE] = page;
+        } else {
+            page = tmpfs_page(file, file->size);
+        }
+        n = TMPFS_PAGE_SIZE - off;
+        if(n > nbytes - done){
+            n = nbytes - done;
+        }
+        memcpy(page + off, (const uint8_t*)buf + done, n);
+        file->size += n;
+        restore_flags(flags);
+        done += n;
+    }
+    return (done || !nbytes) ? (int32_t)done : -1;
+}
+
+/*
+* tmpfs_close
+*   DESCRIPTION: Closes a tmpfs file
+*   INPUTS: fd - the file descriptor
+*   OUTPUTS: none
+*   RETURN VALUE: 0
+*   SIDE EFFECTS: frees an unlinked file when its last fd closes
+*/
+int32_t tmpfs_close(int32_t fd){
+    tmpfs_file_t* file = &tmpfs_files[current_process()->fd[fd].inode];
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if(file->opens && --file->opens == 0 && !file->present){
+        tmpfs_release(file);
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* tmpfs_dup
+*   DESCRIPTION: Takes another reference on a file for an fd copied
+*                by fork; the copy is closed on its own
+*   INPUTS: inode - the file slot
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+void tmpfs_dup(uint32_t inode){
+    if(inode < TMPFS_MAX_FILES){
+        tmpfs_files[inode].opens++;
+    }
+}
+
+/*
+* tmpfs_vfs_lookup
+*   DESCRIPTION: VFS lookup in the tmpfs directory
+*   INPUTS: sb - tmpfs, dir - TMPFS_ROOT, name - the file name
+*   OUTPUTS: inode - the file
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+static int32_t tmpfs_vfs_lookup(vfs_super_t* sb, uint32_t dir, const uint8_t* name, vfs_inode_t* inode){
+    int32_t i;
+    if(dir != TMPFS_ROOT || (i = tmpfs_lookup(name)) < 0){
+        return -1;
+    }
+    inode->sb = sb;
+    inode->ino = i;
+    inode->type = TMPFS_FILE_TYPE;
+    return 0;
+}
+
+/*
+* tmpfs_vfs_readdir
+*   DESCRIPTION: VFS directory listing of tmpfs
+*   INPUTS: sb - tmpfs, dir - TMPFS_ROOT, index - the position
+*   OUTPUTS: dentry - the entry
+*   RETURN VALUE: 0 if success, -1 past the last file
+*   SIDE EFFECTS: none
+*/
+static int32_t tmpfs_vfs_readdir(vfs_super_t* sb, uint32_t dir, uint32_t index, dentry_t* dentry){
+    return dir == TMPFS_ROOT ? tmpfs_dentry_by_index(index, dentry) : -1;
+}
+
+/*
+* tmpfs_vfs_fops
+*   DESCRIPTION: Gets the interface of a tmpfs file
+*   INPUTS: inode - the file
+*   OUTPUTS: none
+*   RETURN VALUE: the file operations
+*   SIDE EFFECTS: none
+*/
+static file_operations_t* tmpfs_vfs_fops(vfs_inode_t* inode){
+    return (file_operations_t*)&tmpfs_op;
+}
+
+static const vfs_super_ops_t tmpfs_vfs_ops = {
+    .lookup = tmpfs_vfs_lookup,
+    .readdir = tmpfs_vfs_readdir,
+    .fops = tmpfs_vfs_fops,
+};
+
+vfs_super_t tmpfs_super = {
+    .name = "tmpfs",
+    .ops = &tmpfs_vfs_ops,
+    .root = TMPFS_ROOT,
+};
@@ -0,0 +1,51 @@
+#ifndef _TMPFS_H
+#define _TMPFS_H
+
+#include "types.h"
+#include "lib.h"
+#include "filesys.h"
+#include "vfs.h"
+
+#define TMPFS_FILE_TYPE 3                       /* dentry file_type of a tmpfs file */
+#define TMPFS_MAX_FILES 32                      /* files that can exist at once */
+#define TMPFS_ROOT TMPFS_MAX_FILES              /* inode number of the directory, the others are slots */
+#define TMPFS_PAGE_SIZE BLOCK_SIZE              /* files grow one page at a time */
+#define TMPFS_PTRS_PER_PAGE (TMPFS_PAGE_SIZE / sizeof(uint8_t*))
+#define TMPFS_INDEX_PAGES 16                    /* 16 index pages * 1024 pages * 4KB = 64MB per file */
+#define TMPFS_MAX_SIZE (TMPFS_INDEX_PAGES * TMPFS_PTRS_PER_PAGE * TMPFS_PAGE_SIZE)
+
+typedef struct {
+    char name[MAX_FILE_NAME];                   /* not NUL-terminated at full length */
+    uint8_t present;                            /* 1 while the name is linked */
+    uint32_t opens;                             /* open fds, the pages outlive unlink until 0 */
+    uint32_t size;                              /* bytes written */
+    uint8_t** index[TMPFS_INDEX_PAGES];         /* index pages, each holding page pointers */
+} tmpfs_file_t;
+
+/* tmpfs as a VFS filesystem, mounted at "/" behind the boot image */
+extern vfs_super_t tmpfs_super;
+
+/* finds a linked tmpfs file by name, returns its slot or -1 */
+int32_t tmpfs_lookup(const uint8_t* fname);
+
+/* creates an empty file, or truncates an existing one */
+int32_t tmpfs_create(const uint8_t* fname);
+
+/* removes a file's name, its pages are freed once it is closed */
+int32_t tmpfs_unlink(const uint8_t* fname);
+
+/* the index-th linked file as a dentry, for dir_read */
+int32_t tmpfs_dentry_by_index(uint32_t index, dentry_t* dentry);
+
+/* size of the file in slot \p inode */
+uint32_t tmpfs_size(uint32_t inode);
+
+int32_t tmpfs_open(const uint8_t* filename);
+int32_t tmpfs_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t tmpfs_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t tmpfs_close(int32_t fd);
+
+/* one more open on a file, for an fd copied by fork */
+void tmpfs_dup(uint32_t inode);
+
+#endif
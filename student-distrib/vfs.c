@@ -0,0 +1,370 @@
+#include "vfs.h"
+#include "system_call.h"
+#include "devfs.h"
+#include "tmpfs.h"
+
+typedef struct {
+    vfs_super_t* sb;
+    vfs_inode_t parent;                     /* directory holding the mount point */
+    uint8_t name[MAX_FILE_NAME + 1];        /* "" for filesystems mounted at "/" */
+} vfs_mount_t;
+
+/* one cached path component: (parent, name) -> inode */
+typedef struct vfs_dentry {
+    vfs_inode_t parent;
+    uint8_t name[MAX_FILE_NAME + 1];
+    vfs_inode_t inode;
+    uint8_t valid;
+    struct vfs_dentry* next;                /* hash chain */
+} vfs_dentry_t;
+
+vfs_stats_t vfs_stats;
+
+static vfs_mount_t mounts[VFS_MAX_MOUNTS];
+static uint32_t num_mounts = 0;
+
+static vfs_dentry_t dcache[VFS_DCACHE_SIZE];
+static vfs_dentry_t* dcache_hash[VFS_DCACHE_BUCKETS];
+static uint32_t dcache_victim = 0;         /* next entry to recycle, FIFO */
+
+static const vfs_inode_t vfs_root = {NULL, 0, VFS_DIR_TYPE};
+
+/*
+* vfs_init
+*   DESCRIPTION: Builds the namespace: the boot image at "/" with tmpfs
+*                behind it for names the image does not have, and the
+*                devices at "/dev"
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+void vfs_init(){
+    vfs_mount((uint8_t*)"/", &filesys_super);
+    vfs_mount((uint8_t*)"/", &tmpfs_super);
+    vfs_mount((uint8_t*)"/dev", &devfs_super);
+}
+
+/*
+* vfs_same
+*   DESCRIPTION: Compares two inodes
+*   INPUTS: a, b - the inodes
+*   OUTPUTS: none
+*   RETURN VALUE: 1 if they are the same file, 0 otherwise
+*   SIDE EFFECTS: none
+*/
+static int32_t vfs_same(const vfs_inode_t* a, const vfs_inode_t* b){
+    return a->sb == b->sb && a->ino == b->ino;
+}
+
+/*
+* vfs_hash
+*   DESCRIPTION: FNV-1a over a component name, seeded with its parent
+*   INPUTS: parent - the directory, name - the component
+*   OUTPUTS: none
+*   RETURN VALUE: the dentry cache bucket
+*   SIDE EFFECTS: none
+*/
+static uint32_t vfs_hash(const vfs_inode_t* parent, const uint8_t* name){
+    uint32_t hash = 2166136261U ^ (uint32_t)parent->sb ^ parent->ino;
+    while(*name){
+        hash = (hash ^ *name++) * 16777619U;
+    }
+    return hash % VFS_DCACHE_BUCKETS;
+}
+
+/*
+* vfs_dcache_unlink
+*   DESCRIPTION: Takes an entry off its hash chain
+*   INPUTS: entry - a valid entry
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: the entry becomes invalid
+*/
+static void vfs_dcache_unlink(vfs_dentry_t* entry){
+    vfs_dentry_t** link = &dcache_hash[vfs_hash(&entry->parent, entry->name)];
+    while(*link != entry){
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    entry->valid = 0;
+}
+
+/*
+* vfs_dcache_flush
+*   DESCRIPTION: Empties the dentry cache, after the namespace changes
+*   INPUTS: none
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+static void vfs_dcache_flush(){
+    uint32_t i;
+    for(i = 0; i < VFS_DCACHE_SIZE; i++){
+        dcache[i].valid = 0;
+    }
+    for(i = 0; i < VFS_DCACHE_BUCKETS; i++){
+        dcache_hash[i] = NULL;
+    }
+}
+
+/*
+* vfs_dcache_forget
+*   DESCRIPTION: Drops every cached component naming an inode, or inside
+*                it, so that a removed file is never found again
+*   INPUTS: sb, ino - the inode
+*   OUTPUTS: none
+*   RETURN VALUE: none
+*   SIDE EFFECTS: none
+*/
+void vfs_dcache_forget(vfs_super_t* sb, uint32_t ino){
+    vfs_inode_t gone;
+    uint32_t i, flags;
+
+    gone.sb = sb;
+    gone.ino = ino;
+    cli_and_save(flags);
+    for(i = 0; i < VFS_DCACHE_SIZE; i++){
+        if(dcache[i].valid && (vfs_same(&dcache[i].inode, &gone) || vfs_same(&dcache[i].parent, &gone))){
+            vfs_dcache_unlink(&dcache[i]);
+        }
+    }
+    restore_flags(flags);
+}
+
+/*
+* vfs_resolve
+*   DESCRIPTION: Looks a component up without the cache. Mount points
+*                come first, then the directory's own filesystem, or at
+*                "/" every filesystem mounted there in mount order
+*   INPUTS: dir - the directory, name - the component
+*   OUTPUTS: inode - what the name refers to
+*   RETURN VALUE: 0 if success, -1 if there is no such file
+*   SIDE EFFECTS: none
+*/
+static int32_t vfs_resolve(const vfs_inode_t* dir, const uint8_t* name, vfs_inode_t* inode){
+    uint32_t i;
+    vfs_super_t* sb;
+
+    for(i = 0; i < num_mounts; i++){
+        if(mounts[i].name[0] && vfs_same(&mounts[i].parent, dir)
+           && strncmp((int8_t*)name, (int8_t*)mounts[i].name, MAX_FILE_NAME) == 0){
+            inode->sb = mounts[i].sb;
+            inode->ino = mounts[i].sb->root;
+            inode->type = VFS_DIR_TYPE;
+            return 0;
+        }
+    }
+    if(dir->sb){
+        return dir->sb->ops->lookup(dir->sb, dir->ino, name, inode);
+    }
+    for(i = 0; i < num_mounts; i++){
+        sb = mounts[i].sb;
+        if(!mounts[i].name[0] && sb->ops->lookup(sb, sb->root, name, inode) == 0){
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+* vfs_step
+*   DESCRIPTION: Looks a component up through the dentry cache, and
+*                caches what the filesystem found. Missing names are not
+*                cached, so creating a file needs no invalidation
+*   INPUTS: dir - the directory, name - the component
+*   OUTPUTS: inode - what the name refers to
+*   RETURN VALUE: 0 if success, -1 if there is no such file
+*   SIDE EFFECTS: may recycle the oldest cache entry
+*/
+static int32_t vfs_step(const vfs_inode_t* dir, const uint8_t* name, vfs_inode_t* inode){
+    uint32_t bucket = vfs_hash(dir, name), flags;
+    vfs_dentry_t* entry;
+
+    cli_and_save(flags);
+    for(entry = dcache_hash[bucket]; entry; entry = entry->next){
+        if(vfs_same(&entry->parent, dir) && strncmp((int8_t*)name, (int8_t*)entry->name, MAX_FILE_NAME) == 0){
+            *inode = entry->inode;
+            vfs_stats.hits++;
+            restore_flags(flags);
+            return 0;
+        }
+    }
+    vfs_stats.misses++;
+    if(vfs_resolve(dir, name, inode)){
+        restore_flags(flags);
+        return -1;
+    }
+
+    entry = &dcache[dcache_victim];
+    dcache_victim = (dcache_victim + 1) % VFS_DCACHE_SIZE;
+    if(entry->valid){
+        vfs_dcache_unlink(entry);
+    }
+    entry->parent = *dir;
+    strncpy((int8_t*)entry->name, (int8_t*)name, MAX_FILE_NAME + 1);
+    entry->inode = *inode;
+    entry->valid = 1;
+    entry->next = dcache_hash[bucket];
+    dcache_hash[bucket] = entry;
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+* vfs_lookup
+*   DESCRIPTION: Walks a path one component at a time from "/". Empty
+*                components and "." stay in the same directory
+*   INPUTS: path - the path, with or without a leading '/'
+*   OUTPUTS: inode - the file it names
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: none
+*/
+int32_t vfs_lookup(const uint8_t* path, vfs_inode_t* inode){
+    uint8_t name[MAX_FILE_NAME + 1];
+    vfs_inode_t cur = vfs_root, next;
+    uint32_t len;
+
+    if(path == NULL || path[0] == '\0'){
+        return -1;
+    }
+    while(*path){
+        if(*path == '/'){
+            path++;
+            continue;
+        }
+        for(len = 0; path[len] && path[len] != '/'; len++){
+            if(len == MAX_FILE_NAME){
+                return -1;
+            }
+        }
+        memcpy(name, path, len);
+        name[len] = '\0';
+        path += len;
+        if(cur.type != VFS_DIR_TYPE){
+            return -1;
+        }
+        if(len == 1 && name[0] == '.'){
+            continue;
+        }
+        if(vfs_step(&cur, name, &next)){
+            return -1;
+        }
+        cur = next;
+    }
+    *inode = cur;
+    return 0;
+}
+
+/*
+* vfs_mount
+*   DESCRIPTION: Mounts a filesystem. The mount point need not exist in
+*                the filesystem below it
+*   INPUTS: path - "/" or the path of the mount point
+*           sb - the filesystem
+*   OUTPUTS: none
+*   RETURN VALUE: 0 if success, -1 if fail
+*   SIDE EFFECTS: empties the dentry cache
+*/
+int32_t vfs_mount(const uint8_t* path, vfs_super_t* sb){
+    uint8_t parent[MAX_FILE_NAME * 4];
+    vfs_mount_t* m;
+    int32_t len, last;
+
+    if(path == NULL || sb == NULL || num_mounts == VFS_MAX_MOUNTS){
+        return -1;
+    }
+    len = strlen((int8_t*)path);
+    while(len > 0 && path[len - 1] == '/'){
+        len--;
+    }
+    for(last = len; last > 0 && path[last - 1] != '/'; last--);
+    if(len - last > MAX_FILE_NAME || last >= (int32_t)sizeof(parent)){
+        return -1;
+    }
+
+    m = &mounts[num_mounts];
+    m->sb = sb;
+    memset(m->name, 0, sizeof(m->name));
+    memcpy(m->name, path + last, len - last);
+    m->parent = vfs_root;
+    if(last > 0){
+        memcpy(parent, path, last);
+        parent[last] = '\0';
+        if(vfs_lookup(parent, &m->parent) || m->parent.type != VFS_DIR_TYPE){
+            return -1;
+        }
+    }
+    num_mounts++;
+    vfs_dcache_flush();
+    return 0;
+}
+
+/*
+* vfs_readdir_sb
+*   DESCRIPTION: Reads an entry of one filesystem's directory. Past the
+*                end, \p index is reduced by the number of entries so the
+*                caller can continue in the next source
+*   INPUTS: sb, dir - the directory, index - the position
+*   OUTPUTS: dentry - the entry, index - see above
+*   RETURN VALUE: 0 if found, -1 past the end
+*   SIDE EFFECTS: none
+*/
+static int32_t vfs_readdir_sb(vfs_super_t* sb, uint32_t dir, uint32_t* index, dentry_t* dentry){
+    uint32_t n;
+    if(sb->ops->readdir(sb, dir, *index, dentry) == 0){
+        return 0;
+    }
+    for(n = 0; n < *index && sb->ops->readdir(sb, dir, n, dentry) == 0; n++);
+    *index -= n;
+    return -1;
+}
+
+/*
+* vfs_readdir
+*   DESCRIPTION: Lists a directory: its own entries (at "/", those of
+*                every filesystem mounted there), then its mount points
+*   INPUTS: dir - the directory, index - the position
+*   OUTPUTS: dentry - the entry
+*   RETURN VALUE: 0 if success, -1 past the last entry
+*   SIDE EFFECTS: none
+*/
+int32_t vfs_readdir(vfs_inode_t* dir, uint32_t index, dentry_t* dentry){
+    uint32_t i;
+
+    if(dir->sb){
+        if(vfs_readdir_sb(dir->sb, dir->ino, &index, dentry) == 0){
+            return 0;
+        }
+    } else {
+        for(i = 0; i < num_mounts; i++){
+            if(!mounts[i].name[0] && vfs_readdir_sb(mounts[i].sb, mounts[i].sb->root, &index, dentry) == 0){
+                return 0;
+            }
+        }
+    }
+    for(i = 0; i < num_mounts; i++){
+        if(mounts[i].name[0] && vfs_same(&mounts[i].parent, dir) && index-- == 0){
+            memcpy(dentry->file_name, mounts[i].name, MAX_FILE_NAME);
+            dentry->file_type = VFS_DIR_TYPE;
+            dentry->inode_num = mounts[i].sb->root;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+* vfs_fops
+*   DESCRIPTION: Gets the interface an open fd on an inode uses
+*   INPUTS: inode - the file
+*   OUTPUTS: none
+*   RETURN VALUE: its file operations
+*   SIDE EFFECTS: none
+*/
+file_operations_t* vfs_fops(vfs_inode_t* inode){
+    if(inode->sb == NULL){
+        return (file_operations_t*)&dir_op;
+    }
+    return inode->sb->ops->fops(inode);
+}
@@ -0,0 +1,62 @@
+#ifndef _VFS_H
+#define _VFS_H
+
+#include "types.h"
+#include "lib.h"
+#include "filesys.h"
+
+#define VFS_DIR_TYPE 1                      /* dentry file_type of a directory, as in the boot image */
+#define VFS_MAX_MOUNTS 8
+#define VFS_DCACHE_SIZE 128                 /* cached path components */
+#define VFS_DCACHE_BUCKETS 64
+
+typedef struct vfs_super vfs_super_t;
+
+/* a file or directory of a mounted filesystem */
+typedef struct vfs_inode {
+    vfs_super_t* sb;                        /* NULL for the root of the namespace */
+    uint32_t ino;                           /* filesystem-specific inode number */
+    uint32_t type;                          /* dentry file_type */
+} vfs_inode_t;
+
+typedef struct vfs_super_ops {
+    /* finds \p name, one path component, in directory \p dir */
+    int32_t (*lookup)(vfs_super_t* sb, uint32_t dir, const uint8_t* name, vfs_inode_t* inode);
+    /* the \p index-th entry of directory \p dir, -1 past the last one */
+    int32_t (*readdir)(vfs_super_t* sb, uint32_t dir, uint32_t index, dentry_t* dentry);
+    /* the file operations an open fd on \p inode uses */
+    file_operations_t* (*fops)(vfs_inode_t* inode);
+} vfs_super_ops_t;
+
+struct vfs_super {
+    const int8_t* name;                     /* "bootfs", "tmpfs", "devfs" */
+    const vfs_super_ops_t* ops;
+    uint32_t root;                          /* inode number of the root directory */
+};
+
+typedef struct {
+    uint32_t hits;                          /* components found in the dentry cache */
+    uint32_t misses;                        /* components the filesystem had to look up */
+} vfs_stats_t;
+
+extern vfs_stats_t vfs_stats;
+
+/* mounts the boot image and tmpfs at "/" and the devices at "/dev" */
+void vfs_init();
+
+/* mounts \p sb at \p path, several filesystems at "/" are searched in mount order */
+int32_t vfs_mount(const uint8_t* path, vfs_super_t* sb);
+
+/* resolves a path, relative paths start at "/" */
+int32_t vfs_lookup(const uint8_t* path, vfs_inode_t* inode);
+
+/* the \p index-th entry of a directory, -1 past the last one */
+int32_t vfs_readdir(vfs_inode_t* dir, uint32_t index, dentry_t* dentry);
+
+/* the file operations for an open fd on \p inode */
+file_operations_t* vfs_fops(vfs_inode_t* inode);
+
+/* drops cached components naming an inode that is going away */
+void vfs_dcache_forget(vfs_super_t* sb, uint32_t ino);
+
+#endif
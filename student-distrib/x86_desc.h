@@ -26,7 +26,9 @@
 #define PAGE_TABLE_COUNT 1024       /* the amount of PTE */
 
 #define READBUF_SIZE 128
-#define NUM_TERMINAL 3
+#ifndef NUM_TERMINAL
+#define NUM_TERMINAL 3              /* consoles built in, CFLAGS+=-DNUM_TERMINAL=N for more */
+#endif
 
 #ifndef ASM
 
@@ -228,8 +230,9 @@ typedef union pte_t {
 typedef struct terminal {
     uint8_t terminal_buf[READBUF_SIZE];
     uint8_t num_echoed;
-    uint8_t cx;
+    uint8_t cx;                         /* cursor, kept per terminal */
     uint8_t cy;
+    uint8_t* video;                     /* its own VGA text page, shown by moving the start address */
     uint8_t idle;
     uint32_t pid;
     uint8_t halt;
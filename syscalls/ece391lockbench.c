@@ -0,0 +1,110 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SHM_KEY 0x4C4B
+#define ITERATIONS 200000
+#define MAX_WORKERS 4
+
+/* lives in shared memory, every worker updates it */
+typedef struct {
+    ece391_mutex_t lock;
+    ece391_cond_t done_cond;
+    volatile uint32_t counter;
+    volatile uint32_t done;             /* workers finished, guarded by lock */
+} shared_t;
+
+/* TSC in units of 1024 cycles, 32 bits last for hours at any clock */
+static uint32_t rdtsc_k ()
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return (hi << 22) | (lo >> 10);
+}
+
+static void put_num (const char* label, uint32_t value)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, num, 10));
+}
+
+/*
+ * Increments the shared counter ITERATIONS times under the mutex, then
+ * signals the condition variable the first worker waits on.  A worker
+ * preempted inside the critical section makes the others take the
+ * futex slow path until it runs again.
+ */
+static void work (shared_t* sh)
+{
+    uint32_t i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        ece391_mutex_lock (&sh->lock);
+        sh->counter++;
+        ece391_mutex_unlock (&sh->lock);
+    }
+    ece391_mutex_lock (&sh->lock);
+    sh->done++;
+    ece391_cond_signal (&sh->done_cond);
+    ece391_mutex_unlock (&sh->lock);
+}
+
+/*
+ * Runs workers processes, this one and forked children, on the same
+ * counter and waits on the condition variable until all are done.
+ */
+static int32_t bench (shared_t* sh, uint32_t workers)
+{
+    uint32_t i, start, kcycles;
+    int32_t status;
+
+    sh->counter = 0;
+    sh->done = 0;
+    start = rdtsc_k ();
+    for (i = 1; i < workers; i++) {
+        switch (ece391_fork ()) {
+        case -1:
+            ece391_fdputs (1, (uint8_t*)"fork failed\n");
+            return -1;
+        case 0:
+            work (sh);
+            ece391_halt (0);
+        }
+    }
+    work (sh);
+    ece391_mutex_lock (&sh->lock);
+    while (sh->done != workers)
+        ece391_cond_wait (&sh->done_cond, &sh->lock);
+    ece391_mutex_unlock (&sh->lock);
+    kcycles = rdtsc_k () - start;
+    for (i = 1; i < workers; i++)
+        ece391_waitpid (-1, &status, 0);
+
+    if (sh->counter != workers * ITERATIONS) {
+        put_num ("lost updates, counter ", sh->counter);
+        ece391_fdputs (1, (uint8_t*)"\n");
+        return -1;
+    }
+    put_num ("workers ", workers);
+    put_num (": ", kcycles * 1024 / (workers * ITERATIONS));
+    ece391_fdputs (1, (uint8_t*)" cycles per lock/unlock\n");
+    return 0;
+}
+
+int main ()
+{
+    int32_t addr;
+    uint32_t workers;
+
+    if (-1 == ece391_shm_create (SHM_KEY, sizeof(shared_t)) ||
+        -1 == (addr = ece391_shm_attach (SHM_KEY))) {
+        ece391_fdputs (1, (uint8_t*)"shared memory failed\n");
+        return 3;
+    }
+    for (workers = 1; workers <= MAX_WORKERS; workers *= 2)
+        if (-1 == bench ((shared_t*)addr, workers))
+            return 3;
+    return 0;
+}
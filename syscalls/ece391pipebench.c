@@ -0,0 +1,100 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define TOTAL_BYTES (64 * 1024 * 1024)
+#define MAX_CHUNK (1024 * 1024)
+#define PAGE 4096
+
+/* one spare page so that a write can start off a page boundary */
+static uint8_t wbuf[MAX_CHUNK + PAGE] __attribute__((aligned(PAGE)));
+static uint8_t rbuf[MAX_CHUNK] __attribute__((aligned(PAGE)));
+
+/* TSC in units of 1024 cycles, 32 bits last for hours at any clock */
+static uint32_t rdtsc_k ()
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return (hi << 22) | (lo >> 10);
+}
+
+static void put_num (const char* label, uint32_t value)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, num, 10));
+}
+
+/*
+ * Streams TOTAL_BYTES through a pipe from a forked child to this
+ * process, both ends moving the given chunk size per system call.
+ * The child writes one byte per page before each write, as a producer
+ * filling its buffer would.  With offset 0 the writes are page aligned
+ * and lend their pages to the reader; offset 1 forces the copying path.
+ * The time covers every write, read and the switches between them.
+ */
+static int32_t bench (uint32_t size, uint32_t offset)
+{
+    int32_t fds[2], cnt, status;
+    uint32_t done, page, start, kcycles;
+    uint8_t* buf = wbuf + offset;
+
+    if (-1 == ece391_pipe (fds)) {
+        ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+        return -1;
+    }
+
+    start = rdtsc_k ();
+    switch (ece391_fork ()) {
+    case -1:
+        ece391_fdputs (1, (uint8_t*)"fork failed\n");
+        return -1;
+    case 0:
+        ece391_close (fds[0]);
+        for (done = 0; done < TOTAL_BYTES; done += size) {
+            for (page = 0; page < size; page += PAGE)
+                buf[page] = 'a' + done % 26;
+            if (size != ece391_write (fds[1], buf, size))
+                ece391_halt (1);
+        }
+        ece391_halt (0);
+    }
+
+    ece391_close (fds[1]);
+    done = 0;
+    while (0 < (cnt = ece391_read (fds[0], rbuf, size)))
+        done += cnt;
+    kcycles = rdtsc_k () - start;
+    ece391_close (fds[0]);
+    ece391_waitpid (-1, &status, 0);
+
+    if (TOTAL_BYTES != done || 0 != status) {
+        put_num ("short transfer, bytes ", done);
+        ece391_fdputs (1, (uint8_t*)"\n");
+        return -1;
+    }
+    put_num ("chunk ", size);
+    ece391_fdputs (1, (uint8_t*)(offset ? " copy: " : " lend: "));
+    put_num ("", kcycles);
+    put_num (" kcycles, ", TOTAL_BYTES / (kcycles + 1));
+    ece391_fdputs (1, (uint8_t*)" bytes/kcycle (MB/s at 1GHz)\n");
+    return 0;
+}
+
+int main ()
+{
+    static const uint32_t sizes[] = {64, 512, 4096, 64 * 1024, MAX_CHUNK};
+    uint32_t i;
+
+    for (i = 0; i < MAX_CHUNK + PAGE; i++)
+        wbuf[i] = 'a' + i % 26;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (-1 == bench (sizes[i], 1))
+            return 3;
+        if (sizes[i] >= PAGE && -1 == bench (sizes[i], 0))
+            return 3;
+    }
+    return 0;
+}
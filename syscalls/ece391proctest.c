@@ -0,0 +1,175 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define CHILD_STATUS 42
+#define THREADS 2
+#define THREAD_STACK 4096
+#define ALARM_MS 20
+#define SPIN_LIMIT 0x40000000
+
+static volatile int32_t caught = -1;
+
+static uint8_t stacks[THREADS][THREAD_STACK] __attribute__((aligned(16)));
+static volatile int32_t shared[THREADS];
+
+/* TEST 1 wait_spawned
+ * spawns this program again with an exit status as its argument and
+ * waits for it, then checks that the child cannot be collected twice
+ * prints "[TEST_NAME]: PASS" if behavior is EXPECTED
+ *     and then returns 0
+ * prints "[TEST_NAME]: FAIL" if behavior is UNEXPECTED
+ *     and then returns 2
+ */
+int wait_spawned(void) {
+	int32_t pid, status = -1;
+	int fail = 0;
+	if (-1 == (pid = ece391_spawn ((uint8_t*)"proctest 42"))) {
+		ece391_fdputs (1, (uint8_t*)"spawn fail\n");
+		fail = 2;
+	} else {
+		if (pid != ece391_waitpid (pid, &status, 0) || CHILD_STATUS != status) {
+			fail = 2;
+			ece391_fdputs (1, (uint8_t*)"waitpid fail\n");
+		}
+		if (-1 != ece391_waitpid (pid, &status, WNOHANG)) {
+			fail = 2;
+			ece391_fdputs (1, (uint8_t*)"second waitpid fail\n");
+		}
+	}
+	if (-1 != ece391_waitpid (-1, &status, WNOHANG)) {
+		fail = 2;
+		ece391_fdputs (1, (uint8_t*)"no children fail\n");
+	}
+	if(fail) {
+		ece391_fdputs (1, (uint8_t*)"wait_spawned: FAIL\n");
+	} else {
+		ece391_fdputs (1, (uint8_t*)"wait_spawned: PASS\n");
+	}
+
+	return fail;
+}
+
+/* a thread of join_threads, marks its slot and halts with its number */
+static int32_t mark (void* arg)
+{
+	shared[(int32_t)arg] = 1;
+	return (int32_t)arg + 1;
+}
+
+/* TEST 2 join_threads
+ * starts THREADS threads that write to this process's memory and joins
+ * each of them, checking its status, the writes, and that a thread
+ * cannot be joined twice
+ * prints "[TEST_NAME]: PASS" if behavior is EXPECTED
+ *     and then returns 0
+ * prints "[TEST_NAME]: FAIL" if behavior is UNEXPECTED
+ *     and then returns 2
+ */
+int join_threads(void) {
+	int32_t i, status, tids[THREADS];
+	int fail = 0;
+	for (i = 0; i < THREADS; i++) {
+		shared[i] = 0;
+		if (-1 == (tids[i] = ece391_thread_create (mark, stacks[i] + THREAD_STACK, (void*)i))) {
+			fail = 2;
+			ece391_fdputs (1, (uint8_t*)"thread_create fail\n");
+		}
+	}
+	for (i = 0; i < THREADS; i++) {
+		if (-1 == tids[i])
+			continue;
+		status = -1;
+		if (tids[i] != ece391_thread_join (tids[i], &status) || i + 1 != status || !shared[i]) {
+			fail = 2;
+			ece391_fdputs (1, (uint8_t*)"thread_join fail\n");
+		}
+		if (-1 != ece391_thread_join (tids[i], &status)) {
+			fail = 2;
+			ece391_fdputs (1, (uint8_t*)"second thread_join fail\n");
+		}
+	}
+	if(fail) {
+		ece391_fdputs (1, (uint8_t*)"join_threads: FAIL\n");
+	} else {
+		ece391_fdputs (1, (uint8_t*)"join_threads: PASS\n");
+	}
+
+	return fail;
+}
+
+/* the ALARM handler of alarm_handled */
+void alarm_caught (int signum)
+{
+	caught = signum;
+}
+
+/* TEST 3 alarm_handled
+ * sets an ALARM handler and a short interval and spins until the handler
+ * has run; the loop's running sum must still be right afterwards, so
+ * sigreturn resumed the interrupted registers. sigreturn outside a
+ * handler fails
+ * prints "[TEST_NAME]: PASS" if behavior is EXPECTED
+ *     and then returns 0
+ * prints "[TEST_NAME]: FAIL" if behavior is UNEXPECTED
+ *     and then returns 2
+ */
+int alarm_handled(void) {
+	uint32_t i, sum = 0;
+	int fail = 0;
+	if (-1 != ece391_sigreturn ()) {
+		fail = 2;
+		ece391_fdputs (1, (uint8_t*)"sigreturn fail\n");
+	}
+	if (0 != ece391_set_handler (ALARM, alarm_caught) || -1 == ece391_alarm (ALARM_MS)) {
+		fail = 2;
+		ece391_fdputs (1, (uint8_t*)"set_handler fail\n");
+	}
+	for (i = 0; caught == -1 && i < SPIN_LIMIT; i++)
+		sum += i;
+	ece391_alarm (0);
+	ece391_set_handler (ALARM, 0);
+	if (ALARM != caught) {
+		fail = 2;
+		ece391_fdputs (1, (uint8_t*)"handler fail\n");
+	}
+	if (sum != (i % 2 ? i * ((i - 1) / 2) : (i / 2) * (i - 1))) {
+		fail = 2;
+		ece391_fdputs (1, (uint8_t*)"resume fail\n");
+	}
+	if(fail) {
+		ece391_fdputs (1, (uint8_t*)"alarm_handled: FAIL\n");
+	} else {
+		ece391_fdputs (1, (uint8_t*)"alarm_handled: PASS\n");
+	}
+
+	return fail;
+}
+
+/*
+ * Runs the process tests through the system calls; with an argument it
+ * is the child of wait_spawned and only halts with that status.
+ */
+int main ()
+{
+	uint8_t buf[32];
+	int32_t i, status = 0;
+	int fail = 0;
+
+	if (0 == ece391_getargs (buf, 32)) {
+		for (i = 0; buf[i] >= '0' && buf[i] <= '9'; i++)
+			status = status * 10 + buf[i] - '0';
+		return status;
+	}
+
+	fail += wait_spawned();
+	fail += join_threads();
+	fail += alarm_handled();
+	if(fail) {
+		ece391_fdputs (1, (uint8_t*)"\nOverall Tests: FAIL\n");
+	} else {
+		ece391_fdputs (1, (uint8_t*)"\nOverall Tests: PASS\n");
+	}
+	return fail;
+}
@@ -4,14 +4,113 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define MAX_STAGES 4
+#define SAVED_STDIN 6
+#define SAVED_STDOUT 7
+
+/* Reports the background jobs that finished since the last prompt. */
+static void reap_jobs ()
+{
+    int32_t pid, status;
+    uint8_t num[16];
+
+    while (0 < (pid = ece391_waitpid (-1, &status, WNOHANG))) {
+	ece391_fdputs (1, (uint8_t*)"[");
+	ece391_fdputs (1, ece391_itoa (pid, num, 10));
+	ece391_fdputs (1, (uint8_t*)"] done, status ");
+	ece391_fdputs (1, ece391_itoa (status, num, 10));
+	ece391_fdputs (1, (uint8_t*)"\n");
+    }
+}
+
+/*
+ * Splits buf at each '|' into the commands of a pipeline, trimming the
+ * spaces around them.  Returns how many there are, or 0 if one is empty
+ * or there are more than MAX_STAGES.
+ */
+static int32_t split_pipeline (uint8_t* buf, uint8_t* stage[])
+{
+    int32_t n = 0, last;
+    uint8_t *p = buf, *end;
+
+    while (1) {
+	while (' ' == *p)
+	    p++;
+	if (MAX_STAGES == n)
+	    return 0;
+	stage[n++] = p;
+	while ('\0' != *p && '|' != *p)
+	    p++;
+	for (end = p; end > stage[n - 1] && ' ' == end[-1]; end--);
+	if (end == stage[n - 1])
+	    return 0;
+	last = ('\0' == *p);
+	*end = '\0';
+	if (last)
+	    return n;
+	p++;
+    }
+}
+
+/*
+ * Runs "a | b": every command but the last is spawned with its stdout
+ * on a pipe that the next one gets as its stdin.  The shell keeps its
+ * own stdin and stdout in SAVED_STDIN and SAVED_STDOUT meanwhile, since
+ * a new program inherits fds 0 and 1.  The last command runs like any
+ * other, then the shell waits for the rest; in the background the last
+ * one is spawned too and all of them are left to reap_jobs.  Returns
+ * what execute returned, or -1 if a command could not start.
+ */
+static int32_t run_pipeline (uint8_t* stage[], int32_t n, int32_t background)
+{
+    int32_t i, fds[2], pids[MAX_STAGES], status, started = 0, rval = -1;
+    uint8_t num[16];
+
+    ece391_dup2 (0, SAVED_STDIN);
+    ece391_dup2 (1, SAVED_STDOUT);
+    for (i = 0; i < n - 1; i++) {
+	if (-1 == ece391_pipe (fds))
+	    break;
+	ece391_dup2 (fds[1], 1);
+	pids[started] = ece391_spawn (stage[i]);
+	ece391_dup2 (SAVED_STDOUT, 1);
+	ece391_close (fds[1]);		/* only the writer holds it, for end of file */
+	ece391_dup2 (fds[0], 0);
+	ece391_close (fds[0]);
+	if (-1 == pids[started])
+	    break;
+	started++;
+    }
+    if (n - 1 == i) {
+	if (!background) {
+	    rval = ece391_execute (stage[i]);
+	} else if (-1 != (rval = ece391_spawn (stage[i]))) {
+	    ece391_fdputs (1, (uint8_t*)"[");
+	    ece391_fdputs (1, ece391_itoa (rval, num, 10));
+	    ece391_fdputs (1, (uint8_t*)"]\n");
+	    rval = 0;
+	}
+    }
+    /* the earlier commands see their reader go away if the last one failed */
+    ece391_dup2 (SAVED_STDIN, 0);
+    ece391_close (SAVED_STDIN);
+    ece391_close (SAVED_STDOUT);
+    if (!background)
+	for (i = 0; i < started; i++)
+	    ece391_waitpid (pids[i], &status, 0);
+    return rval;
+}
 
 int main ()
 {
-    int32_t cnt, rval;
+    int32_t cnt, rval, background, n;
     uint8_t buf[BUFSIZE];
+    uint8_t* stage[MAX_STAGES];
+    uint8_t num[16];
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
 
     while (1) {
+	reap_jobs ();
         ece391_fdputs (1, (uint8_t*)"391OS> ");
 	if (-1 == (cnt = ece391_read (0, buf, BUFSIZE-1))) {
 	    ece391_fdputs (1, (uint8_t*)"read from keyboard failed\n");
@@ -19,12 +118,40 @@ int main ()
 	}
 	if (cnt > 0 && '\n' == buf[cnt - 1])
 	    cnt--;
+	/* a trailing '&' runs the command in the background */
+	while (cnt > 0 && ' ' == buf[cnt - 1])
+	    cnt--;
+	background = (cnt > 0 && '&' == buf[cnt - 1]);
+	if (background) {
+	    cnt--;
+	    while (cnt > 0 && ' ' == buf[cnt - 1])
+		cnt--;
+	}
 	buf[cnt] = '\0';
 	if (0 == ece391_strcmp (buf, (uint8_t*)"exit"))
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
-	rval = ece391_execute (buf);
+	if (0 == (n = split_pipeline (buf, stage))) {
+	    ece391_fdputs (1, (uint8_t*)"bad pipeline\n");
+	    continue;
+	}
+	if (1 < n) {
+	    rval = run_pipeline (stage, n, background);
+	    if (background && -1 != rval)
+		continue;
+	} else if (background) {
+	    if (-1 == (rval = ece391_spawn (buf))) {
+		ece391_fdputs (1, (uint8_t*)"no such command\n");
+	    } else {
+		ece391_fdputs (1, (uint8_t*)"[");
+		ece391_fdputs (1, ece391_itoa (rval, num, 10));
+		ece391_fdputs (1, (uint8_t*)"]\n");
+	    }
+	    continue;
+	} else {
+	    rval = ece391_execute (buf);
+	}
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
 	else if (256 == rval)
@@ -0,0 +1,118 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SHM_KEY 0x5348
+#define MSG_SIZE 4096
+#define ROUNDS 1000
+
+static uint8_t msg[MSG_SIZE];
+
+/* TSC in units of 1024 cycles, 32 bits last for hours at any clock */
+static uint32_t rdtsc_k ()
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return (hi << 22) | (lo >> 10);
+}
+
+static void put_num (const char* label, uint32_t value)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, num, 10));
+}
+
+/* stands in for producing a message: writes every byte of it */
+static void fill (uint8_t* buf, uint32_t round)
+{
+    uint32_t i;
+    for (i = 0; i < MSG_SIZE; i++)
+        buf[i] = round + i;
+}
+
+/*
+ * One side of the ping-pong.  With shm the message is produced in the
+ * shared segment and a one byte token on the pipe only wakes the other
+ * side; without it the whole message goes through the pipe and the
+ * kernel copies it twice.
+ */
+static int32_t side (int32_t in, int32_t out, uint8_t* shm, int32_t first)
+{
+    uint32_t round;
+    uint8_t token;
+
+    for (round = 0; round < ROUNDS; round++) {
+        if (!first || round) {
+            if (shm) {
+                if (1 != ece391_read (in, &token, 1))
+                    return -1;
+            } else {
+                if (MSG_SIZE != ece391_read (in, msg, MSG_SIZE))
+                    return -1;      /* a pipe write this size arrives whole */
+            }
+        }
+        fill (shm ? shm : msg, round);
+        if (shm ? 1 != ece391_write (out, &token, 1)
+                : MSG_SIZE != ece391_write (out, msg, MSG_SIZE))
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * Times ROUNDS round trips of a MSG_SIZE message between this process
+ * and a forked child, through shared memory or through the pipes alone.
+ */
+static int32_t bench (uint8_t* shm)
+{
+    int32_t to_child[2], to_parent[2], status;
+    uint32_t start, kcycles;
+    uint8_t token;
+
+    if (-1 == ece391_pipe (to_child) || -1 == ece391_pipe (to_parent)) {
+        ece391_fdputs (1, (uint8_t*)"pipe failed\n");
+        return -1;
+    }
+
+    start = rdtsc_k ();
+    switch (ece391_fork ()) {
+    case -1:
+        ece391_fdputs (1, (uint8_t*)"fork failed\n");
+        return -1;
+    case 0:
+        ece391_halt (side (to_child[0], to_parent[1], shm, 0) ? 1 : 0);
+    }
+    if (-1 == side (to_parent[0], to_child[1], shm, 1) ||
+        (shm ? 1 != ece391_read (to_parent[0], &token, 1)
+             : MSG_SIZE != ece391_read (to_parent[0], msg, MSG_SIZE))) {
+        ece391_fdputs (1, (uint8_t*)"ping-pong failed\n");
+        return -1;
+    }
+    kcycles = rdtsc_k () - start;
+    ece391_waitpid (-1, &status, 0);
+    ece391_close (to_child[0]);
+    ece391_close (to_child[1]);
+    ece391_close (to_parent[0]);
+    ece391_close (to_parent[1]);
+
+    ece391_fdputs (1, (uint8_t*)(shm ? "shared memory: " : "pipe copy:     "));
+    put_num ("", kcycles * 1024 / ROUNDS);
+    ece391_fdputs (1, (uint8_t*)" cycles per round trip\n");
+    return 0;
+}
+
+int main ()
+{
+    int32_t addr;
+
+    if (-1 == ece391_shm_create (SHM_KEY, MSG_SIZE) ||
+        -1 == (addr = ece391_shm_attach (SHM_KEY))) {
+        ece391_fdputs (1, (uint8_t*)"shared memory failed\n");
+        return 3;
+    }
+    if (-1 == bench (0) || -1 == bench ((uint8_t*)addr))
+        return 3;
+    return 0;
+}
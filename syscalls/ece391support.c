@@ -102,3 +102,75 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+/* Atomically replaces *p with val if it holds old; returns what it held */
+static int32_t cmpxchg(volatile int32_t* p, int32_t old, int32_t val)
+{
+    int32_t prev;
+    asm volatile ("lock; cmpxchgl %2, %1"
+                  : "=a"(prev), "+m"(*p)
+                  : "r"(val), "0"(old)
+                  : "memory", "cc");
+    return prev;
+}
+
+/* Atomically stores val in *p; returns what it held */
+static int32_t xchg(volatile int32_t* p, int32_t val)
+{
+    asm volatile ("xchgl %0, %1"
+                  : "+r"(val), "+m"(*p)
+                  :
+                  : "memory");
+    return val;
+}
+
+/*
+ * The three-state futex mutex: a free mutex is taken with one cmpxchg;
+ * otherwise the taker marks it 2 and sleeps until it gets it, so that
+ * the holder knows to wake someone when it lets go.
+ */
+void ece391_mutex_lock(ece391_mutex_t* m)
+{
+    int32_t c;
+
+    if (0 == (c = cmpxchg(&m->state, 0, 1)))
+        return;
+    if (2 != c)
+        c = xchg(&m->state, 2);
+    while (0 != c) {
+        ece391_futex_wait((int32_t*)&m->state, 2);
+        c = xchg(&m->state, 2);
+    }
+}
+
+void ece391_mutex_unlock(ece391_mutex_t* m)
+{
+    if (2 == xchg(&m->state, 0))
+        ece391_futex_wake((int32_t*)&m->state, 1);
+}
+
+/*
+ * Sleeps until a signal that comes after the mutex is released; the
+ * sequence number read under the mutex makes a signal sent in between
+ * fail the futex_wait instead of being lost.  Wake ups may be spurious,
+ * callers check their condition in a loop.
+ */
+void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m)
+{
+    int32_t seq = c->seq;
+
+    ece391_mutex_unlock(m);
+    ece391_futex_wait((int32_t*)&c->seq, seq);
+    ece391_mutex_lock(m);
+}
+
+void ece391_cond_signal(ece391_cond_t* c)
+{
+    asm volatile ("lock; incl %0" : "+m"(c->seq) : : "memory", "cc");
+    ece391_futex_wake((int32_t*)&c->seq, 1);
+}
+
+void ece391_cond_broadcast(ece391_cond_t* c)
+{
+    asm volatile ("lock; incl %0" : "+m"(c->seq) : : "memory", "cc");
+    ece391_futex_wake((int32_t*)&c->seq, 0x7FFFFFFF);
+}
@@ -9,5 +9,25 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/*
+ * A mutex and a condition variable on futex_wait/futex_wake.  Both start
+ * zeroed, and work between processes when they live in shared memory.
+ * Taking a free mutex and releasing one nobody waits for make no system
+ * call.
+ */
+typedef struct {
+    volatile int32_t state;     /* 0 free, 1 held, 2 held and maybe waited for */
+} ece391_mutex_t;
+
+typedef struct {
+    volatile int32_t seq;       /* bumped by every signal */
+} ece391_cond_t;
+
+extern void ece391_mutex_lock(ece391_mutex_t* m);
+extern void ece391_mutex_unlock(ece391_mutex_t* m);
+extern void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m);
+extern void ece391_cond_signal(ece391_cond_t* c);
+extern void ece391_cond_broadcast(ece391_cond_t* c);
+
 #endif /* ECE391SUPPORT_H */
 
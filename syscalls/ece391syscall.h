@@ -19,9 +19,74 @@ extern int32_t ece391_open (const uint8_t* filename);
 extern int32_t ece391_close (int32_t fd);
 extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
+
+/*
+ * set_handler installs a function called with the signal number when the
+ * signal arrives (0 restores the default: DIV_ZERO, SEGFAULT and INTERRUPT
+ * kill the program, ALARM and USER1 are ignored).  The interrupted
+ * registers sit on the stack above the signal number, as ebx, ecx, edx,
+ * esi, edi, ebp, eax, ds, es, fs, error code, eip, cs, eflags, esp, ss,
+ * and the handler may change them; returning from it calls sigreturn.
+ */
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 
+/* tmpfs: create makes an empty file (truncating an existing one), writes append */
+extern int32_t ece391_create (const uint8_t* filename);
+extern int32_t ece391_unlink (const uint8_t* filename);
+
+/* the child's pid in the parent, 0 in the child; pages are shared copy-on-write */
+extern int32_t ece391_fork (void);
+
+/*
+ * spawn starts a program and returns its pid at once; waitpid collects
+ * a child made by fork or spawn (pid -1: any), returning its pid, or 0
+ * with WNOHANG while it still runs.  The status is 256 after an exception.
+ */
+#define WNOHANG 1
+extern int32_t ece391_spawn (const uint8_t* command);
+extern int32_t ece391_waitpid (int32_t pid, int32_t* status, int32_t options);
+
+/*
+ * pipe opens a read end in fds[0] and a write end in fds[1]; reads wait
+ * for data and return 0 once no write end is open.  dup2 makes newfd a
+ * copy of oldfd, closing newfd first; new programs inherit fds 0 and 1.
+ * isatty is 1 for the terminal, 0 for anything else.
+ */
+extern int32_t ece391_pipe (int32_t* fds);
+extern int32_t ece391_dup2 (int32_t oldfd, int32_t newfd);
+extern int32_t ece391_isatty (int32_t fd);
+
+/*
+ * shm_create makes a zeroed segment of up to 512KB named by a nonzero
+ * key (0 if it already exists); shm_attach maps it, at the same address
+ * in every process, and returns that address.  A forked child stays
+ * attached.  The segment goes away when the last process attached exits.
+ */
+extern int32_t ece391_shm_create (int32_t key, uint32_t size);
+extern int32_t ece391_shm_attach (int32_t key);
+
+/*
+ * futex_wait sleeps while *addr == expected (-1 at once if it is not)
+ * until a futex_wake on the same word, found by its physical address so
+ * shared memory works; it may return spuriously.  futex_wake wakes up to
+ * n sleepers and returns how many it woke.
+ */
+extern int32_t ece391_futex_wait (int32_t* addr, int32_t expected);
+extern int32_t ece391_futex_wake (int32_t* addr, int32_t n);
+
+/*
+ * thread_create runs fn(arg) in another thread of this process, on the
+ * stack whose top is stack, and returns its id; returning from fn halts
+ * the thread with fn's value.  thread_join waits for a thread to halt and
+ * stores that value (256 after an exception) in *status.
+ */
+extern int32_t ece391_thread_create (int32_t (*fn)(void*), void* stack, void* arg);
+extern int32_t ece391_thread_join (int32_t tid, int32_t* status);
+
+/* ALARM every interval_ms from now, 0 to stop; the default is every 10s */
+extern int32_t ece391_alarm (int32_t interval_ms);
+
 enum signums {
 	DIV_ZERO = 0,
 	SEGFAULT,
@@ -11,5 +11,20 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_CREATE  11
+#define SYS_UNLINK  12
+#define SYS_FORK    13
+#define SYS_SPAWN   14
+#define SYS_WAITPID 15
+#define SYS_PIPE    16
+#define SYS_DUP2    17
+#define SYS_ISATTY  18
+#define SYS_SHM_CREATE 19
+#define SYS_SHM_ATTACH 20
+#define SYS_FUTEX_WAIT 21
+#define SYS_FUTEX_WAKE 22
+#define SYS_THREAD_CREATE 23
+#define SYS_THREAD_JOIN 24
+#define SYS_ALARM 25
 
 #endif /* ECE391SYSNUM_H */
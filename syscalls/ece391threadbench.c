@@ -0,0 +1,116 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define RTC_FREQ 64
+#define RTC_TICKS 16                    /* 250ms of blocking reads */
+#define COMPUTE_ROUNDS 8
+#define COMPUTE_STEPS 2000000
+#define WORKERS 2
+#define THREAD_STACK 4096
+
+static uint8_t stacks[WORKERS][THREAD_STACK] __attribute__((aligned(16)));
+static ece391_mutex_t lock;
+static volatile uint32_t total;         /* guarded by lock */
+
+/* TSC in units of 1024 cycles, 32 bits last for hours at any clock */
+static uint32_t rdtsc_k ()
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return (hi << 22) | (lo >> 10);
+}
+
+static void put_num (const char* label, uint32_t value)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, num, 10));
+}
+
+/* a slice of pure computation, adds its result to total under the lock */
+static int32_t compute (void* arg)
+{
+    uint32_t i, x = (uint32_t)arg;
+
+    for (i = 0; i < COMPUTE_STEPS / COMPUTE_ROUNDS; i++)
+        x = x * 1103515245 + 12345;
+    ece391_mutex_lock (&lock);
+    total += x >> 16;
+    ece391_mutex_unlock (&lock);
+    return 0;
+}
+
+/* the share of the rounds a worker thread computes */
+static int32_t worker (void* arg)
+{
+    uint32_t i;
+
+    for (i = (uint32_t)arg; i < COMPUTE_ROUNDS; i += WORKERS)
+        compute ((void*)i);
+    return 0;
+}
+
+/* the blocking part, the process sleeps in the RTC read between ticks */
+static int32_t wait_ticks (int32_t rtc)
+{
+    int32_t i, garbage;
+
+    for (i = 0; i < RTC_TICKS; i++)
+        if (-1 == ece391_read (rtc, &garbage, 4))
+            return -1;
+    return 0;
+}
+
+/*
+ * Does the same computation and RTC waits twice: one after the other in
+ * the main thread, then with the computation split over WORKERS threads
+ * that run while the main thread is blocked on the RTC.
+ */
+int main ()
+{
+    int32_t rtc, freq = RTC_FREQ, status;
+    int32_t tids[WORKERS];
+    uint32_t i, start, serial, threaded, serial_total;
+
+    if (-1 == (rtc = ece391_open ((uint8_t*)"rtc")) ||
+        -1 == ece391_write (rtc, &freq, 4)) {
+        ece391_fdputs (1, (uint8_t*)"rtc failed\n");
+        return 3;
+    }
+
+    total = 0;
+    start = rdtsc_k ();
+    for (i = 0; i < COMPUTE_ROUNDS; i++)
+        compute ((void*)i);
+    if (-1 == wait_ticks (rtc))
+        return 3;
+    serial = rdtsc_k () - start;
+    serial_total = total;
+
+    total = 0;
+    start = rdtsc_k ();
+    for (i = 0; i < WORKERS; i++) {
+        if (-1 == (tids[i] = ece391_thread_create (worker, stacks[i] + THREAD_STACK, (void*)i))) {
+            ece391_fdputs (1, (uint8_t*)"thread_create failed\n");
+            return 3;
+        }
+    }
+    if (-1 == wait_ticks (rtc))
+        return 3;
+    for (i = 0; i < WORKERS; i++)
+        if (-1 == ece391_thread_join (tids[i], &status))
+            return 3;
+    threaded = rdtsc_k () - start;
+    ece391_close (rtc);
+
+    if (total != serial_total) {
+        ece391_fdputs (1, (uint8_t*)"threads lost an update\n");
+        return 3;
+    }
+    put_num ("serial: ", serial);
+    put_num (" kcycles, threaded: ", threaded);
+    ece391_fdputs (1, (uint8_t*)" kcycles\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BENCH_FILE "wbench.out"
+#define TOTAL_BYTES (256 * 1024)
+#define MAX_WRITE 4096
+
+static uint8_t buf[MAX_WRITE];
+
+static uint32_t rdtsc_lo ()
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static void put_num (const char* label, uint32_t value)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, (uint8_t*)label);
+    ece391_fdputs (1, ece391_itoa (value, num, 10));
+}
+
+/*
+ * Appends TOTAL_BYTES to a fresh tmpfs file in writes of the given
+ * size.  The cycle count fits in 32 bits as long as a write stays
+ * under ~16K cycles per byte, which all sizes here do.
+ */
+static int32_t bench (uint32_t size)
+{
+    int32_t fd;
+    uint32_t done, start, cycles;
+
+    if (-1 == ece391_create ((uint8_t*)BENCH_FILE) ||
+        -1 == (fd = ece391_open ((uint8_t*)BENCH_FILE))) {
+        ece391_fdputs (1, (uint8_t*)"cannot create " BENCH_FILE "\n");
+        return -1;
+    }
+
+    start = rdtsc_lo ();
+    for (done = 0; done < TOTAL_BYTES; done += size) {
+        if (size != ece391_write (fd, buf, size)) {
+            ece391_fdputs (1, (uint8_t*)"write failed\n");
+            ece391_close (fd);
+            return -1;
+        }
+    }
+    cycles = rdtsc_lo () - start;
+    ece391_close (fd);
+
+    put_num ("write size ", size);
+    put_num (": ", TOTAL_BYTES / size);
+    put_num (" writes, ", cycles / (TOTAL_BYTES / size));
+    put_num (" cycles/write, ", cycles ? (uint32_t)TOTAL_BYTES / (cycles / 1000 + 1) : 0);
+    ece391_fdputs (1, (uint8_t*)" bytes/kcycle (MB/s at 1GHz)\n");
+    return 0;
+}
+
+int main ()
+{
+    static const uint32_t sizes[] = {1, 128, 4096};
+    uint32_t i;
+
+    for (i = 0; i < MAX_WRITE; i++)
+        buf[i] = 'a' + i % 26;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        if (-1 == bench (sizes[i]))
+            return 3;
+
+    ece391_unlink ((uint8_t*)BENCH_FILE);
+    return 0;
+}